@@ -0,0 +1,273 @@
+#include "findmax.h"
+#include <math.h>
+#include <stdint.h>
+
+// Sampling-based approximate top-N (--approx).
+//
+// Unread directories wait in a frontier ordered by a randomized priority
+// (Efraimidis-Spirakis weighted sampling without replacement), weighted by
+// the number of entries estimated from the directory's own st_size. A
+// directory whose entries made it into the result heap boosts the weight
+// of its subdirectories, so sampling refines where good candidates live.
+// The walk stops after opts->approx_dirs directories or at the deadline.
+
+// Average on-disk directory entry size used to turn st_size into an
+// entry count estimate (ext4 and tmpfs both land near 20-32 bytes)
+#define APPROX_DIRENT_BYTES 24
+
+typedef struct {
+    char *path;
+    int depth;
+    dev_t dev;
+    double key;
+    double estimate;
+    double boost;
+    ignore_rules_t *rules;
+} approx_dir_t;
+
+// Subdirectory of the directory being read, pushed once its yield is known
+typedef struct {
+    char *path;
+    dev_t dev;
+    double estimate;
+} approx_child_t;
+
+typedef struct {
+    approx_dir_t *dirs;
+    size_t size;
+    size_t capacity;
+    double estimate_sum;
+} approx_frontier_t;
+
+// xorshift64*, reseeded with a constant at the start of every run so runs
+// are reproducible, also from one --batch query to the next
+#define APPROX_RNG_SEED 0x9E3779B97F4A7C15ULL
+static uint64_t approx_rng_state = APPROX_RNG_SEED;
+
+static double approx_random(void) {
+    approx_rng_state ^= approx_rng_state >> 12;
+    approx_rng_state ^= approx_rng_state << 25;
+    approx_rng_state ^= approx_rng_state >> 27;
+    uint64_t r = approx_rng_state * 0x2545F4914F6CDD1DULL;
+    // 53 random bits in (0, 1]
+    return ((double)(r >> 11) + 1.0) / 9007199254740992.0;
+}
+
+static void frontier_swap(approx_dir_t *a, approx_dir_t *b) {
+    approx_dir_t temp = *a;
+    *a = *b;
+    *b = temp;
+}
+
+static int frontier_push(approx_frontier_t *frontier, const char *path, int depth, dev_t dev, double estimate, double boost, ignore_rules_t *rules) {
+    if (frontier->size >= frontier->capacity) {
+        size_t new_capacity = frontier->capacity ? frontier->capacity * 2 : 64;
+        approx_dir_t *new_dirs = realloc(frontier->dirs, sizeof(approx_dir_t) * new_capacity);
+        if (!new_dirs) return -1;
+        frontier->dirs = new_dirs;
+        frontier->capacity = new_capacity;
+    }
+    
+    char *copy = strdup(path);
+    if (!copy) return -1;
+    
+    // Larger key is drawn first: log(u) / w orders like u^(1/w)
+    size_t index = frontier->size++;
+    approx_dir_t *dir = &frontier->dirs[index];
+    dir->path = copy;
+    dir->depth = depth;
+    dir->dev = dev;
+    dir->estimate = estimate;
+    dir->boost = boost;
+    dir->key = log(approx_random()) / (estimate * boost);
+    dir->rules = ignore_rules_retain(rules);
+    frontier->estimate_sum += estimate;
+    
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (frontier->dirs[parent].key >= frontier->dirs[index].key) break;
+        frontier_swap(&frontier->dirs[parent], &frontier->dirs[index]);
+        index = parent;
+    }
+    return 0;
+}
+
+static approx_dir_t frontier_pop(approx_frontier_t *frontier) {
+    approx_dir_t top = frontier->dirs[0];
+    frontier->estimate_sum -= top.estimate;
+    frontier->dirs[0] = frontier->dirs[--frontier->size];
+    
+    size_t index = 0;
+    while (1) {
+        size_t left = 2 * index + 1;
+        size_t right = left + 1;
+        size_t largest = index;
+        if (left < frontier->size && frontier->dirs[left].key > frontier->dirs[largest].key) largest = left;
+        if (right < frontier->size && frontier->dirs[right].key > frontier->dirs[largest].key) largest = right;
+        if (largest == index) break;
+        frontier_swap(&frontier->dirs[index], &frontier->dirs[largest]);
+        index = largest;
+    }
+    return top;
+}
+
+static double estimate_entries(const struct stat *st) {
+    double estimate = (double)st->st_size / APPROX_DIRENT_BYTES;
+    return estimate < 1 ? 1 : estimate;
+}
+
+static int approx_stat(const char *path, struct stat *st, const options_t *opts) {
+    int stat_result = stat_path(path, st, opts);
+    if (stat_result != 0 && !opts->quiet) {
+        perror(path);
+    }
+    return stat_result;
+}
+
+static int can_descend(const char *path, const struct stat *st, dev_t parent_dev, int depth, const options_t *opts) {
+    return S_ISDIR(st->st_mode) && opts->recursive &&
+           (opts->max_depth < 0 || depth < opts->max_depth) &&
+           mount_may_enter(path, st, parent_dev, depth, opts);
+}
+
+int traverse_approximate(char **paths, int path_count, const options_t *opts, min_heap_t *heap, approx_report_t *report) {
+    approx_frontier_t frontier = {0};
+    long deadline = opts->deadline_ms > 0 ? monotonic_ms() + opts->deadline_ms : 0;
+    
+    memset(report, 0, sizeof(*report));
+    approx_rng_state = APPROX_RNG_SEED;
+    
+    for (int i = 0; i < path_count; i++) {
+        struct stat st;
+        if (approx_stat(paths[i], &st, opts) != 0) {
+            continue;
+        }
+        report->entries_examined++;
+        if (should_include_name(paths[i], opts) && should_include_file(&st, opts)) {
+            heap_offer(heap, paths[i], &st, opts);
+        }
+        if (can_descend(paths[i], &st, 0, 0, opts)) {
+            frontier_push(&frontier, paths[i], 0, st.st_dev, estimate_entries(&st), 1.0, NULL);
+        }
+    }
+    
+    approx_child_t *children = NULL;
+    size_t child_count = 0;
+    size_t child_capacity = 0;
+    
+    while (frontier.size > 0 && report->dirs_sampled < (size_t)opts->approx_dirs) {
+        if (deadline && monotonic_ms() >= deadline) {
+            break;
+        }
+        
+        approx_dir_t task = frontier_pop(&frontier);
+        report->dirs_sampled++;
+        
+        DIR *dir = open_directory(task.path);
+        if (!dir) {
+            if (!opts->quiet) {
+                perror(task.path);
+            }
+            ignore_rules_release(task.rules);
+            free(task.path);
+            continue;
+        }
+        
+        ignore_rules_t *dir_rules = opts->ignore_vcs ? ignore_rules_enter(task.rules, task.path) : NULL;
+        size_t hits = 0;
+        child_count = 0;
+        
+        struct dirent *entry;
+        while ((entry = read_directory(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            
+            if ((opts->predicates || opts->filter_type != FILTER_ALL) && should_skip_entry(entry, opts)) {
+                continue;
+            }
+            
+            char full_path[MAX_PATH_LEN];
+            int ret = snprintf(full_path, sizeof(full_path), "%s/%s", task.path, entry->d_name);
+            if (ret < 0 || (size_t)ret >= sizeof(full_path)) {
+                if (!opts->quiet) {
+                    fprintf(stderr, "findmax: path too long: %s/%s\n", task.path, entry->d_name);
+                }
+                continue;
+            }
+            STATS_ADD(path_bytes, ret);
+            
+            if (opts->ignore_vcs && ignore_should_prune(dir_rules, full_path, entry, opts)) {
+                continue;
+            }
+            
+            if (opts->mount_policy && mount_path_skipped(full_path, opts)) {
+                continue;
+            }
+            
+            struct stat st;
+            if (approx_stat(full_path, &st, opts) != 0) {
+                continue;
+            }
+            report->entries_examined++;
+            
+            if (should_include_name(full_path, opts) && should_include_file(&st, opts)) {
+                hits += heap_offer(heap, full_path, &st, opts);
+            }
+            
+            if (can_descend(full_path, &st, task.dev, task.depth + 1, opts)) {
+                if (child_count >= child_capacity) {
+                    size_t new_capacity = child_capacity ? child_capacity * 2 : 32;
+                    approx_child_t *new_children = realloc(children, sizeof(approx_child_t) * new_capacity);
+                    if (!new_children) {
+                        if (!opts->quiet) {
+                            fprintf(stderr, "findmax: memory allocation failed\n");
+                        }
+                        continue;
+                    }
+                    children = new_children;
+                    child_capacity = new_capacity;
+                }
+                children[child_count].path = strdup(full_path);
+                children[child_count].dev = st.st_dev;
+                children[child_count].estimate = estimate_entries(&st);
+                if (children[child_count].path) child_count++;
+            }
+        }
+        closedir(dir);
+        
+        // Productive directories double their subtree's sampling weight,
+        // unproductive ones decay back towards the plain size estimate
+        double boost = hits > 0 ? task.boost * 2 + (double)hits : 1 + (task.boost - 1) / 2;
+        for (size_t i = 0; i < child_count; i++) {
+            frontier_push(&frontier, children[i].path, task.depth + 1, children[i].dev, children[i].estimate, boost, dir_rules);
+            free(children[i].path);
+        }
+        
+        ignore_rules_release(dir_rules);
+        ignore_rules_release(task.rules);
+        free(task.path);
+    }
+    
+    report->dirs_unvisited = frontier.size;
+    report->entries_unread = frontier.size > 0 ? frontier.estimate_sum : 0;
+    
+    for (size_t i = 0; i < frontier.size; i++) {
+        ignore_rules_release(frontier.dirs[i].rules);
+        free(frontier.dirs[i].path);
+    }
+    free(frontier.dirs);
+    free(children);
+    return report->dirs_unvisited > 0;
+}
+
+// Expected share of the true top-N that was seen, assuming candidates are
+// spread like entries. Only the first unread level is known, so deeper
+// subtrees make this an optimistic estimate on very deep trees.
+double approx_confidence(const approx_report_t *report) {
+    double total = (double)report->entries_examined + report->entries_unread;
+    if (report->dirs_unvisited == 0 || total <= 0) {
+        return 1.0;
+    }
+    return (double)report->entries_examined / total;
+}
@@ -0,0 +1,92 @@
+#include "findmax.h"
+
+// Many queries from one process (--batch).
+//
+// Each line of stdin is a query: options and paths, split into words as
+// --exec commands are. It runs as a findmax command line of its own, after
+// the options given with --batch, and its output is followed by a
+// "# findmax exit STATUS" line and flushed, so a reader can take results
+// one query at a time over a pipe. Process startup, dynamic linking and
+// setlocale() are paid once; owner and group names stay cached between
+// queries, and heaps reuse the previous query's entry array.
+
+#define BATCH_MAX_WORDS 256
+#define BATCH_TERMINATOR "# findmax exit"
+
+static int batch_running;
+
+// Whether queries are being read from stdin, where a usage message on
+// stdout would read as results
+int batch_active(void) {
+    return batch_running;
+}
+
+int batch_main(char **args, int arg_count) {
+    if (batch_running) {
+        fprintf(stderr, "findmax: --batch cannot be nested\n");
+        return 1;
+    }
+    batch_running = 1;
+    heap_reuse_arrays(1);
+    
+    // The command line minus --batch comes first on every query
+    char **vector = malloc(sizeof(char *) * ((size_t)arg_count + BATCH_MAX_WORDS + 1));
+    if (!vector) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
+        heap_reuse_arrays(0);
+        batch_running = 0;
+        return 1;
+    }
+    int prefix = 0;
+    for (int i = 0; i < arg_count; i++) {
+        if (strcmp(args[i], "--batch") != 0) {
+            vector[prefix++] = args[i];
+        }
+    }
+    
+    char *words[BATCH_MAX_WORDS];
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t len;
+    size_t number = 0;
+    while ((len = getline(&line, &capacity, stdin)) != -1) {
+        number++;
+        if (len > 0 && line[len - 1] == '\n') {
+            line[--len] = '\0';
+        }
+        const char *p = line;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+        
+        int status;
+        int count = split_command_words(line, words, BATCH_MAX_WORDS);
+        if (count < 0) {
+            fprintf(stderr, "findmax: stdin:%zu: invalid query\n", number);
+            status = 1;
+        } else {
+            memcpy(vector + prefix, words, sizeof(char *) * (size_t)count);
+            vector[prefix + count] = NULL;
+            optind = 0;
+            memset(&g_scan_stats, 0, sizeof(g_scan_stats));
+            status = findmax_main(prefix + count, vector, NULL);
+            for (int i = 0; i < count; i++) {
+                free(words[i]);
+            }
+        }
+        printf("%s %d\n", BATCH_TERMINATOR, status);
+        fflush(stdout);
+        fflush(stderr);
+    }
+    
+    int failed = ferror(stdin) != 0;
+    if (failed) {
+        perror("findmax: stdin");
+    }
+    free(line);
+    free(vector);
+    heap_reuse_arrays(0);
+    batch_running = 0;
+    return failed;
+}
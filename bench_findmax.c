@@ -0,0 +1,366 @@
+/*
+ * Benchmark harness for findmax traversal modes
+ * Copyright (C) 2026 Lenik <findmax@bodz.net>
+ *
+ * Generates a reproducible synthetic tree and times each traversal mode
+ * in-process over repeated trials, reporting median, p95 and a
+ * distribution-free 95% confidence interval for the median.
+ */
+
+#include "findmax.h"
+#include <fcntl.h>
+#include <ftw.h>
+#include <math.h>
+#include <sys/time.h>
+
+typedef struct {
+    int fanout;
+    int depth;
+    int files;
+    int name_min;
+    int name_max;
+    unsigned long seed;
+    int trials;
+    int cold;
+    int json;
+    int keep;
+    const char *root;
+} bench_config_t;
+
+typedef enum {
+    MODE_SINGLE,
+    MODE_HEAP,
+    MODE_BFS,
+    MODE_APPROX,
+    MODE_LIST
+} bench_mode_t;
+
+typedef struct {
+    const char *name;
+    bench_mode_t mode;
+    sort_type_t sort_type;
+    int num_files;
+} bench_case_t;
+
+static const bench_case_t bench_cases[] = {
+    { "single", MODE_SINGLE, SORT_MTIME, 1 },
+    { "heap", MODE_HEAP, SORT_SIZE, 10 },
+    { "heap", MODE_HEAP, SORT_SIZE, 1000 },
+    { "heap-name", MODE_HEAP, SORT_NAME, 10 },
+    { "bfs", MODE_BFS, SORT_SIZE, 10 },
+    { "approx", MODE_APPROX, SORT_SIZE, 10 },
+    { "list-sort", MODE_LIST, SORT_SIZE, 10 },
+};
+
+// Deterministic generator so every run builds the same tree
+static unsigned long long bench_rng;
+
+static unsigned long long bench_random(void) {
+    bench_rng ^= bench_rng >> 12;
+    bench_rng ^= bench_rng << 25;
+    bench_rng ^= bench_rng >> 27;
+    return bench_rng * 0x2545F4914F6CDD1DULL;
+}
+
+static void random_name(char *buf, const bench_config_t *cfg) {
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789_-.";
+    int span = cfg->name_max - cfg->name_min + 1;
+    int len = cfg->name_min + (int)(bench_random() % (unsigned long long)span);
+    for (int i = 0; i < len; i++) {
+        buf[i] = alphabet[bench_random() % (sizeof(alphabet) - 1)];
+    }
+    // Keep names from starting with '.' or '-'
+    if (buf[0] == '.' || buf[0] == '-') buf[0] = 'x';
+    buf[len] = '\0';
+}
+
+static long generate_tree(const char *dir, int level, const bench_config_t *cfg) {
+    long created = 0;
+    char path[MAX_PATH_LEN];
+    char name[256];
+
+    for (int i = 0; i < cfg->files; i++) {
+        random_name(name, cfg);
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        int fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0644);
+        if (fd < 0) {
+            continue; // name collision, skip
+        }
+        // Sparse files give realistic sizes without writing data
+        if (ftruncate(fd, (off_t)(bench_random() % (1 << 24))) != 0) {
+            perror(path);
+        }
+        close(fd);
+
+        struct timeval times[2];
+        times[0].tv_sec = 1000000000 + (time_t)(bench_random() % 700000000);
+        times[0].tv_usec = 0;
+        times[1].tv_sec = 1000000000 + (time_t)(bench_random() % 700000000);
+        times[1].tv_usec = 0;
+        utimes(path, times);
+        created++;
+    }
+
+    if (level < cfg->depth) {
+        for (int i = 0; i < cfg->fanout; i++) {
+            random_name(name, cfg);
+            snprintf(path, sizeof(path), "%s/%s", dir, name);
+            if (mkdir(path, 0755) != 0) {
+                continue;
+            }
+            created += 1 + generate_tree(path, level + 1, cfg);
+        }
+    }
+    return created;
+}
+
+// Remove one entry of the generated tree; nftw() visits children first
+static int remove_entry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st;
+    (void)ftw;
+    return type == FTW_DP ? rmdir(path) : unlink(path);
+}
+
+// Drop dentry and inode caches; needs root
+static int drop_caches(void) {
+    sync();
+    int fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    int ok = write(fd, "2\n", 2) == 2;
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double run_case(const bench_case_t *bc, char *root) {
+    options_t opts = {0};
+    opts.sort_type = bc->sort_type;
+    opts.filter_type = FILTER_ALL;
+    opts.recursive = 1;
+    opts.max_depth = -1;
+    opts.reverse = 1;
+    opts.num_files = bc->num_files;
+    opts.quiet = 1;
+    strcpy(opts.format, "%n");
+
+    double start = now_ms();
+    switch (bc->mode) {
+        case MODE_SINGLE:
+            {
+                file_entry_t best = {0};
+                traverse_directory_single(root, &opts, &best, 0);
+            }
+            break;
+        case MODE_HEAP:
+        case MODE_BFS:
+        case MODE_APPROX:
+            {
+                min_heap_t *heap = create_min_heap(opts.num_files, &opts);
+                char *roots[] = { root };
+                if (bc->mode == MODE_HEAP) {
+                    traverse_directory_optimized(root, &opts, heap, 0);
+                } else if (bc->mode == MODE_BFS) {
+                    size_t unvisited;
+                    traverse_breadth_first(roots, 1, &opts, heap, &unvisited);
+                } else {
+                    approx_report_t report;
+                    opts.approx_dirs = 64;
+                    traverse_approximate(roots, 1, &opts, heap, &report);
+                }
+                free_min_heap(heap);
+            }
+            break;
+        case MODE_LIST:
+            {
+                file_list_t *files = create_file_list();
+                traverse_directory(root, &opts, files);
+                sort_files(files, &opts);
+                free_file_list(files);
+            }
+            break;
+    }
+    return now_ms() - start;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+static double percentile(const double *sorted, int n, double p) {
+    double rank = p * (n - 1);
+    int lo = (int)rank;
+    int hi = lo + 1 < n ? lo + 1 : lo;
+    return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - lo);
+}
+
+static void report(const bench_case_t *bc, const char *cache, double *samples, int n, long entries, int json, int *first) {
+    qsort(samples, n, sizeof(double), compare_double);
+
+    // Order-statistic confidence interval for the median (binomial, 95%)
+    double half = 1.96 * sqrt((double)n) / 2;
+    int lo = (int)floor(n / 2.0 - half);
+    int hi = (int)ceil(n / 2.0 + half);
+    if (lo < 0) lo = 0;
+    if (hi > n - 1) hi = n - 1;
+
+    double median = percentile(samples, n, 0.5);
+    double p95 = samples[(int)ceil(0.95 * n) - 1];
+
+    if (json) {
+        printf("%s{\"mode\":\"%s\",\"n\":%d,\"cache\":\"%s\",\"trials\":%d,\"entries\":%ld,"
+               "\"median_ms\":%.4f,\"p95_ms\":%.4f,\"ci95_low_ms\":%.4f,\"ci95_high_ms\":%.4f,"
+               "\"min_ms\":%.4f,\"max_ms\":%.4f}",
+               *first ? "" : ",\n", bc->name, bc->num_files, cache, n, entries,
+               median, p95, samples[lo], samples[hi], samples[0], samples[n - 1]);
+    } else {
+        printf("%s,%d,%s,%d,%ld,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+               bc->name, bc->num_files, cache, n, entries,
+               median, p95, samples[lo], samples[hi], samples[0], samples[n - 1]);
+    }
+    *first = 0;
+}
+
+static void usage(void) {
+    printf("Usage: bench_findmax [OPTIONS]\n");
+    printf("Time findmax traversal modes over a reproducible synthetic tree.\n\n");
+    printf("  --fanout NUM        subdirectories per directory (default 8)\n");
+    printf("  --depth NUM         directory levels below the root (default 3)\n");
+    printf("  --files NUM         files per directory (default 32)\n");
+    printf("  --name-len MIN-MAX  uniform name length range (default 4-24)\n");
+    printf("  --seed NUM          generator seed (default 1)\n");
+    printf("  --trials NUM        timed trials per mode (default 11)\n");
+    printf("  --root DIR          build the tree in DIR (must not exist) instead of a temp directory\n");
+    printf("  --keep              keep the generated tree\n");
+    printf("  --cold              also run cold-cache trials (needs root)\n");
+    printf("  --json              JSON output instead of CSV\n");
+}
+
+int main(int argc, char *argv[]) {
+    bench_config_t cfg = { 8, 3, 32, 4, 24, 1, 11, 0, 0, 0, NULL };
+
+    static struct option long_options[] = {
+        {"fanout", required_argument, 0, 1},
+        {"depth", required_argument, 0, 2},
+        {"files", required_argument, 0, 3},
+        {"name-len", required_argument, 0, 4},
+        {"seed", required_argument, 0, 5},
+        {"trials", required_argument, 0, 6},
+        {"root", required_argument, 0, 7},
+        {"keep", no_argument, 0, 8},
+        {"cold", no_argument, 0, 9},
+        {"json", no_argument, 0, 10},
+        {"help", no_argument, 0, 11},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 1: cfg.fanout = atoi(optarg); break;
+            case 2: cfg.depth = atoi(optarg); break;
+            case 3: cfg.files = atoi(optarg); break;
+            case 4:
+                if (sscanf(optarg, "%d-%d", &cfg.name_min, &cfg.name_max) != 2 ||
+                    cfg.name_min < 1 || cfg.name_max < cfg.name_min || cfg.name_max > 255) {
+                    fprintf(stderr, "bench_findmax: invalid name length '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 5: cfg.seed = strtoul(optarg, NULL, 10); break;
+            case 6: cfg.trials = atoi(optarg); break;
+            case 7: cfg.root = optarg; break;
+            case 8: cfg.keep = 1; break;
+            case 9: cfg.cold = 1; break;
+            case 10: cfg.json = 1; break;
+            case 11: usage(); return 0;
+            default: usage(); return 1;
+        }
+    }
+    if (cfg.trials < 1 || cfg.fanout < 0 || cfg.depth < 0 || cfg.files < 0) {
+        fprintf(stderr, "bench_findmax: invalid configuration\n");
+        return 1;
+    }
+
+    setlocale(LC_ALL, "");
+
+    char root[MAX_PATH_LEN];
+    if (cfg.root) {
+        // The tree is removed afterwards, so never build into a directory
+        // that already exists
+        snprintf(root, sizeof(root), "%s", cfg.root);
+        if (mkdir(root, 0755) != 0) {
+            if (errno == EEXIST) {
+                fprintf(stderr, "bench_findmax: %s already exists, refusing to use it\n", root);
+            } else {
+                perror(root);
+            }
+            return 1;
+        }
+    } else {
+        snprintf(root, sizeof(root), "/tmp/findmax_bench_XXXXXX");
+        if (!mkdtemp(root)) {
+            perror("mkdtemp");
+            return 1;
+        }
+    }
+
+    bench_rng = 0x9E3779B97F4A7C15ULL ^ (cfg.seed * 0xBF58476D1CE4E5B9ULL);
+    if (bench_rng == 0) bench_rng = 1;
+    long entries = 1 + generate_tree(root, 0, &cfg);
+    fprintf(stderr, "bench_findmax: %ld entries in %s (fanout %d, depth %d, %d files/dir, names %d-%d)\n",
+            entries, root, cfg.fanout, cfg.depth, cfg.files, cfg.name_min, cfg.name_max);
+
+    int cold = cfg.cold;
+    if (cold && drop_caches() != 0) {
+        fprintf(stderr, "bench_findmax: cannot drop caches (need root), skipping cold-cache runs\n");
+        cold = 0;
+    }
+
+    if (cfg.json) {
+        printf("[\n");
+    } else {
+        printf("mode,n,cache,trials,entries,median_ms,p95_ms,ci95_low_ms,ci95_high_ms,min_ms,max_ms\n");
+    }
+
+    double *samples = malloc(sizeof(double) * cfg.trials);
+    int first = 1;
+    for (size_t c = 0; c < sizeof(bench_cases) / sizeof(bench_cases[0]); c++) {
+        const bench_case_t *bc = &bench_cases[c];
+
+        // Warm cache: one untimed pass, then the timed trials
+        run_case(bc, root);
+        for (int t = 0; t < cfg.trials; t++) {
+            samples[t] = run_case(bc, root);
+        }
+        report(bc, "warm", samples, cfg.trials, entries, cfg.json, &first);
+
+        if (cold) {
+            for (int t = 0; t < cfg.trials; t++) {
+                drop_caches();
+                samples[t] = run_case(bc, root);
+            }
+            report(bc, "cold", samples, cfg.trials, entries, cfg.json, &first);
+        }
+    }
+    free(samples);
+
+    if (cfg.json) {
+        printf("\n]\n");
+    }
+
+    if (!cfg.keep) {
+        if (nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS) != 0) {
+            fprintf(stderr, "bench_findmax: failed to remove %s\n", root);
+        }
+    }
+    return 0;
+}
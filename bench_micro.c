@@ -0,0 +1,349 @@
+/*
+ * Microbenchmarks for findmax hot paths
+ * Copyright (C) 2026 Lenik <findmax@bodz.net>
+ *
+ * Measures heap_insert() (and the sift-down behind replacements),
+ * compare_file_entries(), sort_files() and format_output() in isolation
+ * for every sort key, over random, sorted and adversarial key streams,
+ * and the cost of extracting a key against evaluating --score programs.
+ */
+
+#include "findmax.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+// Keys generated per stream beyond the N needed to fill the heap
+#define STREAM_EXTRA 100000
+#define COMPARE_OPS 2000000
+#define FORMAT_OPS 200000
+#define SORT_ELEMENTS 100000
+#define EXTRACT_OPS 2000000
+#define NAME_POOL 4096
+
+typedef enum {
+    STREAM_RANDOM,
+    STREAM_SORTED,
+    STREAM_ADVERSARIAL,
+    STREAM_COUNT
+} stream_t;
+
+static const char *const stream_names[STREAM_COUNT] = { "random", "sorted", "adversarial" };
+
+static size_t mem_limit = (size_t)1 << 30;
+static char name_pool[NAME_POOL][64];
+
+static unsigned long long rng_state = 0x9E3779B97F4A7C15ULL;
+
+static unsigned long long next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t cycles(void) {
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void report(const char *bench, const char *sort, const char *stream, size_t n, size_t ops, uint64_t ns, uint64_t cyc) {
+    printf("%s,%s,%s,%zu,%zu,%.2f,", bench, sort, stream, n, ops, (double)ns / ops);
+#ifdef HAVE_RDTSC
+    printf("%.1f\n", (double)cyc / ops);
+#else
+    (void)cyc;
+    printf("n/a\n");
+#endif
+}
+
+// Names sharing a long prefix make strcoll() walk far before deciding
+static void build_name_pool(void) {
+    for (int i = 0; i < NAME_POOL; i++) {
+        snprintf(name_pool[i], sizeof(name_pool[i]),
+                 "/bench/dir/common_prefix_for_all_names_%08d", i);
+    }
+}
+
+// Key for position i of a stream of length len: "sorted" arrives in output
+// order (best first) so the heap rejects almost everything, "adversarial"
+// arrives in reverse so every key displaces the root and sifts down
+static long long stream_key(stream_t stream, size_t i, size_t len) {
+    switch (stream) {
+        case STREAM_SORTED:
+            return (long long)(len - i);
+        case STREAM_ADVERSARIAL:
+            return (long long)i;
+        case STREAM_RANDOM:
+        default:
+            return (long long)(next_random() % (len * 4 + 1));
+    }
+}
+
+static void fill_entry(file_entry_t *entry, sort_type_t sort_type, long long key, size_t len) {
+    entry->st.st_mtime = entry->st.st_atime = entry->st.st_ctime = (time_t)key;
+    entry->st.st_size = (off_t)key;
+    entry->sort_key = key;
+    if (sort_type == SORT_NAME) {
+        // Map the key monotonically onto the name pool
+        size_t index = (size_t)((unsigned long long)key * (NAME_POOL - 1) / (len * 4 + 1));
+        strcpy(entry->path, name_pool[index]);
+    }
+}
+
+static void bench_heap(sort_type_t sort_type, const char *sort_name, stream_t stream, size_t n) {
+    if (n * sizeof(file_entry_t) > mem_limit) {
+        printf("heap_insert,%s,%s,%zu,0,skipped,skipped\n", sort_name, stream_names[stream], n);
+        return;
+    }
+    
+    options_t opts = {0};
+    opts.sort_type = sort_type;
+    opts.reverse = 1;
+    min_heap_t *heap = create_min_heap(n, &opts);
+    if (!heap) {
+        printf("heap_insert,%s,%s,%zu,0,skipped,skipped\n", sort_name, stream_names[stream], n);
+        return;
+    }
+    
+    size_t len = n + STREAM_EXTRA;
+    long long *keys = malloc(sizeof(long long) * len);
+    if (!keys) {
+        free_min_heap(heap);
+        return;
+    }
+    for (size_t i = 0; i < len; i++) {
+        keys[i] = stream_key(stream, i, len);
+    }
+    
+    // Filling the entry is part of the timed loop; it is a few stores
+    // (one short strcpy for names) against the 4 KiB copy heap_insert makes
+    file_entry_t entry = {0};
+    strcpy(entry.path, name_pool[0]);
+    uint64_t t0 = now_ns();
+    uint64_t c0 = cycles();
+    for (size_t i = 0; i < len; i++) {
+        fill_entry(&entry, sort_type, keys[i], len);
+        heap_insert(heap, &entry);
+    }
+    uint64_t cyc = cycles() - c0;
+    uint64_t ns = now_ns() - t0;
+    free(keys);
+    report("heap_insert", sort_name, stream_names[stream], n, len, ns, cyc);
+    free_min_heap(heap);
+}
+
+static void bench_compare(sort_type_t sort_type, const char *sort_name) {
+    static file_entry_t pool[256];
+    for (int i = 0; i < 256; i++) {
+        fill_entry(&pool[i], sort_type, (long long)(next_random() % 1024), 256);
+    }
+    
+    options_t opts = {0};
+    opts.sort_type = sort_type;
+    opts.reverse = 1;
+    
+    volatile int sink = 0;
+    uint64_t t0 = now_ns();
+    uint64_t c0 = cycles();
+    for (size_t i = 0; i < COMPARE_OPS; i++) {
+        sink += compare_file_entries(&pool[i & 255], &pool[(i * 7 + 3) & 255], &opts);
+    }
+    uint64_t cyc = cycles() - c0;
+    uint64_t ns = now_ns() - t0;
+    (void)sink;
+    report("compare_file_entries", sort_name, "random", 256, COMPARE_OPS, ns, cyc);
+}
+
+// Composite keys: ties on size and mtime fall through to the name,
+// compared key by key as compare_sort_list() does
+static void bench_compare_composite(const char *spec) {
+    options_t opts = {0};
+    opts.reverse = 1;
+    if (parse_sort_list(spec, &opts) != 0) return;
+    
+    static file_entry_t pool[256];
+    for (int i = 0; i < 256; i++) {
+        memset(&pool[i].st, 0, sizeof(pool[i].st));
+        pool[i].st.st_size = (off_t)(next_random() % 4);
+        pool[i].st.st_mtime = (time_t)(next_random() % 4);
+        strcpy(pool[i].path, name_pool[next_random() % NAME_POOL]);
+        set_sort_key(&pool[i], &opts);
+    }
+    
+    volatile int sink = 0;
+    uint64_t t0 = now_ns();
+    uint64_t c0 = cycles();
+    for (size_t i = 0; i < COMPARE_OPS; i++) {
+        sink += compare_file_entries(&pool[i & 255], &pool[(i * 7 + 3) & 255], &opts);
+    }
+    uint64_t cyc = cycles() - c0;
+    uint64_t ns = now_ns() - t0;
+    (void)sink;
+    char label[64];
+    snprintf(label, sizeof(label), "%s", spec);
+    for (char *p = label; *p; p++) {
+        if (*p == ',') *p = '+';  // keep the CSV columns intact
+    }
+    report("compare_file_entries", label, "ties", 256, COMPARE_OPS, ns, cyc);
+}
+
+// set_sort_key() per entry: a fixed extractor (expr NULL) or a compiled
+// --score expression, over stat data that varies from entry to entry
+static void bench_extract(sort_type_t sort_type, const char *expr) {
+    options_t opts = {0};
+    opts.sort_type = sort_type;
+    if (expr && !(opts.score = score_compile(expr, 1700000000))) return;
+    
+    static file_entry_t pool[256];
+    for (int i = 0; i < 256; i++) {
+        memset(&pool[i].st, 0, sizeof(pool[i].st));
+        pool[i].st.st_size = (off_t)(next_random() % (1 << 30));
+        pool[i].st.st_mtime = pool[i].st.st_atime = (time_t)(1600000000 + next_random() % 100000000);
+        pool[i].st.st_nlink = 1;
+        strcpy(pool[i].path, name_pool[i]);
+    }
+    
+    volatile int64_t sink = 0;
+    uint64_t t0 = now_ns();
+    uint64_t c0 = cycles();
+    for (size_t i = 0; i < EXTRACT_OPS; i++) {
+        set_sort_key(&pool[i & 255], &opts);
+        sink += pool[i & 255].sort_key;
+    }
+    uint64_t cyc = cycles() - c0;
+    uint64_t ns = now_ns() - t0;
+    (void)sink;
+    report("set_sort_key", expr ? expr : sort_keys[sort_type].name, expr ? "score" : "fixed", 256, EXTRACT_OPS, ns, cyc);
+    score_free(opts.score);
+}
+
+static void bench_sort(sort_type_t sort_type, const char *sort_name, stream_t stream, size_t n) {
+    if (n * sizeof(file_entry_t) > mem_limit) {
+        printf("sort_files,%s,%s,%zu,0,skipped,skipped\n", sort_name, stream_names[stream], n);
+        return;
+    }
+    
+    options_t opts = {0};
+    opts.sort_type = sort_type;
+    opts.reverse = 1;
+    
+    // Small lists are rebuilt and sorted repeatedly so every run times
+    // roughly the same number of elements
+    size_t reps = n < SORT_ELEMENTS ? SORT_ELEMENTS / n : 1;
+    uint64_t ns = 0, cyc = 0;
+    for (size_t r = 0; r < reps; r++) {
+        file_list_t *files = create_file_list();
+        file_entry_t entry = {0};
+        for (size_t i = 0; i < n; i++) {
+            fill_entry(&entry, sort_type, stream_key(stream, i, n), n);
+            if (sort_type != SORT_NAME) strcpy(entry.path, name_pool[i % NAME_POOL]);
+            add_file_entry(files, entry.path, &entry.st, &opts);
+        }
+        
+        uint64_t t0 = now_ns();
+        uint64_t c0 = cycles();
+        sort_files(files, &opts);
+        cyc += cycles() - c0;
+        ns += now_ns() - t0;
+        free_file_list(files);
+    }
+    report("sort_files", sort_name, stream_names[stream], n, n * reps, ns, cyc);
+}
+
+static void bench_format(const char *format) {
+    file_entry_t entry = {0};
+    strcpy(entry.path, name_pool[1]);
+    entry.st.st_mode = S_IFREG | 0644;
+    entry.st.st_size = 123456789;
+    entry.st.st_mtime = 1700000000;
+    entry.st.st_uid = getuid();
+    entry.st.st_gid = getgid();
+    
+    char output[4096];
+    uint64_t t0 = now_ns();
+    uint64_t c0 = cycles();
+    for (size_t i = 0; i < FORMAT_OPS; i++) {
+        format_output(&entry, format, output, sizeof(output));
+    }
+    uint64_t cyc = cycles() - c0;
+    uint64_t ns = now_ns() - t0;
+    report("format_output", format, "-", 1, FORMAT_OPS, ns, cyc);
+}
+
+int main(int argc, char *argv[]) {
+    size_t sizes[] = { 1, 10, 1000, 1000000 };
+    const char *only = NULL;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mem-limit") == 0 && i + 1 < argc) {
+            mem_limit = (size_t)strtoull(argv[++i], NULL, 10) << 20;
+        } else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else {
+            printf("Usage: bench_micro [--only heap|compare|sort|extract|format] [--mem-limit MIB]\n");
+            printf("N=1e6 runs are skipped when they need more than --mem-limit (default 1024 MiB).\n");
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+    
+    setlocale(LC_ALL, "");
+    build_name_pool();
+    printf("bench,key,stream,n,ops,ns_per_op,cycles_per_op\n");
+    
+    // The score key is timed by the extract benchmarks below
+    for (int k = 0; k < SORT_SCORE; k++) {
+        sort_type_t sort_type = (sort_type_t)k;
+        const char *sort_name = sort_keys[k].name;
+        if (!only || strcmp(only, "heap") == 0) {
+            for (int s = 0; s < STREAM_COUNT; s++) {
+                for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+                    bench_heap(sort_type, sort_name, (stream_t)s, sizes[i]);
+                }
+            }
+        }
+        if (!only || strcmp(only, "compare") == 0) {
+            bench_compare(sort_type, sort_name);
+        }
+        if (!only || strcmp(only, "sort") == 0) {
+            for (int s = 0; s < STREAM_COUNT; s++) {
+                for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+                    bench_sort(sort_type, sort_name, (stream_t)s, sizes[i]);
+                }
+            }
+        }
+    }
+    
+    if (!only || strcmp(only, "compare") == 0) {
+        bench_compare_composite("size,mtime");
+        bench_compare_composite("size,mtime,name");
+    }
+    
+    if (!only || strcmp(only, "extract") == 0) {
+        bench_extract(SORT_SIZE, NULL);
+        bench_extract(SORT_MTIME, NULL);
+        bench_extract(SORT_DEPTH, NULL);
+        bench_extract(SORT_SCORE, "size");
+        bench_extract(SORT_SCORE, "size*(now-atime)");
+        bench_extract(SORT_SCORE, "size*(now-atime)/(now-30d)");
+        bench_extract(SORT_SCORE, "log(size)*(now-mtime)/1d+links*1M");
+    }
+    
+    if (!only || strcmp(only, "format") == 0) {
+        bench_format("%n");
+        bench_format("%n %s %y");
+        bench_format("%A %U:%G %s %n");
+    }
+    return 0;
+}
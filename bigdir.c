@@ -0,0 +1,240 @@
+#include "findmax.h"
+#include <fcntl.h>
+#include <pthread.h>
+
+// Giant directories split between stat() workers.
+//
+// A directory that holds millions of entries on one level is read by one
+// thread however the walk is arranged, and the stat() of every entry
+// dominates. Once a directory has yielded SPLIT_START_ENTRIES entries,
+// the walking thread keeps reading it but hands the names of files (any
+// entry whose d_type says it is not a directory) in batches to worker
+// threads. Each worker stat()s and filters its batches and ranks the
+// survivors into a sink of its own, a heap or a single best entry, so
+// workers share nothing but the batch queue; the sinks are merged into
+// the walk's result when the directory is finished. Directories and
+// entries of unknown type are still handled in order by the walking
+// thread, which recurses into them as before.
+//
+// Workers only run when nothing else sees each candidate (--stats,
+// snapshots, --query, --group-by, --histogram and --quantiles keep the
+// walk on one thread), so their ranking needs no locks.
+
+#define SPLIT_BATCH_ENTRIES 256
+#define SPLIT_BATCH_BYTES (64 * 1024)
+#define SPLIT_DEFAULT_WORKERS 8
+
+typedef struct split_batch {
+    struct split_batch *next;
+    size_t count;
+    size_t used;
+    uint32_t path_at[SPLIT_BATCH_ENTRIES];
+    uint32_t name_at[SPLIT_BATCH_ENTRIES];
+    char bytes[SPLIT_BATCH_BYTES];
+} split_batch_t;
+
+typedef struct {
+    dir_split_t *split;
+    void *sink;
+    pthread_t thread;
+} split_worker_t;
+
+struct dir_split {
+    const options_t *opts;
+    const dir_split_sink_t *sink;
+    int dirfd;
+    int worker_count;
+    split_worker_t workers[SPLIT_MAX_WORKERS];
+    pthread_mutex_t lock;
+    pthread_cond_t work;   // a batch was queued, or the directory is done
+    pthread_cond_t room;   // a batch was taken off the queue
+    split_batch_t *head;
+    split_batch_t *tail;
+    size_t queued;
+    split_batch_t *spare;
+    split_batch_t *filling;
+    int done;
+};
+
+// Worker threads for a directory on device dev; 1 or less keeps it on the
+// walking thread
+static int split_workers(dev_t dev, const options_t *opts) {
+    if (g_stats_enabled || opts->snapshot_writer || opts->queries || opts->group_map || opts->sketch) {
+        return 0;
+    }
+    int workers = opts->threads;
+    if (workers == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = online > SPLIT_DEFAULT_WORKERS ? SPLIT_DEFAULT_WORKERS : (int)online;
+    }
+    int limit = mount_thread_limit(dev, opts);
+    if (limit > 0 && limit < workers) {
+        workers = limit;
+    }
+    return workers;
+}
+
+// stat(), filter and rank every entry of one batch into the worker's sink
+static void split_run_batch(split_worker_t *worker, const split_batch_t *batch) {
+    const options_t *opts = worker->split->opts;
+    int flags = opts->dereference ? 0 : AT_SYMLINK_NOFOLLOW;
+    file_entry_t entry;
+    for (size_t i = 0; i < batch->count; i++) {
+        const char *path = batch->bytes + batch->path_at[i];
+        if (fstatat(worker->split->dirfd, batch->bytes + batch->name_at[i], &entry.st, flags) != 0) {
+            if (!opts->quiet) {
+                perror(path);
+            }
+            continue;
+        }
+        if (!should_include_name(path, opts) || !should_include_file(&entry.st, opts)) {
+            continue;
+        }
+        strncpy(entry.path, path, MAX_PATH_LEN - 1);
+        entry.path[MAX_PATH_LEN - 1] = '\0';
+        set_sort_key(&entry, opts);
+        worker->split->sink->offer(worker->sink, &entry, opts);
+    }
+}
+
+static void *split_worker_main(void *arg) {
+    split_worker_t *worker = arg;
+    dir_split_t *split = worker->split;
+    pthread_mutex_lock(&split->lock);
+    while (1) {
+        while (!split->head && !split->done) {
+            pthread_cond_wait(&split->work, &split->lock);
+        }
+        split_batch_t *batch = split->head;
+        if (!batch) break;
+        split->head = batch->next;
+        if (!split->head) split->tail = NULL;
+        split->queued--;
+        pthread_cond_signal(&split->room);
+        pthread_mutex_unlock(&split->lock);
+        
+        split_run_batch(worker, batch);
+        
+        pthread_mutex_lock(&split->lock);
+        batch->next = split->spare;
+        split->spare = batch;
+    }
+    pthread_mutex_unlock(&split->lock);
+    return NULL;
+}
+
+dir_split_t *dir_split_begin(DIR *dir, const struct stat *st, int child_depth, const dir_split_sink_t *sink, const options_t *opts) {
+    // Files below the depth limit or in another shard are never offered
+    if ((opts->max_depth >= 0 && child_depth > opts->max_depth) ||
+        (opts->shard_count > 0 && child_depth <= opts->shard_depth)) {
+        return NULL;
+    }
+    int workers = split_workers(st->st_dev, opts);
+    if (workers <= 1) {
+        return NULL;
+    }
+    if (workers > SPLIT_MAX_WORKERS) workers = SPLIT_MAX_WORKERS;
+    
+    dir_split_t *split = calloc(1, sizeof(dir_split_t));
+    if (!split) return NULL;
+    split->opts = opts;
+    split->sink = sink;
+    split->dirfd = dirfd(dir);
+    pthread_mutex_init(&split->lock, NULL);
+    pthread_cond_init(&split->work, NULL);
+    pthread_cond_init(&split->room, NULL);
+    
+    for (int i = 0; i < workers; i++) {
+        split_worker_t *worker = &split->workers[i];
+        worker->split = split;
+        if (!(worker->sink = sink->create(sink->context))) break;
+        if (pthread_create(&worker->thread, NULL, split_worker_main, worker) != 0) {
+            sink->merge(sink->context, worker->sink, opts);
+            break;
+        }
+        split->worker_count++;
+    }
+    if (split->worker_count == 0) {
+        dir_split_finish(split);
+        return NULL;
+    }
+    return split;
+}
+
+// Queue the batch being filled, waiting while the workers are behind
+static void split_submit(dir_split_t *split) {
+    split_batch_t *batch = split->filling;
+    split->filling = NULL;
+    if (!batch || batch->count == 0) {
+        free(batch);
+        return;
+    }
+    batch->next = NULL;
+    pthread_mutex_lock(&split->lock);
+    while (split->queued >= (size_t)split->worker_count * 2) {
+        pthread_cond_wait(&split->room, &split->lock);
+    }
+    if (split->tail) split->tail->next = batch;
+    else split->head = batch;
+    split->tail = batch;
+    split->queued++;
+    pthread_cond_signal(&split->work);
+    pthread_mutex_unlock(&split->lock);
+}
+
+int dir_split_add(dir_split_t *split, const struct dirent *entry, const char *path, size_t path_len) {
+    // Only the walking thread may recurse
+    if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_DIR ||
+        (entry->d_type == DT_LNK && split->opts->dereference)) {
+        return -1;
+    }
+    
+    split_batch_t *batch = split->filling;
+    if (batch && (batch->count >= SPLIT_BATCH_ENTRIES || batch->used + path_len + 1 > SPLIT_BATCH_BYTES)) {
+        split_submit(split);
+        batch = NULL;
+    }
+    if (!batch) {
+        pthread_mutex_lock(&split->lock);
+        batch = split->spare;
+        if (batch) split->spare = batch->next;
+        pthread_mutex_unlock(&split->lock);
+        if (!batch && !(batch = malloc(sizeof(split_batch_t)))) {
+            return -1;
+        }
+        batch->count = 0;
+        batch->used = 0;
+        split->filling = batch;
+    }
+    
+    size_t name_len = strlen(entry->d_name);
+    memcpy(batch->bytes + batch->used, path, path_len + 1);
+    batch->path_at[batch->count] = (uint32_t)batch->used;
+    batch->name_at[batch->count] = (uint32_t)(batch->used + path_len - name_len);
+    batch->used += path_len + 1;
+    batch->count++;
+    return 0;
+}
+
+void dir_split_finish(dir_split_t *split) {
+    if (!split) return;
+    split_submit(split);
+    pthread_mutex_lock(&split->lock);
+    split->done = 1;
+    pthread_cond_broadcast(&split->work);
+    pthread_mutex_unlock(&split->lock);
+    
+    for (int i = 0; i < split->worker_count; i++) {
+        pthread_join(split->workers[i].thread, NULL);
+        split->sink->merge(split->sink->context, split->workers[i].sink, split->opts);
+    }
+    while (split->spare) {
+        split_batch_t *next = split->spare->next;
+        free(split->spare);
+        split->spare = next;
+    }
+    pthread_cond_destroy(&split->room);
+    pthread_cond_destroy(&split->work);
+    pthread_mutex_destroy(&split->lock);
+    free(split);
+}
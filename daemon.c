@@ -0,0 +1,510 @@
+#include "findmax.h"
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+// findmaxd, the resident query server, and findmax --connect, its client.
+//
+// findmaxd walks its roots once into a snapshot (SOCKET.index) and keeps
+// it mapped. A child process rescans every --rescan seconds, or on
+// SIGHUP, and the new index replaces the old one once it is complete, so
+// queries never wait for a walk.
+//
+// A query is the client's own command line. It arrives on the unix socket
+// together with the client's stdout and stderr (SCM_RIGHTS); the server
+// forks, and the child runs the ordinary findmax pipeline against the
+// inherited mapping, writing straight to the client's descriptors, then
+// sends back the exit status. No directory is read, no program is loaded
+// and no result is copied through the server, so a query costs a fork()
+// and a scan of the index.
+//
+// The index is built with the server's rights, so each query is answered
+// for the connecting user alone: the child takes the client's
+// credentials from the socket, becomes that user when the server runs as
+// root, and lists only entries the user could have listed on a walk
+// (see snapshot_set_reader()).
+//
+// Request: "FMXQ", the argument count and the byte length of the
+// arguments (uint32 each, host order), then the arguments, each
+// NUL-terminated. Reply: the exit status as an int32.
+
+#define DAEMON_MAGIC "FMXQ"
+#define DAEMON_MAX_REQUEST (1024 * 1024)
+#define DAEMON_DEFAULT_RESCAN 600
+
+typedef struct {
+    char magic[4];
+    uint32_t arg_count;
+    uint32_t length;
+} daemon_request_t;
+
+static volatile sig_atomic_t rescan_requested;
+static volatile sig_atomic_t stop_requested;
+
+static void on_signal(int sig) {
+    if (sig == SIGHUP) rescan_requested = 1;
+    else if (sig != SIGCHLD) stop_requested = 1;
+}
+
+static int write_full(int fd, const void *data, size_t size) {
+    const char *p = data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+static int read_full(int fd, void *data, size_t size) {
+    char *p = data;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+static void print_daemon_usage(void) {
+    printf("Usage: findmaxd -s SOCKET [OPTIONS] ROOT...\n");
+    printf("Keep an index of the trees under each ROOT and answer findmax --connect\n");
+    printf("queries from it.\n\n");
+    printf("Options:\n");
+    printf("  -s, --socket PATH   listen on the unix socket PATH; the index is kept\n");
+    printf("                      in PATH.index\n");
+    printf("      --rescan SECS   rescan every SECS seconds (default %d, 0 for only\n", DAEMON_DEFAULT_RESCAN);
+    printf("                      on SIGHUP)\n");
+    printf("  -q, --quiet         do not report scans and unreadable entries\n");
+    printf("      --help          show this help\n");
+}
+
+// Walk the roots into a new index file, replaced atomically
+static int build_index(char **roots, int root_count, const char *file, int quiet) {
+    options_t opts = {0};
+    opts.recursive = 1;
+    opts.reverse = 1;
+    opts.max_depth = -1;
+    opts.sort_type = SORT_MTIME;
+    opts.filter_type = FILTER_ALL;
+    opts.num_files = 1;
+    opts.quiet = quiet;
+    
+    min_heap_t *heap = create_min_heap(1, &opts);
+    if (!heap || !(opts.snapshot_writer = snapshot_create(file))) {
+        fprintf(stderr, "findmaxd: memory allocation failed\n");
+        free_min_heap(heap);
+        return -1;
+    }
+    for (int i = 0; i < root_count; i++) {
+        traverse_directory_optimized(roots[i], &opts, heap, 0);
+    }
+    free_min_heap(heap);
+    return snapshot_finish(opts.snapshot_writer);
+}
+
+// Receive a request and the two descriptors sent with it; args is one
+// allocation holding the pointers and the strings
+static int read_request(int conn, char ***args, int *arg_count, int fds[2]) {
+    daemon_request_t request;
+    char control[CMSG_SPACE(sizeof(int) * 2)];
+    struct iovec iov = { &request, sizeof(request) };
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    
+    ssize_t n = recvmsg(conn, &msg, MSG_WAITALL);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (n != (ssize_t)sizeof(request) || !cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * 2)) {
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * 2);
+    if (memcmp(request.magic, DAEMON_MAGIC, 4) != 0 || request.arg_count == 0 ||
+        request.arg_count > request.length || request.length > DAEMON_MAX_REQUEST) {
+        return -1;
+    }
+    
+    size_t table = sizeof(char *) * ((size_t)request.arg_count + 1);
+    char **vector = malloc(table + request.length);
+    if (!vector) return -1;
+    char *strings = (char *)vector + table;
+    if (read_full(conn, strings, request.length) != 0 || strings[request.length - 1] != '\0') {
+        free(vector);
+        return -1;
+    }
+    
+    uint32_t count = 0;
+    for (char *p = strings; p < strings + request.length; p += strlen(p) + 1) {
+        if (count == request.arg_count) {
+            free(vector);
+            return -1;
+        }
+        vector[count++] = p;
+    }
+    if (count != request.arg_count) {
+        free(vector);
+        return -1;
+    }
+    vector[count] = NULL;
+    *args = vector;
+    *arg_count = (int)count;
+    return 0;
+}
+
+// Credentials of the process at the other end of a unix socket
+static int peer_credentials(int conn, uid_t *uid, gid_t *gid) {
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) return -1;
+    *uid = cred.uid;
+    *gid = cred.gid;
+    return 0;
+#else
+    return getpeereid(conn, uid, gid);
+#endif
+}
+
+// Answer as the client: a root server takes on its identity, and the
+// index lists only what it may list
+static int become_peer(int conn, snapshot_t *index) {
+    uid_t uid;
+    gid_t gid;
+    if (peer_credentials(conn, &uid, &gid) != 0) return -1;
+    if (geteuid() == 0 && uid != 0) {
+        struct passwd *pw = getpwuid(uid);
+        if ((pw ? initgroups(pw->pw_name, gid) : setgroups(1, &gid)) != 0 ||
+            setgid(gid) != 0 || setuid(uid) != 0) {
+            return -1;
+        }
+    }
+    return snapshot_set_reader(index, uid, gid);
+}
+
+// In the child forked for one connection: run the query with the
+// client's descriptors as stdout and stderr, then report its status
+static void serve_connection(int conn, snapshot_t *index) {
+    char **args;
+    int arg_count;
+    int fds[2] = { -1, -1 };
+    if (become_peer(conn, index) != 0 || read_request(conn, &args, &arg_count, fds) != 0) {
+        _exit(1);
+    }
+    if (dup2(fds[0], STDOUT_FILENO) < 0 || dup2(fds[1], STDERR_FILENO) < 0) {
+        _exit(1);
+    }
+    close(fds[0]);
+    close(fds[1]);
+    // Nothing has been written to stdout yet, so its buffering can
+    // still follow the client's descriptor
+    setvbuf(stdout, NULL, isatty(STDOUT_FILENO) ? _IOLBF : _IOFBF, BUFSIZ);
+    
+    optind = 0;
+    int32_t status = findmax_main(arg_count, args, index);
+    fflush(stdout);
+    fflush(stderr);
+    write_full(conn, &status, sizeof(status));
+    _exit(0);
+}
+
+static int listen_on(const char *path) {
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "findmaxd: socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    
+    // Replace the socket of an earlier run, but nothing else
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int daemon_main(int argc, char *argv[]) {
+    const char *socket_path = NULL;
+    long rescan = DAEMON_DEFAULT_RESCAN;
+    int quiet = 0;
+    
+    static struct option long_options[] = {
+        {"socket", required_argument, 0, 's'},
+        {"rescan", required_argument, 0, 1000},
+        {"quiet", no_argument, 0, 'q'},
+        {"help", no_argument, 0, 1001},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:q", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 's':
+                socket_path = optarg;
+                break;
+            case 1000: // --rescan SECONDS
+                {
+                    char *endptr;
+                    rescan = strtol(optarg, &endptr, 10);
+                    if (endptr == optarg || *endptr != '\0' || rescan < 0) {
+                        fprintf(stderr, "findmaxd: invalid rescan interval '%s'\n", optarg);
+                        return 1;
+                    }
+                }
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            case 1001: // --help
+                print_daemon_usage();
+                return 0;
+            default:
+                print_daemon_usage();
+                return 1;
+        }
+    }
+    if (!socket_path || optind >= argc) {
+        print_daemon_usage();
+        return 1;
+    }
+    
+    // Roots are kept in canonical form, which is how clients ask for them
+    int root_count = argc - optind;
+    char **roots = calloc((size_t)root_count, sizeof(char *));
+    if (!roots) {
+        fprintf(stderr, "findmaxd: memory allocation failed\n");
+        return 1;
+    }
+    for (int i = 0; i < root_count; i++) {
+        if (!(roots[i] = realpath(argv[optind + i], NULL))) {
+            perror(argv[optind + i]);
+            return 1;
+        }
+    }
+    
+    char index_file[MAX_PATH_LEN];
+    int ret = snprintf(index_file, sizeof(index_file), "%s.index", socket_path);
+    if (ret < 0 || (size_t)ret >= sizeof(index_file)) {
+        fprintf(stderr, "findmaxd: path too long: %s\n", socket_path);
+        return 1;
+    }
+    
+    time_t started = time(NULL);
+    snapshot_t *index;
+    if (build_index(roots, root_count, index_file, quiet) != 0 || !(index = snapshot_open(index_file))) {
+        return 1;
+    }
+    if (!quiet) {
+        fprintf(stderr, "findmaxd: indexed %zu entries in %lds\n", snapshot_count(index), (long)(time(NULL) - started));
+    }
+    
+    int listener = listen_on(socket_path);
+    if (listener < 0) {
+        snapshot_close(index);
+        return 1;
+    }
+    
+    // No SA_RESTART: a signal wakes poll() so children are reaped and
+    // rescans start promptly
+    struct sigaction sa = {0};
+    sa.sa_handler = on_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGCHLD, &sa, NULL);
+    
+    pid_t rescan_pid = 0;
+    time_t next_rescan = rescan > 0 ? time(NULL) + rescan : 0;
+    while (!stop_requested) {
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            if (pid != rescan_pid) continue;
+            rescan_pid = 0;
+            snapshot_t *fresh;
+            if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && (fresh = snapshot_open(index_file))) {
+                snapshot_close(index);
+                index = fresh;
+                if (!quiet) {
+                    fprintf(stderr, "findmaxd: reindexed %zu entries\n", snapshot_count(index));
+                }
+            } else {
+                fprintf(stderr, "findmaxd: rescan failed, keeping the previous index\n");
+            }
+        }
+        
+        time_t now = time(NULL);
+        if (!rescan_pid && (rescan_requested || (next_rescan && now >= next_rescan))) {
+            rescan_requested = 0;
+            next_rescan = rescan > 0 ? now + rescan : 0;
+            fflush(stderr);
+            if ((rescan_pid = fork()) == 0) {
+                close(listener);
+                _exit(build_index(roots, root_count, index_file, quiet) == 0 ? 0 : 1);
+            }
+            if (rescan_pid < 0) {
+                perror("findmaxd: fork");
+                rescan_pid = 0;
+            }
+        }
+        
+        // Signals wake the poll early; the timeout only bounds how long a
+        // signal that arrives just before it can go unnoticed
+        struct pollfd pfd = { listener, POLLIN, 0 };
+        if (poll(&pfd, 1, 1000) <= 0) {
+            continue;
+        }
+        int conn = accept(listener, NULL, NULL);
+        if (conn < 0) {
+            continue;
+        }
+        fflush(stderr);
+        pid = fork();
+        if (pid == 0) {
+            close(listener);
+            serve_connection(conn, index);
+        }
+        if (pid < 0) {
+            perror("findmaxd: fork");
+        }
+        close(conn);
+    }
+    
+    close(listener);
+    unlink(socket_path);
+    snapshot_close(index);
+    for (int i = 0; i < root_count; i++) {
+        free(roots[i]);
+    }
+    free(roots);
+    return 0;
+}
+
+// Send this command line to the findmaxd on socket_path, with the path
+// operands made canonical, and wait for its exit status. The server
+// writes the results to our stdout and stderr itself.
+int daemon_query(const char *socket_path, char **args, int arg_count, char **paths, int path_count) {
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "findmax: socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+    
+    // Operands are the same strings as before parsing, so they can be
+    // found in the original vector by address; with none, ask for "."
+    char **canonical = calloc((size_t)arg_count + 1, sizeof(char *));
+    char **request_args = malloc(sizeof(char *) * ((size_t)arg_count + 1));
+    if (!canonical || !request_args) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
+        free(canonical);
+        free(request_args);
+        return 1;
+    }
+    int count = arg_count;
+    memcpy(request_args, args, sizeof(char *) * (size_t)arg_count);
+    int failed = 0;
+    for (int i = 1; i < arg_count && !failed; i++) {
+        for (int p = 0; p < path_count; p++) {
+            if (args[i] != paths[p]) continue;
+            if (!(canonical[i] = realpath(args[i], NULL))) {
+                perror(args[i]);
+                failed = 1;
+            }
+            request_args[i] = canonical[i];
+            break;
+        }
+    }
+    if (path_count == 0 && !failed) {
+        if (!(canonical[count] = realpath(".", NULL))) {
+            perror(".");
+            failed = 1;
+        }
+        request_args[count] = canonical[count];
+        count++;
+    }
+    
+    size_t length = 0;
+    for (int i = 0; i < count && !failed; i++) {
+        length += strlen(request_args[i]) + 1;
+    }
+    char *body = failed ? NULL : malloc(length ? length : 1);
+    if (body) {
+        char *p = body;
+        for (int i = 0; i < count; i++) {
+            size_t len = strlen(request_args[i]) + 1;
+            memcpy(p, request_args[i], len);
+            p += len;
+        }
+    }
+    for (int i = 0; i <= arg_count; i++) {
+        free(canonical[i]);
+    }
+    free(canonical);
+    free(request_args);
+    if (!body) {
+        if (!failed) fprintf(stderr, "findmax: memory allocation failed\n");
+        return 1;
+    }
+    if (length > DAEMON_MAX_REQUEST) {
+        fprintf(stderr, "findmax: command line too long for --connect\n");
+        free(body);
+        return 1;
+    }
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "findmax: %s: %s\n", socket_path, strerror(errno));
+        if (fd >= 0) close(fd);
+        free(body);
+        return 1;
+    }
+    
+    daemon_request_t request;
+    memcpy(request.magic, DAEMON_MAGIC, 4);
+    request.arg_count = (uint32_t)count;
+    request.length = (uint32_t)length;
+    
+    int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = { &request, sizeof(request) };
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    
+    fflush(stdout);
+    int32_t status;
+    if (sendmsg(fd, &msg, 0) != (ssize_t)sizeof(request) || write_full(fd, body, length) != 0 ||
+        read_full(fd, &status, sizeof(status)) != 0) {
+        fprintf(stderr, "findmax: %s: no reply from findmaxd\n", socket_path);
+        status = 1;
+    }
+    close(fd);
+    free(body);
+    return status;
+}
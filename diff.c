@@ -0,0 +1,268 @@
+#include "findmax.h"
+
+// Snapshot diff (--diff OLD): rank what changed between an old snapshot
+// and the current tree (or a second snapshot given with --from-snapshot).
+//
+// The two sides are joined with a hash join keyed by a 64-bit fingerprint
+// of the path or of (dev, ino). The old snapshot is the build side; each
+// table slot keeps the fingerprint and the two fields the rankings need,
+// so probing never touches the old file again. When the old side does not
+// fit in DIFF_TABLE_BYTES, records are split into partitions by
+// fingerprint and both snapshots are re-read once per partition, which
+// bounds memory at the cost of extra sequential passes over mmap()ed data.
+
+#ifndef DIFF_TABLE_BYTES
+#define DIFF_TABLE_BYTES ((size_t)256 << 20)
+#endif
+#define DIFF_LOAD_PERCENT 70
+
+typedef struct {
+    uint64_t key;     // fingerprint, 0 marks an empty slot
+    int64_t size;
+    int64_t mtime;
+} diff_slot_t;
+
+typedef struct {
+    diff_slot_t *slots;
+    size_t mask;
+} diff_table_t;
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t record_key(const char *path, const struct stat *st, const options_t *opts) {
+    uint64_t h;
+    if (opts->diff_join == DIFF_JOIN_INODE) {
+        h = mix64((uint64_t)st->st_dev * 0x9E3779B97F4A7C15ULL ^ mix64((uint64_t)st->st_ino));
+    } else {
+        // FNV-1a, finalized so the partition and slot bits are well mixed
+        h = 0xCBF29CE484222325ULL;
+        for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+            h = (h ^ *p) * 0x100000001B3ULL;
+        }
+        h = mix64(h);
+    }
+    return h ? h : 1;
+}
+
+static size_t table_capacity(size_t entries) {
+    size_t capacity = 16;
+    while (capacity * DIFF_LOAD_PERCENT / 100 < entries) capacity *= 2;
+    return capacity;
+}
+
+static void table_put(diff_table_t *table, uint64_t key, const struct stat *st) {
+    size_t i = (size_t)key & table->mask;
+    while (table->slots[i].key && table->slots[i].key != key) {
+        i = (i + 1) & table->mask;
+    }
+    table->slots[i].key = key;
+    table->slots[i].size = (int64_t)st->st_size;
+    table->slots[i].mtime = (int64_t)st->st_mtime;
+}
+
+static const diff_slot_t *table_get(const diff_table_t *table, uint64_t key) {
+    size_t i = (size_t)key & table->mask;
+    while (table->slots[i].key) {
+        if (table->slots[i].key == key) return &table->slots[i];
+        i = (i + 1) & table->mask;
+    }
+    return NULL;
+}
+
+// Partition from the high bits, slots from the low bits
+static size_t partition_of(uint64_t key, size_t partitions) {
+    return (size_t)((key >> 32) % partitions);
+}
+
+// The change a new record represents, or 0 if it does not count
+static int64_t record_delta(const struct stat *st, const diff_slot_t *old, const options_t *opts) {
+    switch (opts->diff_by) {
+        case DIFF_BY_NEW:
+            return old ? 0 : (int64_t)st->st_size;
+        case DIFF_BY_MTIME:
+            return old ? (int64_t)st->st_mtime - old->mtime : 0;
+        case DIFF_BY_GROWTH:
+        default:
+            return (int64_t)st->st_size - (old ? old->size : 0);
+    }
+}
+
+int snapshot_diff(snapshot_t *old_snap, snapshot_t *new_snap, const options_t *opts, min_heap_t *heap) {
+    size_t old_count = snapshot_count(old_snap);
+    size_t per_partition = DIFF_TABLE_BYTES / sizeof(diff_slot_t) * DIFF_LOAD_PERCENT / 100;
+    size_t partitions = old_count / per_partition + 1;
+    size_t capacity = table_capacity(old_count / partitions + 1);
+    
+    diff_table_t table;
+    table.slots = malloc(sizeof(diff_slot_t) * capacity);
+    table.mask = capacity - 1;
+    if (!table.slots) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
+        return -1;
+    }
+    
+    const char *path;
+    struct stat st;
+    int status = 0;
+    for (size_t p = 0; p < partitions && status >= 0; p++) {
+        memset(table.slots, 0, sizeof(diff_slot_t) * capacity);
+        
+        snapshot_rewind(old_snap);
+        while ((status = snapshot_next(old_snap, &path, &st)) > 0) {
+            uint64_t key = record_key(path, &st, opts);
+            if (partition_of(key, partitions) == p) {
+                table_put(&table, key, &st);
+            }
+        }
+        if (status < 0) break;
+        
+        // Rank by the delta: the heap keeps the largest sort_key, and -r
+        // flips the sign so it keeps the largest decrease instead
+        snapshot_rewind(new_snap);
+        while ((status = snapshot_next(new_snap, &path, &st)) > 0) {
+            STATS_INC(entries_read);
+            uint64_t key = record_key(path, &st, opts);
+            if (partition_of(key, partitions) != p) continue;
+            if (!should_include_name(path, opts) || !should_include_file(&st, opts)) continue;
+            
+            int64_t delta = record_delta(&st, table_get(&table, key), opts);
+            if (delta == 0) continue;
+            
+            file_entry_t entry;
+            strncpy(entry.path, path, MAX_PATH_LEN - 1);
+            entry.path[MAX_PATH_LEN - 1] = '\0';
+            entry.st = st;
+            entry.sort_key = opts->reverse ? delta : -delta;
+            heap_insert(heap, &entry);
+        }
+    }
+    
+    free(table.slots);
+    if (status < 0) {
+        fprintf(stderr, "findmax: snapshot is corrupt\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Print the ranked changes, largest first, as "DELTA<TAB>formatted entry"
+void print_diff_results(min_heap_t *heap, const options_t *opts) {
+    options_t rank_opts = *opts;
+    rank_opts.sort_type = SORT_SIZE;
+    rank_opts.sort_count = 0;
+    rank_opts.reverse = 1;
+    
+    file_entry_t *entries = get_heap_entries(heap);
+    size_t count = get_heap_size(heap);
+    file_list_t list = { entries, count, count };
+    sort_files(&list, &rank_opts);
+    
+    for (size_t i = 0; i < count; i++) {
+        long long delta = (long long)entries[i].sort_key;
+        if (!opts->reverse) delta = -delta;
+        char formatted_output[4096];
+        format_output(&entries[i], opts->format, formatted_output, sizeof(formatted_output));
+        printf("%+lld\t%s\n", delta, formatted_output);
+    }
+}
+
+// Scan the given paths into a snapshot at file, feeding the writer
+// through the regular heap traversal. The scan records every entry it
+// stat()s; the filters are applied when the two snapshots are joined.
+static int scan_to_snapshot(char **paths, int path_count, const options_t *opts, const char *file) {
+    options_t scan_opts = *opts;
+    scan_opts.filter_type = FILTER_ALL;
+    scan_opts.predicates = 0;
+    min_heap_t *heap = create_min_heap(1, &scan_opts);
+    if (!heap || !(scan_opts.snapshot_writer = snapshot_create(file))) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
+        free_min_heap(heap);
+        return -1;
+    }
+    
+    if (opts->files_from) {
+        traverse_files_from(opts->files_from, opts->files_from_delim, &scan_opts, heap);
+    } else {
+        for (int i = 0; i < path_count; i++) {
+            if (traverse_directory_optimized(paths[i], &scan_opts, heap, 0) != 0 && !opts->quiet) {
+                fprintf(stderr, "findmax: error processing '%s'\n", paths[i]);
+            }
+        }
+    }
+    free_min_heap(heap);
+    
+    return snapshot_finish(scan_opts.snapshot_writer);
+}
+
+int diff_main(char **paths, int path_count, options_t *opts) {
+    snapshot_t *old_snap = snapshot_open(opts->diff_snapshot);
+    if (!old_snap) {
+        return 1;
+    }
+    
+    // The current side is either a second snapshot or a fresh scan, kept
+    // in --save-snapshot FILE if given and in an unlinked temporary file
+    // otherwise
+    stats_phase_begin(PHASE_TRAVERSE);
+    snapshot_t *new_snap = NULL;
+    if (opts->from_snapshot) {
+        new_snap = snapshot_open(opts->from_snapshot);
+    } else {
+        char temp[MAX_PATH_LEN];
+        const char *file = opts->save_snapshot;
+        if (!file) {
+            const char *tmpdir = getenv("TMPDIR");
+            snprintf(temp, sizeof(temp), "%s/findmax-diff-XXXXXX", tmpdir && *tmpdir ? tmpdir : "/tmp");
+            int fd = mkstemp(temp);
+            if (fd < 0) {
+                perror(temp);
+                snapshot_close(old_snap);
+                return 1;
+            }
+            close(fd);
+            file = temp;
+        }
+        if (scan_to_snapshot(paths, path_count, opts, file) == 0) {
+            new_snap = snapshot_open(file);
+        }
+        if (!opts->save_snapshot) {
+            unlink(file);
+        }
+    }
+    if (!new_snap) {
+        snapshot_close(old_snap);
+        return 1;
+    }
+    
+    options_t rank_opts = *opts;
+    rank_opts.sort_type = SORT_SIZE;
+    rank_opts.sort_count = 0;
+    rank_opts.reverse = 1;
+    min_heap_t *heap = create_min_heap(opts->num_files, &rank_opts);
+    if (!heap) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
+        snapshot_close(new_snap);
+        snapshot_close(old_snap);
+        return 1;
+    }
+    
+    int failed = snapshot_diff(old_snap, new_snap, opts, heap) != 0;
+    snapshot_close(new_snap);
+    snapshot_close(old_snap);
+    stats_phase_end(PHASE_TRAVERSE);
+    
+    stats_phase_begin(PHASE_OUTPUT);
+    print_diff_results(heap, opts);
+    fflush(stdout);
+    stats_phase_end(PHASE_OUTPUT);
+    
+    free_min_heap(heap);
+    return failed;
+}
@@ -0,0 +1,254 @@
+#include "findmax.h"
+#include <sys/wait.h>
+
+// Running commands on the results (--exec, --exec-each, -P).
+//
+// The command is split into words once, when the option is parsed. With
+// --exec, paths are appended to it straight from the result array in
+// batches that fit the kernel's argument limit, as find's "-exec {} +"
+// and xargs do, so a thousand results cost a handful of fork()s rather
+// than a thousand. --exec-each runs the command once per result. Up to
+// -P commands run at the same time.
+
+#define EXEC_MAX_WORDS 256
+// Room left for the environment's growth and the kernel's bookkeeping, as
+// xargs leaves
+#define EXEC_ARG_HEADROOM 2048
+
+struct exec_command {
+    char *words[EXEC_MAX_WORDS];
+    int count;
+    int each;
+};
+
+// Split spec into words as the shell would, without expansions:
+// whitespace separates them, '...' is literal, a backslash escapes the
+// next character outside quotes and one of " \ $ ` inside "...". Returns
+// the number of words, each allocated, or -1.
+int split_command_words(const char *spec, char **words, int max_words) {
+    const char *p = spec;
+    char word[MAX_PATH_LEN];
+    int count = 0;
+    while (1) {
+        while (isspace((unsigned char)*p)) p++;
+        if (!*p) return count;
+        
+        size_t len = 0;
+        while (*p && !isspace((unsigned char)*p)) {
+            if (len + 1 >= sizeof(word)) goto fail;
+            if (*p == '\'') {
+                const char *close = strchr(p + 1, '\'');
+                if (!close || len + (size_t)(close - p) >= sizeof(word)) goto fail;
+                memcpy(word + len, p + 1, (size_t)(close - p - 1));
+                len += (size_t)(close - p - 1);
+                p = close + 1;
+            } else if (*p == '"') {
+                for (p++; *p != '"'; p++) {
+                    if (!*p || len + 1 >= sizeof(word)) goto fail;
+                    if (*p == '\\' && p[1] && strchr("\"\\$`", p[1])) p++;
+                    word[len++] = *p;
+                }
+                p++;
+            } else {
+                if (*p == '\\' && p[1]) p++;
+                word[len++] = *p++;
+            }
+        }
+        word[len] = '\0';
+        
+        if (count >= max_words || !(words[count] = strdup(word))) goto fail;
+        count++;
+    }
+    
+fail:
+    while (count > 0) free(words[--count]);
+    return -1;
+}
+
+exec_command_t *exec_parse(const char *spec, int each) {
+    exec_command_t *command = calloc(1, sizeof(exec_command_t));
+    if (!command) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
+        return NULL;
+    }
+    command->each = each;
+    command->count = split_command_words(spec, command->words, EXEC_MAX_WORDS - 1);
+    if (command->count <= 0) {
+        command->count = 0;
+        fprintf(stderr, "findmax: invalid command '%s'\n", spec);
+        exec_free(command);
+        return NULL;
+    }
+    
+    if (!each) {
+        // find's "CMD {} +": the + is optional here, and {} may only
+        // stand last since the paths are appended
+        if (command->count > 1 && strcmp(command->words[command->count - 1], "+") == 0) {
+            free(command->words[--command->count]);
+        }
+        for (int i = 0; i < command->count; i++) {
+            if (strcmp(command->words[i], "{}") != 0) continue;
+            if (i != command->count - 1 || i == 0) {
+                fprintf(stderr, "findmax: --exec: {} must be the last argument\n");
+                exec_free(command);
+                return NULL;
+            }
+            free(command->words[--command->count]);
+        }
+    }
+    return command;
+}
+
+void exec_free(exec_command_t *command) {
+    if (!command) return;
+    for (int i = 0; i < command->count; i++) {
+        free(command->words[i]);
+    }
+    free(command);
+}
+
+// Wait for one running command; returns 0 if it exited successfully
+static int exec_wait(void) {
+    int status;
+    while (waitpid(-1, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
+}
+
+static int exec_spawn(char **argv, int *running, int jobs) {
+    int failed = 0;
+    if (*running >= jobs) {
+        failed |= exec_wait();
+        (*running)--;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("findmax: fork");
+        return -1;
+    }
+    if (pid == 0) {
+        execvp(argv[0], argv);
+        fprintf(stderr, "findmax: %s: %s\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+    (*running)++;
+    return failed;
+}
+
+// Bytes available for the arguments of one command, after the environment
+static size_t exec_arg_budget(void) {
+    long arg_max = sysconf(_SC_ARG_MAX);
+    size_t budget = arg_max > 0 ? (size_t)arg_max : 131072;
+    for (char **env = environ; *env; env++) {
+        size_t len = strlen(*env) + 1 + sizeof(char *);
+        budget = budget > len ? budget - len : 0;
+    }
+    return budget > EXEC_ARG_HEADROOM * 2 ? budget - EXEC_ARG_HEADROOM : EXEC_ARG_HEADROOM;
+}
+
+// Run --exec-each: the command once per path, with {} replaced anywhere
+// it occurs in a word, or the path appended if no word contains {}
+static int exec_each(const exec_command_t *command, const file_entry_t *entries, size_t count, int jobs, int *running) {
+    int failed = 0;
+    int substituted = 0;
+    for (int i = 0; i < command->count; i++) {
+        if (strstr(command->words[i], "{}")) substituted = 1;
+    }
+    
+    char *argv[EXEC_MAX_WORDS + 1];
+    char (*buffers)[MAX_PATH_LEN] = malloc(sizeof(*buffers) * (size_t)command->count);
+    if (!buffers) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
+        return -1;
+    }
+    for (size_t e = 0; e < count; e++) {
+        const char *path = entries[e].path;
+        size_t path_len = strlen(path);
+        int argc = 0;
+        int overflow = 0;
+        for (int i = 0; i < command->count && !overflow; i++) {
+            const char *word = command->words[i];
+            if (!strstr(word, "{}")) {
+                argv[argc++] = command->words[i];
+                continue;
+            }
+            size_t len = 0;
+            for (const char *p = word; *p && !overflow; ) {
+                int brace = p[0] == '{' && p[1] == '}';
+                if (len + (brace ? path_len : 1) >= MAX_PATH_LEN) {
+                    overflow = 1;
+                } else if (brace) {
+                    memcpy(buffers[i] + len, path, path_len);
+                    len += path_len;
+                    p += 2;
+                } else {
+                    buffers[i][len++] = *p++;
+                }
+            }
+            buffers[i][len] = '\0';
+            argv[argc++] = buffers[i];
+        }
+        // A truncated argument would name another file: skip the entry
+        if (overflow) {
+            fprintf(stderr, "findmax: %s: argument too long after substituting {}, skipped\n", path);
+            failed = 1;
+            continue;
+        }
+        if (!substituted) argv[argc++] = (char *)path;
+        argv[argc] = NULL;
+        failed |= exec_spawn(argv, running, jobs);
+    }
+    free(buffers);
+    return failed;
+}
+
+// Run --exec: as many paths per command as the argument limit allows
+static int exec_batched(const exec_command_t *command, const file_entry_t *entries, size_t count, int jobs, int *running) {
+    size_t budget = exec_arg_budget();
+    size_t fixed = 0;
+    for (int i = 0; i < command->count; i++) {
+        fixed += strlen(command->words[i]) + 1 + sizeof(char *);
+    }
+    
+    char **argv = malloc(sizeof(char *) * ((size_t)command->count + count + 1));
+    if (!argv) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
+        return -1;
+    }
+    memcpy(argv, command->words, sizeof(char *) * (size_t)command->count);
+    
+    int failed = 0;
+    size_t next = 0;
+    while (next < count) {
+        size_t argc = (size_t)command->count;
+        size_t used = fixed;
+        // Always at least one path, however long
+        do {
+            used += strlen(entries[next].path) + 1 + sizeof(char *);
+            argv[argc++] = (char *)entries[next++].path;
+        } while (next < count && used + strlen(entries[next].path) + 1 + sizeof(char *) <= budget);
+        argv[argc] = NULL;
+        failed |= exec_spawn(argv, running, jobs);
+    }
+    free(argv);
+    return failed;
+}
+
+// Run the command over the first count results in output order; returns 0
+// if every command ran and exited with status 0
+int exec_run(const exec_command_t *command, const file_entry_t *entries, size_t count, int jobs) {
+    if (count == 0) return 0;
+    if (jobs < 1) jobs = 1;
+    // Children inherit stdout; anything printed so far goes first
+    fflush(stdout);
+    
+    int running = 0;
+    int failed = command->each ? exec_each(command, entries, count, jobs, &running)
+                               : exec_batched(command, entries, count, jobs, &running);
+    while (running > 0) {
+        failed |= exec_wait();
+        running--;
+    }
+    return failed ? -1 : 0;
+}
@@ -43,53 +43,171 @@ int add_file_entry(file_list_t *files, const char *path, const struct stat *st,
     // Copy stat info
     entry->st = *st;
     
-    // Set sort criteria based on sort type
-    switch (opts->sort_type) {
-        case SORT_ATIME:
-            entry->sort_time = st->st_atime;
-            break;
-        case SORT_CTIME:
-            entry->sort_time = st->st_ctime;
-            break;
-        case SORT_MTIME:
-            entry->sort_time = st->st_mtime;
-            break;
-        case SORT_BTIME:
-#ifdef __APPLE__
-            entry->sort_time = st->st_birthtime;
-#else
-            entry->sort_time = st->st_ctime; // Fallback to ctime on Linux
-#endif
-            break;
-        case SORT_SIZE:
-            entry->sort_size = st->st_size;
-            break;
-        case SORT_NAME:
-            // For name sorting, we'll use the path directly in comparison
-            break;
-    }
+    set_sort_key(entry, opts);
     
     files->count++;
     return 0;
 }
 
+unsigned file_type_bit(mode_t mode) {
+    if (S_ISREG(mode)) return TYPE_REG;
+    if (S_ISDIR(mode)) return TYPE_DIR;
+    if (S_ISLNK(mode)) return TYPE_LNK;
+    if (S_ISSOCK(mode)) return TYPE_SOCK;
+    if (S_ISFIFO(mode)) return TYPE_FIFO;
+    if (S_ISBLK(mode)) return TYPE_BLK;
+    if (S_ISCHR(mode)) return TYPE_CHR;
+    return 0;
+}
+
+// Parse --type letters as in find(1): f d l s p b c, optionally comma separated
+int parse_type_list(const char *arg, unsigned *mask) {
+    *mask = 0;
+    for (const char *p = arg; *p; p++) {
+        switch (*p) {
+            case 'f': *mask |= TYPE_REG; break;
+            case 'd': *mask |= TYPE_DIR; break;
+            case 'l': *mask |= TYPE_LNK; break;
+            case 's': *mask |= TYPE_SOCK; break;
+            case 'p': *mask |= TYPE_FIFO; break;
+            case 'b': *mask |= TYPE_BLK; break;
+            case 'c': *mask |= TYPE_CHR; break;
+            case ',': break;
+            default: return -1;
+        }
+    }
+    return *mask ? 0 : -1;
+}
+
+// Parse a duration into milliseconds: 500ms, 2s, 1.5m, 1h (seconds if no unit)
+int parse_duration(const char *arg, long *ms) {
+    char *endptr;
+    double amount = strtod(arg, &endptr);
+    if (endptr == arg || amount < 0) {
+        return -1;
+    }
+    
+    double unit;
+    if (strcmp(endptr, "ms") == 0) unit = 1;
+    else if (strcmp(endptr, "s") == 0 || *endptr == '\0') unit = 1000;
+    else if (strcmp(endptr, "m") == 0) unit = 60 * 1000;
+    else if (strcmp(endptr, "h") == 0) unit = 3600 * 1000;
+    else return -1;
+    
+    *ms = (long)(amount * unit);
+    return 0;
+}
+
+// Timestamp used by --newer/--older: the selected time key, mtime otherwise
+static time_t predicate_time(const struct stat *st, const options_t *opts) {
+    const sort_key_t *key = &sort_keys[opts->sort_type];
+    return key->is_time ? (time_t)key->extract(NULL, st) : st->st_mtime;
+}
+
 int should_include_file(const struct stat *st, const options_t *opts) {
     switch (opts->filter_type) {
         case FILTER_FILE_ONLY:
-            return S_ISREG(st->st_mode);
+            if (!S_ISREG(st->st_mode)) return 0;
+            break;
         case FILTER_DIR_ONLY:
-            return S_ISDIR(st->st_mode);
+            if (!S_ISDIR(st->st_mode)) return 0;
+            break;
         case FILTER_ALL:
         default:
-            return 1;
+            break;
+    }
+    
+    if (!opts->predicates) {
+        return 1;
     }
+    
+    unsigned pred = opts->predicates;
+    if ((pred & PRED_TYPE) && !(opts->type_mask & file_type_bit(st->st_mode))) return 0;
+    if ((pred & PRED_MIN_SIZE) && st->st_size < opts->min_size) return 0;
+    if ((pred & PRED_MAX_SIZE) && st->st_size > opts->max_size) return 0;
+    if ((pred & PRED_UID) && st->st_uid != opts->uid) return 0;
+    if ((pred & PRED_GID) && st->st_gid != opts->gid) return 0;
+    if (pred & (PRED_NEWER | PRED_OLDER)) {
+        time_t t = predicate_time(st, opts);
+        if ((pred & PRED_NEWER) && t <= opts->newer_than) return 0;
+        if ((pred & PRED_OLDER) && t >= opts->older_than) return 0;
+    }
+    return 1;
+}
+
+// Name predicate, checked on the last path component before anything else
+int should_include_name(const char *path, const options_t *opts) {
+    if (!(opts->predicates & PRED_NAME)) {
+        return 1;
+    }
+    
+    size_t len = strlen(path);
+    while (len > 1 && path[len - 1] == '/') len--;
+    size_t start = len;
+    while (start > 0 && path[start - 1] != '/') start--;
+    
+    if (path[len] == '\0') {
+        return fnmatch(opts->name_glob, path + start, 0) == 0;
+    }
+    
+    char name[MAX_PATH_LEN];
+    memcpy(name, path + start, len - start);
+    name[len - start] = '\0';
+    return fnmatch(opts->name_glob, name, 0) == 0;
+}
+
+static int skip_by_dirent(const struct dirent *entry, const options_t *opts) {
+#ifdef _DIRENT_HAVE_D_TYPE
+    unsigned char type = entry->d_type;
+    if (type == DT_UNKNOWN || type == DT_DIR || (type == DT_LNK && opts->dereference)) {
+        return 0;
+    }
+    
+    if (opts->filter_type == FILTER_DIR_ONLY) return 1;
+    if (opts->filter_type == FILTER_FILE_ONLY && type != DT_REG) return 1;
+    if (opts->predicates & PRED_TYPE) {
+        unsigned bit = 0;
+        switch (type) {
+            case DT_REG: bit = TYPE_REG; break;
+            case DT_LNK: bit = TYPE_LNK; break;
+            case DT_SOCK: bit = TYPE_SOCK; break;
+            case DT_FIFO: bit = TYPE_FIFO; break;
+            case DT_BLK: bit = TYPE_BLK; break;
+            case DT_CHR: bit = TYPE_CHR; break;
+        }
+        if (!(opts->type_mask & bit)) return 1;
+    }
+    if ((opts->predicates & PRED_NAME) && fnmatch(opts->name_glob, entry->d_name, 0) != 0) {
+        return 1;
+    }
+#else
+    (void)entry;
+    (void)opts;
+#endif
+    return 0;
+}
+
+// Decide from the directory entry alone whether it can neither be reported
+// nor descended into, so the stat() call can be skipped entirely
+int should_skip_entry(const struct dirent *entry, const options_t *opts) {
+    if (skip_by_dirent(entry, opts)) {
+        STATS_INC(stat_avoided);
+        return 1;
+    }
+    return 0;
 }
 
 int traverse_directory(const char *path, const options_t *opts, file_list_t *files) {
     return traverse_directory_depth(path, opts, files, 0);
 }
 
+static int traverse_depth_rules(const char *path, const options_t *opts, file_list_t *files, int current_depth, ignore_rules_t *rules, dev_t parent_dev);
+
 int traverse_directory_depth(const char *path, const options_t *opts, file_list_t *files, int current_depth) {
+    return traverse_depth_rules(path, opts, files, current_depth, NULL, 0);
+}
+
+static int traverse_depth_rules(const char *path, const options_t *opts, file_list_t *files, int current_depth, ignore_rules_t *rules, dev_t parent_dev) {
     struct stat st;
     
     // Check depth limit
@@ -97,14 +215,14 @@ int traverse_directory_depth(const char *path, const options_t *opts, file_list_
         return 0;
     }
     
-    // Get file/directory stats
-    int stat_result;
-    if (opts->dereference) {
-        stat_result = stat(path, &st);
-    } else {
-        stat_result = lstat(path, &st);
+    // A mount point the policy skips is not even stat()ed
+    if (opts->mount_policy && current_depth > 0 && mount_path_skipped(path, opts)) {
+        return 0;
     }
     
+    // Get file/directory stats
+    int stat_result = stat_path(path, &st, opts);
+    
     if (stat_result != 0) {
         if (!opts->quiet) {
             perror(path);
@@ -113,7 +231,7 @@ int traverse_directory_depth(const char *path, const options_t *opts, file_list_
     }
     
     // Add current file/directory if it matches filter
-    if (should_include_file(&st, opts)) {
+    if (should_include_name(path, opts) && should_include_file(&st, opts)) {
         if (add_file_entry(files, path, &st, opts) != 0) {
             if (!opts->quiet) {
                 fprintf(stderr, "findmax: memory allocation failed\n");
@@ -123,8 +241,8 @@ int traverse_directory_depth(const char *path, const options_t *opts, file_list_
     }
     
     // If it's a directory and recursive mode is enabled, traverse it
-    if (S_ISDIR(st.st_mode) && opts->recursive) {
-        DIR *dir = opendir(path);
+    if (S_ISDIR(st.st_mode) && opts->recursive && mount_may_enter(path, &st, parent_dev, current_depth, opts)) {
+        DIR *dir = open_directory(path);
         if (!dir) {
             if (!opts->quiet) {
                 perror(path);
@@ -132,13 +250,21 @@ int traverse_directory_depth(const char *path, const options_t *opts, file_list_
             return -1;
         }
         
+        // Inherit ignore rules and add this level's .gitignore/.ignore
+        ignore_rules_t *dir_rules = opts->ignore_vcs ? ignore_rules_enter(rules, path) : NULL;
+        
         struct dirent *entry;
-        while ((entry = readdir(dir)) != NULL) {
+        while ((entry = read_directory(dir)) != NULL) {
             // Skip . and ..
             if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
                 continue;
             }
             
+            // Cheap predicates on the name and d_type run before stat()
+            if ((opts->predicates || opts->filter_type != FILTER_ALL) && should_skip_entry(entry, opts)) {
+                continue;
+            }
+            
             // Build full path
             char full_path[MAX_PATH_LEN];
             int ret = snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
@@ -148,73 +274,29 @@ int traverse_directory_depth(const char *path, const options_t *opts, file_list_
                 }
                 continue;
             }
+            STATS_ADD(path_bytes, ret);
+            
+            if (opts->ignore_vcs && ignore_should_prune(dir_rules, full_path, entry, opts)) {
+                continue;
+            }
             
             // Recursively traverse with incremented depth
-            traverse_directory_depth(full_path, opts, files, current_depth + 1);
+            traverse_depth_rules(full_path, opts, files, current_depth + 1, dir_rules, st.st_dev);
         }
         
+        ignore_rules_release(dir_rules);
         closedir(dir);
     }
     
     return 0;
 }
 
-static int compare_time(const void *a, const void *b, int reverse) {
-    const file_entry_t *fa = (const file_entry_t *)a;
-    const file_entry_t *fb = (const file_entry_t *)b;
-    
-    time_t diff = fa->sort_time - fb->sort_time;
-    if (diff == 0) return 0;
-    
-    // Normal ascending order: smaller values first
-    int result = (diff > 0) ? 1 : -1;
-    return reverse ? -result : result;
-}
-
-static int compare_size(const void *a, const void *b, int reverse) {
-    const file_entry_t *fa = (const file_entry_t *)a;
-    const file_entry_t *fb = (const file_entry_t *)b;
-    
-    off_t diff = fa->sort_size - fb->sort_size;
-    if (diff == 0) return 0;
-    
-    // Normal ascending order: smaller values first
-    int result = (diff > 0) ? 1 : -1;
-    return reverse ? -result : result;
-}
-
-static int compare_name(const void *a, const void *b, int reverse) {
-    const file_entry_t *fa = (const file_entry_t *)a;
-    const file_entry_t *fb = (const file_entry_t *)b;
-    
-    // Extract just the filename from the path for comparison
-    const char *name_a = strrchr(fa->path, '/');
-    const char *name_b = strrchr(fb->path, '/');
-    
-    name_a = name_a ? name_a + 1 : fa->path;
-    name_b = name_b ? name_b + 1 : fb->path;
-    
-    int result = strcoll(name_a, name_b);
-    return reverse ? -result : result;
-}
-
 static int file_compare_wrapper(const void *a, const void *b) {
     // This is a global variable hack - not ideal but needed for qsort
     extern const options_t *g_sort_opts;
     
-    switch (g_sort_opts->sort_type) {
-        case SORT_ATIME:
-        case SORT_CTIME:
-        case SORT_MTIME:
-        case SORT_BTIME:
-            return compare_time(a, b, g_sort_opts->reverse);
-        case SORT_SIZE:
-            return compare_size(a, b, g_sort_opts->reverse);
-        case SORT_NAME:
-            return compare_name(a, b, g_sort_opts->reverse);
-        default:
-            return 0;
-    }
+    int result = compare_sort_keys((const file_entry_t *)a, (const file_entry_t *)b, g_sort_opts);
+    return g_sort_opts->reverse ? -result : result;
 }
 
 // Global variable for qsort (not ideal but necessary)
@@ -229,40 +311,39 @@ void sort_files(file_list_t *files, const options_t *opts) {
 
 // Compare two file entries directly (for num_files == 1 optimization)
 int compare_file_entries(const file_entry_t *a, const file_entry_t *b, const options_t *opts) {
-    switch (opts->sort_type) {
-        case SORT_ATIME:
-        case SORT_CTIME:
-        case SORT_MTIME:
-        case SORT_BTIME:
-            {
-                time_t diff = a->sort_time - b->sort_time;
-                if (diff == 0) return 0;
-                int result = (diff > 0) ? 1 : -1;
-                return opts->reverse ? -result : result;
-            }
-        case SORT_SIZE:
-            {
-                off_t diff = a->sort_size - b->sort_size;
-                if (diff == 0) return 0;
-                int result = (diff > 0) ? 1 : -1;
-                return opts->reverse ? -result : result;
-            }
-        case SORT_NAME:
-            {
-                const char *name_a = strrchr(a->path, '/');
-                const char *name_b = strrchr(b->path, '/');
-                name_a = name_a ? name_a + 1 : a->path;
-                name_b = name_b ? name_b + 1 : b->path;
-                int result = strcoll(name_a, name_b);
-                return opts->reverse ? -result : result;
-            }
-        default:
-            return 0;
+    int result = compare_sort_keys(a, b, opts);
+    return opts->reverse ? -result : result;
+}
+
+static int traverse_single_rules(const char *path, const options_t *opts, file_entry_t *best, int current_depth, ignore_rules_t *rules, dev_t parent_dev);
+
+// Workers of a split giant directory each keep their own best entry
+static void *split_best_create(void *context) {
+    (void)context;
+    return calloc(1, sizeof(file_entry_t));
+}
+
+static void split_best_offer(void *sink, const file_entry_t *entry, const options_t *opts) {
+    file_entry_t *best = sink;
+    if (best->path[0] == '\0' || compare_file_entries(entry, best, opts) < 0) {
+        *best = *entry;
     }
 }
 
+static void split_best_merge(void *context, void *sink, const options_t *opts) {
+    file_entry_t *worker_best = sink;
+    if (worker_best->path[0] != '\0') {
+        split_best_offer(context, worker_best, opts);
+    }
+    free(worker_best);
+}
+
 // Optimized traversal for num_files == 1: use direct comparison instead of heap
 int traverse_directory_single(const char *path, const options_t *opts, file_entry_t *best, int current_depth) {
+    return traverse_single_rules(path, opts, best, current_depth, NULL, 0);
+}
+
+static int traverse_single_rules(const char *path, const options_t *opts, file_entry_t *best, int current_depth, ignore_rules_t *rules, dev_t parent_dev) {
     struct stat st;
     
     // Check depth limit
@@ -270,14 +351,14 @@ int traverse_directory_single(const char *path, const options_t *opts, file_entr
         return 0;
     }
     
-    // Get file/directory stats
-    int stat_result;
-    if (opts->dereference) {
-        stat_result = stat(path, &st);
-    } else {
-        stat_result = lstat(path, &st);
+    // A mount point the policy skips is not even stat()ed
+    if (opts->mount_policy && current_depth > 0 && mount_path_skipped(path, opts)) {
+        return 0;
     }
     
+    // Get file/directory stats
+    int stat_result = stat_path(path, &st, opts);
+    
     if (stat_result != 0) {
         if (!opts->quiet) {
             perror(path);
@@ -286,46 +367,24 @@ int traverse_directory_single(const char *path, const options_t *opts, file_entr
     }
     
     // Add current file/directory if it matches filter
-    if (should_include_file(&st, opts)) {
+    if (should_include_name(path, opts) && should_include_file(&st, opts)) {
         file_entry_t entry;
+        STATS_ADD(path_bytes, strlen(path));
         strncpy(entry.path, path, MAX_PATH_LEN - 1);
         entry.path[MAX_PATH_LEN - 1] = '\0';
         entry.st = st;
         
-        // Set sort criteria
-        switch (opts->sort_type) {
-            case SORT_ATIME:
-                entry.sort_time = st.st_atime;
-                break;
-            case SORT_CTIME:
-                entry.sort_time = st.st_ctime;
-                break;
-            case SORT_MTIME:
-                entry.sort_time = st.st_mtime;
-                break;
-            case SORT_BTIME:
-#ifdef __APPLE__
-                entry.sort_time = st.st_birthtime;
-#else
-                entry.sort_time = st.st_ctime;
-#endif
-                break;
-            case SORT_SIZE:
-                entry.sort_size = st.st_size;
-                break;
-            case SORT_NAME:
-                break;
-        }
+        set_sort_key(&entry, opts);
         
-        // Compare directly: if no best yet, or this is better, update best
-        if (best->path[0] == '\0' || compare_file_entries(&entry, best, opts) > 0) {
+        // Compare directly: if no best yet, or this sorts first, update best
+        if (best->path[0] == '\0' || compare_file_entries(&entry, best, opts) < 0) {
             *best = entry;
         }
     }
     
     // Recursive traversal for directories
-    if (S_ISDIR(st.st_mode) && opts->recursive) {
-        DIR *dir = opendir(path);
+    if (S_ISDIR(st.st_mode) && opts->recursive && mount_may_enter(path, &st, parent_dev, current_depth, opts)) {
+        DIR *dir = open_directory(path);
         if (!dir) {
             if (!opts->quiet) {
                 perror(path);
@@ -333,13 +392,30 @@ int traverse_directory_single(const char *path, const options_t *opts, file_entr
             return -1;
         }
         
+        // Inherit ignore rules and add this level's .gitignore/.ignore
+        ignore_rules_t *dir_rules = opts->ignore_vcs ? ignore_rules_enter(rules, path) : NULL;
+        
+        dir_split_sink_t sink = { split_best_create, split_best_offer, split_best_merge, best };
+        dir_split_t *split = NULL;
+        size_t entries_seen = 0;
+        
         struct dirent *entry;
-        while ((entry = readdir(dir)) != NULL) {
+        while ((entry = read_directory(dir)) != NULL) {
             // Skip . and ..
             if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
                 continue;
             }
             
+            // A giant directory's files go to stat() workers from here on
+            if (++entries_seen == SPLIT_START_ENTRIES) {
+                split = dir_split_begin(dir, &st, current_depth + 1, &sink, opts);
+            }
+            
+            // Cheap predicates on the name and d_type run before stat()
+            if ((opts->predicates || opts->filter_type != FILTER_ALL) && should_skip_entry(entry, opts)) {
+                continue;
+            }
+            
             char full_path[MAX_PATH_LEN];
             int ret = snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
             if (ret < 0 || (size_t)ret >= sizeof(full_path)) {
@@ -348,10 +424,21 @@ int traverse_directory_single(const char *path, const options_t *opts, file_entr
                 }
                 continue;
             }
+            STATS_ADD(path_bytes, ret);
+            
+            if (opts->ignore_vcs && ignore_should_prune(dir_rules, full_path, entry, opts)) {
+                continue;
+            }
+            
+            if (split && dir_split_add(split, entry, full_path, (size_t)ret) == 0) {
+                continue;
+            }
             
-            traverse_directory_single(full_path, opts, best, current_depth + 1);
+            traverse_single_rules(full_path, opts, best, current_depth + 1, dir_rules, st.st_dev);
         }
         
+        dir_split_finish(split);
+        ignore_rules_release(dir_rules);
         closedir(dir);
     }
     
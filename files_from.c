@@ -0,0 +1,122 @@
+#include "findmax.h"
+#include <fcntl.h>
+
+// Streaming path input for --files-from / --files0-from.
+//
+// Paths are read one at a time with getdelim() into a single reused
+// buffer and go through the same stat, filter and heap steps as a
+// traversal, so memory stays constant however long the list is. Listings
+// from locate, git ls-files or find keep siblings together, so the parent
+// directory of the previous path is kept open and each stat is an
+// fstatat() on the last component instead of a full path lookup.
+
+typedef struct {
+    char dir[MAX_PATH_LEN];
+    size_t dir_len;
+    int fd;
+} parent_cache_t;
+
+static int open_parent(parent_cache_t *cache, const char *path, size_t dir_len) {
+    if (cache->fd >= 0 && cache->dir_len == dir_len && memcmp(cache->dir, path, dir_len) == 0) {
+        return cache->fd;
+    }
+    if (cache->fd >= 0) {
+        close(cache->fd);
+        cache->fd = -1;
+    }
+    if (dir_len >= sizeof(cache->dir)) {
+        return -1;
+    }
+    
+    memcpy(cache->dir, path, dir_len);
+    cache->dir[dir_len] = '\0';
+    cache->dir_len = dir_len;
+#ifdef O_PATH
+    cache->fd = open(dir_len ? cache->dir : "/", O_PATH | O_DIRECTORY | O_CLOEXEC);
+#else
+    cache->fd = open(dir_len ? cache->dir : "/", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+#endif
+    return cache->fd;
+}
+
+// stat() a listed path through the cached parent directory when the path
+// has a usable last component, and plainly otherwise
+static int stat_listed(parent_cache_t *cache, const char *path, struct stat *st, const options_t *opts) {
+    const char *slash = strrchr(path, '/');
+    if (!slash) {
+        return stat_path_at(AT_FDCWD, path, st, opts);
+    }
+    if (slash[1] == '\0') {
+        return stat_path(path, st, opts);
+    }
+    
+    int dirfd = open_parent(cache, path, (size_t)(slash - path));
+    if (dirfd < 0) {
+        return stat_path(path, st, opts);
+    }
+    return stat_path_at(dirfd, slash + 1, st, opts);
+}
+
+int traverse_files_from(const char *file, int delim, const options_t *opts, min_heap_t *heap) {
+    FILE *in = strcmp(file, "-") == 0 ? stdin : fopen(file, "r");
+    if (!in) {
+        perror(file);
+        return -1;
+    }
+    
+    parent_cache_t cache;
+    cache.fd = -1;
+    cache.dir_len = 0;
+    
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t len;
+    while ((len = getdelim(&line, &capacity, delim, in)) != -1) {
+        if (len > 0 && line[len - 1] == delim) {
+            line[--len] = '\0';
+        }
+        if (len == 0) {
+            continue;
+        }
+        if (len >= MAX_PATH_LEN) {
+            if (!opts->quiet) {
+                fprintf(stderr, "findmax: path too long: %.64s...\n", line);
+            }
+            continue;
+        }
+        STATS_INC(entries_read);
+        
+        // The name filter runs before stat() unless -R may need to expand
+        // a non-matching directory
+        struct stat st;
+        if (!opts->recursive && !should_include_name(line, opts)) {
+            STATS_INC(stat_avoided);
+            continue;
+        }
+        if (stat_listed(&cache, line, &st, opts) != 0) {
+            if (!opts->quiet) {
+                perror(line);
+            }
+            continue;
+        }
+        if (opts->recursive && S_ISDIR(st.st_mode)) {
+            // The walk stats and offers the directory itself
+            traverse_directory_optimized(line, opts, heap, 0);
+        } else if (should_include_name(line, opts) && should_include_file(&st, opts)) {
+            heap_offer(heap, line, &st, opts);
+        }
+    }
+    
+    int read_error = ferror(in);
+    if (read_error) {
+        perror(file);
+    }
+    if (cache.fd >= 0) {
+        close(cache.fd);
+    }
+    free(line);
+    if (in != stdin) {
+        fclose(in);
+    }
+    return read_error ? -1 : 0;
+}
@@ -8,10 +8,10 @@ _findmax() {
     prev="${COMP_WORDS[COMP_CWORD-1]}"
 
     # Long options
-    local long_opts="--recursive --reverse --name --file-only --dir-only --format --verbose --quiet --dereference --time --maxdepth --version --help"
+    local long_opts="--recursive --reverse --name --file-only --dir-only --format --verbose --quiet --dereference --xdev --pseudo-fs --mount-policy --threads --time --sort --score --until-size --until-count --maxdepth --ignore-vcs --min-size --max-size --newer --older --glob --uid --gid --type --files-from --files0-from --deadline --approx --stats --save-snapshot --from-snapshot --diff --diff-by --join --exec --exec-each --max-procs --connect --batch --shard --shard-depth --merge --query --histogram --quantiles --total --group-by --max-groups --flat --version --help"
     
     # Short options
-    local short_opts="-R -r -u -c -t -S -n -f -d -F -v -q -L"
+    local short_opts="-R -r -u -c -t -S -n -f -d -F -v -q -L -x -P"
     
     # All options combined
     opts="$long_opts $short_opts"
@@ -23,11 +23,63 @@ _findmax() {
             COMPREPLY=( $(compgen -W '"%n" "%n %y" "%n %s" "%n %s %y" "%A %n" "%U:%G %n"' -- "$cur") )
             return 0
             ;;
+        --sort)
+            COMPREPLY=( $(compgen -W "mtime atime ctime btime size name blocks links depth pathlen score" -- "$cur") )
+            return 0
+            ;;
         --time)
             # Time type completion
             COMPREPLY=( $(compgen -W "atime access use ctime status mtime modification birth creation" -- "$cur") )
             return 0
             ;;
+        --stats)
+            COMPREPLY=( $(compgen -W "text json" -- "$cur") )
+            return 0
+            ;;
+        --diff-by)
+            COMPREPLY=( $(compgen -W "growth new mtime" -- "$cur") )
+            return 0
+            ;;
+        --total)
+            COMPREPLY=( $(compgen -W "size blocks count" -- "$cur") )
+            return 0
+            ;;
+        --group-by)
+            COMPREPLY=( $(compgen -W "dir dir: ext uid gid" -- "$cur") )
+            return 0
+            ;;
+        --join)
+            COMPREPLY=( $(compgen -W "path inode" -- "$cur") )
+            return 0
+            ;;
+        --files-from|--files0-from|--save-snapshot|--from-snapshot|--diff|--connect|--mount-policy)
+            COMPREPLY=( $(compgen -f -- "$cur") )
+            return 0
+            ;;
+        --type)
+            COMPREPLY=( $(compgen -W "f d l s p b c" -- "$cur") )
+            return 0
+            ;;
+        --exec|--exec-each)
+            COMPREPLY=( $(compgen -c -- "$cur") )
+            return 0
+            ;;
+        --shard)
+            COMPREPLY=( $(compgen -W "1/2 1/4 1/8" -- "$cur") )
+            return 0
+            ;;
+        --max-procs|-P|--threads)
+            COMPREPLY=( $(compgen -W "1 2 4 8 16" -- "$cur") )
+            return 0
+            ;;
+        --uid)
+            COMPREPLY=( $(compgen -u -- "$cur") )
+            return 0
+            ;;
+        --gid)
+            COMPREPLY=( $(compgen -g -- "$cur") )
+            return 0
+            ;;
         --maxdepth)
             # Number completion for maxdepth
             COMPREPLY=( $(compgen -W "1 2 3 4 5 10" -- "$cur") )
@@ -15,18 +15,27 @@
 #include <errno.h>
 #include <locale.h>
 #include <ctype.h>
+#include <fnmatch.h>
+#include <stdint.h>
 
 #define MAX_PATH_LEN 4096
 #define MAX_FORMAT_LEN 1024
 #define DEFAULT_NUM_FILES 1
 
+// Sort keys, indexing the extractor table in keys.c
 typedef enum {
     SORT_MTIME,
     SORT_ATIME,
     SORT_CTIME,
     SORT_BTIME,
     SORT_SIZE,
-    SORT_NAME
+    SORT_NAME,
+    SORT_BLOCKS,
+    SORT_NLINK,
+    SORT_DEPTH,
+    SORT_PATHLEN,
+    SORT_SCORE,
+    SORT_KEY_COUNT
 } sort_type_t;
 
 typedef enum {
@@ -35,46 +44,254 @@ typedef enum {
     FILTER_DIR_ONLY
 } filter_type_t;
 
+// Predicate filters (options_t.predicates bits)
+#define PRED_MIN_SIZE  0x01
+#define PRED_MAX_SIZE  0x02
+#define PRED_NEWER     0x04
+#define PRED_OLDER     0x08
+#define PRED_NAME      0x10
+#define PRED_UID       0x20
+#define PRED_GID       0x40
+#define PRED_TYPE      0x80
+
+// File type bits for --type (options_t.type_mask)
+#define TYPE_REG   0x01
+#define TYPE_DIR   0x02
+#define TYPE_LNK   0x04
+#define TYPE_SOCK  0x08
+#define TYPE_FIFO  0x10
+#define TYPE_BLK   0x20
+#define TYPE_CHR   0x40
+
+// Scan statistics (stats.c), collected only while g_stats_enabled is set
+#define STATS_MAX_ERRNO 160
+#define STATS_TEXT 1
+#define STATS_JSON 2
+
+typedef enum {
+    PHASE_TRAVERSE,
+    PHASE_SORT,
+    PHASE_OUTPUT,
+    PHASE_COUNT
+} stats_phase_t;
+
+typedef struct {
+    uint64_t dirs_opened;
+    uint64_t entries_read;
+    uint64_t stat_calls;
+    uint64_t stat_avoided;
+    uint64_t entries_ignored;
+    uint64_t mounts_skipped;
+    uint64_t heap_inserts;
+    uint64_t heap_replacements;
+    uint64_t heap_rejections;
+    uint64_t path_bytes;
+    uint64_t errors;
+    uint64_t errors_by_errno[STATS_MAX_ERRNO];
+    uint64_t readdir_ns;
+    uint64_t stat_ns;
+    uint64_t heap_ns;
+    uint64_t phase_wall_ns[PHASE_COUNT];
+    uint64_t phase_cpu_ns[PHASE_COUNT];
+} scan_stats_t;
+
+extern int g_stats_enabled;
+extern scan_stats_t g_scan_stats;
+
+#define STATS_INC(field) do { if (g_stats_enabled) g_scan_stats.field++; } while (0)
+#define STATS_ADD(field, n) do { if (g_stats_enabled) g_scan_stats.field += (n); } while (0)
+
+// Composite --sort KEY,KEY... ordering
+#define SORT_MAX_KEYS 8
+
 typedef struct {
     char path[MAX_PATH_LEN];
     struct stat st;
-    time_t sort_time;
-    off_t sort_size;
+    int64_t sort_key;  // extracted key, or the score of a key list using it; unused for SORT_NAME
+    int64_t sort_vals[SORT_MAX_KEYS];  // each integer key of a key list, in list order; unused for SORT_NAME
 } file_entry_t;
 
+// One sort key: every key but SORT_NAME is extracted once into
+// file_entry_t.sort_key, or sort_vals in a key list, and compared as a
+// plain integer. SORT_SCORE has no extractor of its own; it runs the
+// --score program in options_t.
+typedef struct {
+    const char *name;
+    int64_t (*extract)(const char *path, const struct stat *st);
+    int is_time;  // a timestamp usable by --newer/--older
+} sort_key_t;
+
+extern const sort_key_t sort_keys[SORT_KEY_COUNT];
+
 typedef struct {
     file_entry_t *entries;
     size_t count;
     size_t capacity;
 } file_list_t;
 
-typedef struct {
+// Snapshot diff ranking (--diff-by) and join key (--join)
+#define DIFF_BY_GROWTH 0
+#define DIFF_BY_NEW 1
+#define DIFF_BY_MTIME 2
+#define DIFF_JOIN_PATH 0
+#define DIFF_JOIN_INODE 1
+
+// Snapshot writer fed by heap_offer() during --save-snapshot (opaque)
+typedef struct snapshot_writer snapshot_writer_t;
+
+// --group-by keys (options_t.group_by)
+#define GROUP_BY_NONE 0
+#define GROUP_BY_DIR 1
+#define GROUP_BY_EXT 2
+#define GROUP_BY_UID 3
+#define GROUP_BY_GID 4
+#define DEFAULT_MAX_GROUPS 4096
+
+// --total metrics (options_t.total)
+#define TOTAL_NONE 0
+#define TOTAL_SIZE 1
+#define TOTAL_BLOCKS 2
+#define TOTAL_COUNT 3
+
+// Several rankings filled by heap_offer() in one traversal (opaque)
+#define MAX_QUERIES 16
+typedef struct query_set query_set_t;
+
+// Distribution of every offered entry for --histogram/--quantiles (opaque)
+#define MAX_QUANTILES 16
+typedef struct sketch sketch_t;
+
+// Compiled --score expression (opaque)
+typedef struct score_program score_program_t;
+
+// Command run on the results by --exec/--exec-each (opaque)
+typedef struct exec_command exec_command_t;
+
+// Per-group heaps that heap_offer() routes candidates to (opaque)
+typedef struct group_map group_map_t;
+
+// Per-mount rules read from --mount-policy (opaque)
+typedef struct mount_policy mount_policy_t;
+
+// A giant directory being stat()ed by worker threads (opaque)
+typedef struct dir_split dir_split_t;
+
+typedef struct options {
     int recursive;
     int reverse;
     int dereference;
     int max_depth;
-    sort_type_t sort_type;
+    sort_type_t sort_type;       // the only key, or the first of sort_list
+    int sort_count;              // keys in sort_list; 0 for a single plain key
+    sort_type_t sort_list[SORT_MAX_KEYS];
+    unsigned char sort_asc[SORT_MAX_KEYS];
     filter_type_t filter_type;
     char format[MAX_FORMAT_LEN];
     int num_files;
     int verbose;
     int quiet;
+    int ignore_vcs;
+    unsigned predicates;
+    off_t min_size;
+    off_t max_size;
+    time_t newer_than;
+    time_t older_than;
+    uid_t uid;
+    gid_t gid;
+    unsigned type_mask;
+    char name_glob[MAX_FORMAT_LEN];
+    long deadline_ms;
+    long approx_dirs;
+    int stats;
+    const char *save_snapshot;
+    const char *from_snapshot;
+    snapshot_writer_t *snapshot_writer;
+    // Filters of the query while a --save-snapshot walk runs unfiltered
+    const struct options *snapshot_filter;
+    const char *diff_snapshot;
+    int diff_by;
+    int diff_join;
+    const char *files_from;
+    int files_from_delim;
+    int group_by;
+    int group_depth;
+    long max_groups;
+    int group_flat;
+    group_map_t *group_map;
+    int total;
+    query_set_t *queries;
+    int histogram;
+    int quantile_count;
+    double quantiles[MAX_QUANTILES];
+    sketch_t *sketch;
+    score_program_t *score;
+    off_t until_size;
+    long until_count;
+    exec_command_t *exec;
+    int exec_jobs;
+    int shard_index;   // --shard K/N: this is shard K (1..N) of shard_count
+    int shard_count;
+    int shard_depth;
+    int merge;
+    const char *connect;  // --connect: ask the findmaxd listening here
+    int batch;
+    int xdev;           // -x: stay on the filesystem of each root
+    int pseudo_fs;      // --pseudo-fs: enter proc, sysfs and the like
+    mount_policy_t *mount_policy;
+    int threads;        // --threads: stat() workers per giant directory, 0 = auto
 } options_t;
 
+// Sort key table (keys.c)
+int sort_key_by_name(const char *name, sort_type_t *sort_type);
+int parse_sort_list(const char *spec, options_t *opts);
+int sort_uses_score(const options_t *opts);
+void set_sort_key(file_entry_t *entry, const options_t *opts);
+int compare_sort_list(const file_entry_t *a, const file_entry_t *b, const options_t *opts);
+int64_t score_key(double score);
+double score_value(int64_t key);
+
+// Natural (ascending) order of two entries under the sort keys; inline
+// since it is the innermost operation of every heap, sort and single-best
+// scan. A key list goes through compare_sort_list().
+static inline int compare_sort_keys(const file_entry_t *a, const file_entry_t *b, const options_t *opts) {
+    if (opts->sort_count > 0) {
+        return compare_sort_list(a, b, opts);
+    }
+    if (opts->sort_type == SORT_NAME) {
+        const char *name_a = strrchr(a->path, '/');
+        const char *name_b = strrchr(b->path, '/');
+        name_a = name_a ? name_a + 1 : a->path;
+        name_b = name_b ? name_b + 1 : b->path;
+        return strcoll(name_a, name_b);
+    }
+    return (a->sort_key > b->sort_key) - (a->sort_key < b->sort_key);
+}
+
 // Function prototypes
 void print_usage(void);
 void print_version(void);
+// parse_arguments() result when --help or --version was answered and
+// there is nothing left to run
+#define PARSE_DONE (-1)
 int parse_arguments(int argc, char *argv[], options_t *opts, char ***paths, int *path_count);
+void free_options(options_t *opts);
 int traverse_directory(const char *path, const options_t *opts, file_list_t *files);
 int traverse_directory_depth(const char *path, const options_t *opts, file_list_t *files, int current_depth);
 int compare_files(const void *a, const void *b, const options_t *opts);
 void sort_files(file_list_t *files, const options_t *opts);
 void print_file_entry(const file_entry_t *entry, const options_t *opts);
 void format_output(const file_entry_t *entry, const char *format, char *output, size_t output_size);
+void get_username(uid_t uid, char *buf, size_t size);
+void get_groupname(gid_t gid, char *buf, size_t size);
 file_list_t *create_file_list(void);
 void free_file_list(file_list_t *files);
 int add_file_entry(file_list_t *files, const char *path, const struct stat *st, const options_t *opts);
 int should_include_file(const struct stat *st, const options_t *opts);
+int should_include_name(const char *path, const options_t *opts);
+int should_skip_entry(const struct dirent *entry, const options_t *opts);
+unsigned file_type_bit(mode_t mode);
+int parse_type_list(const char *arg, unsigned *mask);
+int parse_duration(const char *arg, long *ms);
 int compare_file_entries(const file_entry_t *a, const file_entry_t *b, const options_t *opts);
 int traverse_directory_single(const char *path, const options_t *opts, file_entry_t *best, int current_depth);
 
@@ -82,8 +299,134 @@ int traverse_directory_single(const char *path, const options_t *opts, file_entr
 typedef struct min_heap min_heap_t;
 min_heap_t *create_min_heap(size_t capacity, const options_t *opts);
 void free_min_heap(min_heap_t *heap);
+void heap_reuse_arrays(int enable);
 size_t get_heap_size(min_heap_t *heap);
 file_entry_t *get_heap_entries(min_heap_t *heap);
+int heap_insert(min_heap_t *heap, const file_entry_t *entry);
+int heap_offer(min_heap_t *heap, const char *path, const struct stat *st, const options_t *opts);
 int traverse_directory_optimized(const char *path, const options_t *opts, min_heap_t *heap, int current_depth);
+int traverse_breadth_first(char **paths, int path_count, const options_t *opts, min_heap_t *heap, size_t *unvisited);
+int traverse_files_from(const char *file, int delim, const options_t *opts, min_heap_t *heap);
+
+// Instrumented system call wrappers and reporting (stats.c)
+uint64_t stats_now_ns(void);
+long monotonic_ms(void);
+void stats_phase_begin(stats_phase_t phase);
+void stats_phase_end(stats_phase_t phase);
+int stat_path(const char *path, struct stat *st, const options_t *opts);
+int stat_path_at(int dirfd, const char *name, struct stat *st, const options_t *opts);
+DIR *open_directory(const char *path);
+struct dirent *read_directory(DIR *dir);
+void print_scan_stats(int format);
+
+// Sampling-based approximate traversal (approx.c)
+typedef struct {
+    size_t dirs_sampled;
+    size_t dirs_unvisited;
+    size_t entries_examined;
+    double entries_unread;
+} approx_report_t;
+int traverse_approximate(char **paths, int path_count, const options_t *opts, min_heap_t *heap, approx_report_t *report);
+double approx_confidence(const approx_report_t *report);
+
+// Columnar, front-coded metadata snapshots (snapshot.c)
+typedef struct snapshot snapshot_t;
+snapshot_writer_t *snapshot_create(const char *file);
+int snapshot_append(snapshot_writer_t *writer, const char *path, const struct stat *st);
+int snapshot_finish(snapshot_writer_t *writer);
+snapshot_t *snapshot_open(const char *file);
+void snapshot_close(snapshot_t *snap);
+size_t snapshot_count(const snapshot_t *snap);
+void snapshot_rewind(snapshot_t *snap);
+int snapshot_next(snapshot_t *snap, const char **path, struct stat *st);
+int snapshot_query(snapshot_t *snap, const options_t *opts, min_heap_t *heap);
+int snapshot_query_roots(snapshot_t *snap, char **roots, int root_count, const options_t *opts, min_heap_t *heap);
+int snapshot_set_reader(snapshot_t *snap, uid_t uid, gid_t gid);
+
+// Change ranking between two snapshots (diff.c)
+int snapshot_diff(snapshot_t *old_snap, snapshot_t *new_snap, const options_t *opts, min_heap_t *heap);
+void print_diff_results(min_heap_t *heap, const options_t *opts);
+int diff_main(char **paths, int path_count, options_t *opts);
+
+// Per-group top-N for --group-by (group.c)
+group_map_t *group_map_create(char **roots, int root_count, const options_t *opts);
+void group_map_free(group_map_t *map);
+min_heap_t *group_heap_for(group_map_t *map, const char *path, const struct stat *st);
+void group_map_print(group_map_t *map, const options_t *opts);
+
+// Several queries answered by one traversal (query.c)
+query_set_t *query_set_create(const char **specs, int count, const options_t *opts);
+void query_set_free(query_set_t *set);
+int query_set_count(const query_set_t *set);
+min_heap_t *query_set_heap(const query_set_t *set, int index);
+int query_set_offer(query_set_t *set, file_entry_t *entry);
+void query_set_print(query_set_t *set);
+
+// Constant-memory distribution sketches (sketch.c)
+sketch_t *sketch_create(const options_t *opts);
+void sketch_free(sketch_t *sketch);
+void sketch_add(sketch_t *sketch, const file_entry_t *entry);
+uint64_t sketch_quantile(const sketch_t *sketch, double q);
+void sketch_print(const sketch_t *sketch, const options_t *opts);
+
+// Score expressions compiled to bytecode for --score (score.c)
+score_program_t *score_compile(const char *expr, time_t now);
+void score_free(score_program_t *program);
+int score_length(const score_program_t *program);
+double score_eval(const score_program_t *program, const char *path, const struct stat *st);
+
+// Sharded walks and merging their results (shard.c)
+#define DEFAULT_SHARD_DEPTH 1
+int parse_shard(const char *arg, options_t *opts);
+int shard_owns(const char *path, size_t root_len, const options_t *opts);
+void print_shard_records(const file_entry_t *entries, size_t count, const options_t *opts);
+int traverse_merge(char **files, int file_count, const options_t *opts, min_heap_t *heap);
+
+// Commands run on the results in batches (exec.c)
+int split_command_words(const char *spec, char **words, int max_words);
+exec_command_t *exec_parse(const char *spec, int each);
+void exec_free(exec_command_t *command);
+int exec_run(const exec_command_t *command, const file_entry_t *entries, size_t count, int jobs);
+
+// findmaxd query server and the --connect client (daemon.c), and
+// --batch (batch.c); both run findmax_main() once per query
+int findmax_main(int argc, char *argv[], snapshot_t *index);
+int batch_main(char **args, int arg_count);
+int batch_active(void);
+int daemon_main(int argc, char *argv[]);
+int daemon_query(const char *socket_path, char **args, int arg_count, char **paths, int path_count);
+
+// Cumulative directory totals for --total (total.c)
+int traverse_totals(char **paths, int path_count, const options_t *opts, min_heap_t *heap);
+
+// Filesystem boundaries and per-mount rules (mounts.c)
+mount_policy_t *mount_policy_load(const char *file);
+void mount_policy_free(mount_policy_t *policy);
+int mount_path_skipped(const char *path, const options_t *opts);
+int mount_may_enter(const char *path, const struct stat *st, dev_t parent_dev, int depth, const options_t *opts);
+int mount_thread_limit(dev_t dev, const options_t *opts);
+
+// Giant directories split between stat() workers (bigdir.c). Each worker
+// ranks into a sink of its own from create(); merge() folds one into the
+// walk's result and frees it, on the walking thread.
+#define SPLIT_START_ENTRIES 1024
+#define SPLIT_MAX_WORKERS 64
+typedef struct {
+    void *(*create)(void *context);
+    void (*offer)(void *sink, const file_entry_t *entry, const options_t *opts);
+    void (*merge)(void *context, void *sink, const options_t *opts);
+    void *context;
+} dir_split_sink_t;
+dir_split_t *dir_split_begin(DIR *dir, const struct stat *st, int child_depth, const dir_split_sink_t *sink, const options_t *opts);
+int dir_split_add(dir_split_t *split, const struct dirent *entry, const char *path, size_t path_len);
+void dir_split_finish(dir_split_t *split);
+
+// .gitignore/.ignore rules, inherited per directory level (opaque, refcounted)
+typedef struct ignore_rules ignore_rules_t;
+ignore_rules_t *ignore_rules_enter(ignore_rules_t *parent, const char *dir_path);
+ignore_rules_t *ignore_rules_retain(ignore_rules_t *rules);
+void ignore_rules_release(ignore_rules_t *rules);
+int ignore_rules_match(const ignore_rules_t *rules, const char *path, const char *name, int is_dir);
+int ignore_should_prune(const ignore_rules_t *rules, const char *path, const struct dirent *entry, const options_t *opts);
 
 #endif
@@ -59,24 +59,49 @@ static void format_time_human(time_t t, char *buf, size_t size) {
     }
 }
 
-static void get_username(uid_t uid, char *buf, size_t size) {
-    struct passwd *pw = getpwuid(uid);
-    if (pw) {
-        strncpy(buf, pw->pw_name, size - 1);
-        buf[size - 1] = '\0';
-    } else {
-        snprintf(buf, size, "%u", uid);
+// Owner and group names by id, remembered for the life of the process:
+// every lookup otherwise goes through NSS, which for plain files reads
+// and parses /etc/passwd or /etc/group again. A --batch run keeps the
+// names from one query to the next.
+#define NAME_CACHE_SLOTS 64
+
+typedef struct {
+    unsigned long id;
+    int valid;
+    char name[64];
+} name_cache_t;
+
+static name_cache_t user_cache[NAME_CACHE_SLOTS];
+static name_cache_t group_cache[NAME_CACHE_SLOTS];
+
+void get_username(uid_t uid, char *buf, size_t size) {
+    name_cache_t *slot = &user_cache[uid % NAME_CACHE_SLOTS];
+    if (!slot->valid || slot->id != (unsigned long)uid) {
+        struct passwd *pw = getpwuid(uid);
+        if (pw) {
+            snprintf(slot->name, sizeof(slot->name), "%s", pw->pw_name);
+        } else {
+            snprintf(slot->name, sizeof(slot->name), "%u", uid);
+        }
+        slot->id = (unsigned long)uid;
+        slot->valid = 1;
     }
+    snprintf(buf, size, "%s", slot->name);
 }
 
-static void get_groupname(gid_t gid, char *buf, size_t size) {
-    struct group *gr = getgrgid(gid);
-    if (gr) {
-        strncpy(buf, gr->gr_name, size - 1);
-        buf[size - 1] = '\0';
-    } else {
-        snprintf(buf, size, "%u", gid);
+void get_groupname(gid_t gid, char *buf, size_t size) {
+    name_cache_t *slot = &group_cache[gid % NAME_CACHE_SLOTS];
+    if (!slot->valid || slot->id != (unsigned long)gid) {
+        struct group *gr = getgrgid(gid);
+        if (gr) {
+            snprintf(slot->name, sizeof(slot->name), "%s", gr->gr_name);
+        } else {
+            snprintf(slot->name, sizeof(slot->name), "%u", gid);
+        }
+        slot->id = (unsigned long)gid;
+        slot->valid = 1;
     }
+    snprintf(buf, size, "%s", slot->name);
 }
 
 void format_output(const file_entry_t *entry, const char *format, char *output, size_t output_size) {
@@ -0,0 +1,268 @@
+#include "findmax.h"
+
+// Per-group top-N for --group-by.
+//
+// Every candidate is routed by heap_offer() to the bounded heap of its
+// group, found in an open-addressing hash map keyed by the group string,
+// so all groups fill during the one traversal. The number of groups is
+// capped by --max-groups; candidates of groups beyond the cap are counted
+// and dropped rather than growing memory without bound. Owner groups are
+// keyed on the numeric id and named only when printed, so --group-by
+// uid|gid costs no NSS lookup per candidate.
+
+typedef struct {
+    char *key;
+    uint64_t hash;
+    min_heap_t *heap;
+    char *name;   // owner name of a uid/gid key, resolved for printing
+} group_t;
+
+struct group_map {
+    group_t *groups;
+    size_t count;
+    size_t capacity;
+    size_t dropped;
+    char **roots;
+    int root_count;
+    const options_t *opts;
+};
+
+static uint64_t hash_key(const char *key) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        h = (h ^ *p) * 0x100000001B3ULL;
+    }
+    return h;
+}
+
+group_map_t *group_map_create(char **roots, int root_count, const options_t *opts) {
+    group_map_t *map = calloc(1, sizeof(group_map_t));
+    if (!map) return NULL;
+    map->capacity = 64;
+    map->groups = calloc(map->capacity, sizeof(group_t));
+    if (!map->groups) {
+        free(map);
+        return NULL;
+    }
+    map->roots = roots;
+    map->root_count = root_count;
+    map->opts = opts;
+    return map;
+}
+
+void group_map_free(group_map_t *map) {
+    if (!map) return;
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->groups[i].key) {
+            free(map->groups[i].key);
+            free(map->groups[i].name);
+            free_min_heap(map->groups[i].heap);
+        }
+    }
+    free(map->groups);
+    free(map);
+}
+
+// Length of the root argument path came from, so dir:DEPTH counts
+// components below it; 0 when the path did not come from a root
+static size_t root_prefix(const group_map_t *map, const char *path) {
+    size_t best = 0;
+    for (int i = 0; i < map->root_count; i++) {
+        size_t len = strlen(map->roots[i]);
+        while (len > 1 && map->roots[i][len - 1] == '/') len--;
+        if (len > best && strncmp(path, map->roots[i], len) == 0 &&
+            (path[len] == '/' || path[len] == '\0')) {
+            best = len;
+        }
+    }
+    return best;
+}
+
+// Build the group key of an entry into key. Directories group under their
+// own path for dir keys, files under their parent directory.
+static void group_key(const group_map_t *map, const char *path, const struct stat *st, char *key, size_t key_size) {
+    const options_t *opts = map->opts;
+    switch (opts->group_by) {
+        case GROUP_BY_EXT:
+            {
+                const char *name = strrchr(path, '/');
+                name = name ? name + 1 : path;
+                const char *dot = strrchr(name, '.');
+                snprintf(key, key_size, "%s", (dot && dot != name && !S_ISDIR(st->st_mode)) ? dot + 1 : "");
+            }
+            break;
+        case GROUP_BY_UID:
+            snprintf(key, key_size, "%lu", (unsigned long)st->st_uid);
+            break;
+        case GROUP_BY_GID:
+            snprintf(key, key_size, "%lu", (unsigned long)st->st_gid);
+            break;
+        case GROUP_BY_DIR:
+        default:
+            {
+                size_t len = strlen(path);
+                if (!S_ISDIR(st->st_mode)) {
+                    const char *slash = strrchr(path, '/');
+                    len = slash ? (size_t)(slash - path) : 0;
+                }
+                if (opts->group_depth > 0) {
+                    // Keep the root plus group_depth more components
+                    size_t end = root_prefix(map, path);
+                    for (int level = 0; level < opts->group_depth && end < len; level++) {
+                        end++;
+                        while (end < len && path[end] != '/') end++;
+                    }
+                    if (end < len) len = end;
+                }
+                if (len == 0) {
+                    snprintf(key, key_size, "%s", path[0] == '/' ? "/" : ".");
+                } else {
+                    snprintf(key, key_size, "%.*s", (int)len, path);
+                }
+            }
+            break;
+    }
+}
+
+static int group_map_grow(group_map_t *map) {
+    size_t new_capacity = map->capacity * 2;
+    group_t *groups = calloc(new_capacity, sizeof(group_t));
+    if (!groups) return -1;
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (!map->groups[i].key) continue;
+        size_t j = (size_t)map->groups[i].hash & (new_capacity - 1);
+        while (groups[j].key) j = (j + 1) & (new_capacity - 1);
+        groups[j] = map->groups[i];
+    }
+    free(map->groups);
+    map->groups = groups;
+    map->capacity = new_capacity;
+    return 0;
+}
+
+// Heap for the entry's group, created on first use; NULL once the group
+// cap is reached or memory runs out
+min_heap_t *group_heap_for(group_map_t *map, const char *path, const struct stat *st) {
+    char key[MAX_PATH_LEN];
+    group_key(map, path, st, key, sizeof(key));
+    uint64_t hash = hash_key(key);
+    
+    size_t i = (size_t)hash & (map->capacity - 1);
+    while (map->groups[i].key) {
+        if (map->groups[i].hash == hash && strcmp(map->groups[i].key, key) == 0) {
+            return map->groups[i].heap;
+        }
+        i = (i + 1) & (map->capacity - 1);
+    }
+    
+    if (map->count >= (size_t)map->opts->max_groups) {
+        map->dropped++;
+        return NULL;
+    }
+    if ((map->count + 1) * 2 > map->capacity) {
+        if (group_map_grow(map) != 0) {
+            map->dropped++;
+            return NULL;
+        }
+        i = (size_t)hash & (map->capacity - 1);
+        while (map->groups[i].key) i = (i + 1) & (map->capacity - 1);
+    }
+    
+    min_heap_t *heap = create_min_heap(map->opts->num_files, map->opts);
+    char *copy = strdup(key);
+    if (!heap || !copy) {
+        free_min_heap(heap);
+        free(copy);
+        map->dropped++;
+        return NULL;
+    }
+    map->groups[i].key = copy;
+    map->groups[i].hash = hash;
+    map->groups[i].heap = heap;
+    map->count++;
+    return heap;
+}
+
+// Printed label of a group
+static const char *group_label(const group_t *group) {
+    if (group->name) return group->name;
+    return group->key[0] ? group->key : "(none)";
+}
+
+static int compare_group_keys(const void *a, const void *b) {
+    return strcoll(group_label(*(const group_t *const *)a), group_label(*(const group_t *const *)b));
+}
+
+// Resolve the owner name of a uid/gid group, once per group
+static void group_name(group_t *group, const options_t *opts) {
+    if (group->name || (opts->group_by != GROUP_BY_UID && opts->group_by != GROUP_BY_GID)) {
+        return;
+    }
+    char name[64];
+    unsigned long id = strtoul(group->key, NULL, 10);
+    if (opts->group_by == GROUP_BY_UID) {
+        get_username((uid_t)id, name, sizeof(name));
+    } else {
+        get_groupname((gid_t)id, name, sizeof(name));
+    }
+    group->name = strdup(name);
+}
+
+// Sorted copy of one group's heap, in output order
+static file_list_t *group_results(const group_t *group, const options_t *opts) {
+    file_list_t *results = create_file_list();
+    if (!results) return NULL;
+    file_entry_t *entries = get_heap_entries(group->heap);
+    size_t size = get_heap_size(group->heap);
+    for (size_t i = 0; i < size; i++) {
+        if (add_file_entry(results, entries[i].path, &entries[i].st, opts) != 0) break;
+    }
+    sort_files(results, opts);
+    return results;
+}
+
+// Print groups in key order: a "KEY:" header over each group's entries
+// (as ls -R does), or with --flat one "KEY<TAB>entry" line per result
+void group_map_print(group_map_t *map, const options_t *opts) {
+    group_t **sorted = malloc(sizeof(group_t *) * (map->count ? map->count : 1));
+    if (!sorted) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
+        return;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->groups[i].key) {
+            group_name(&map->groups[i], opts);
+            sorted[n++] = &map->groups[i];
+        }
+    }
+    qsort(sorted, n, sizeof(group_t *), compare_group_keys);
+    
+    for (size_t g = 0; g < n; g++) {
+        file_list_t *results = group_results(sorted[g], opts);
+        if (!results) {
+            fprintf(stderr, "findmax: memory allocation failed\n");
+            break;
+        }
+        const char *label = group_label(sorted[g]);
+        if (!opts->group_flat) {
+            printf("%s%s:\n", g ? "\n" : "", label);
+        }
+        for (size_t i = 0; i < results->count; i++) {
+            if (opts->group_flat) {
+                char formatted_output[4096];
+                format_output(&results->entries[i], opts->format, formatted_output, sizeof(formatted_output));
+                printf("%s\t%s\n", label, formatted_output);
+            } else {
+                print_file_entry(&results->entries[i], opts);
+            }
+        }
+        free_file_list(results);
+    }
+    free(sorted);
+    
+    if (map->dropped && !opts->quiet) {
+        fprintf(stderr, "findmax: group limit of %ld reached, %zu entries in further groups ignored\n",
+                opts->max_groups, map->dropped);
+    }
+}
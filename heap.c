@@ -5,43 +5,36 @@ struct min_heap {
     file_entry_t *entries;
     size_t size;
     size_t capacity;
+    size_t allocated;     // length of entries, at least capacity
     const options_t *opts;
+    uint64_t total_size;  // sum of st_size kept, for --until-size
 };
 
-static int heap_compare(const file_entry_t *a, const file_entry_t *b, const options_t *opts) {
-    int result = 0;
-    
-    switch (opts->sort_type) {
-        case SORT_ATIME:
-        case SORT_CTIME:
-        case SORT_MTIME:
-        case SORT_BTIME:
-            if (a->sort_time < b->sort_time) result = -1;
-            else if (a->sort_time > b->sort_time) result = 1;
-            else result = 0;
-            break;
-        case SORT_SIZE:
-            if (a->sort_size < b->sort_size) result = -1;
-            else if (a->sort_size > b->sort_size) result = 1;
-            else result = 0;
-            break;
-        case SORT_NAME:
-            {
-                const char *name_a = strrchr(a->path, '/');
-                const char *name_b = strrchr(b->path, '/');
-                name_a = name_a ? name_a + 1 : a->path;
-                name_b = name_b ? name_b + 1 : b->path;
-                result = strcoll(name_a, name_b);
-            }
-            break;
+// The entry array of a freed heap, kept for the next heap that fits in
+// it while heap_reuse_arrays() is on. A --batch run creates and frees
+// heaps for every query, and for a large N the array is big enough that
+// malloc() would map and unmap (and the kernel zero) it each time.
+static int reuse_arrays;
+static file_entry_t *spare_entries;
+static size_t spare_allocated;
+
+// Keep freed entry arrays for later heaps; turning it off frees the spare
+void heap_reuse_arrays(int enable) {
+    reuse_arrays = enable;
+    if (!enable) {
+        free(spare_entries);
+        spare_entries = NULL;
+        spare_allocated = 0;
     }
-    
-    // For heap ordering: when reverse=1 (max first), we want to keep the N largest values
-    // The heap root should be the smallest of those N values
-    // So if a > b, a should be below b in the heap (return positive)
-    // This means we DON'T flip for heap operations - we use natural comparison
-    // The reverse flag only affects final output sorting, not heap maintenance
-    return result;
+}
+
+// Heap order: the root is the worst entry kept, the one the next better
+// candidate replaces. Keeping the N largest (reverse=1, max first) needs
+// the smallest at the root, the natural order; keeping the N smallest
+// (-r) needs the largest at the root, so the order is flipped.
+static int heap_compare(const file_entry_t *a, const file_entry_t *b, const options_t *opts) {
+    int result = compare_sort_keys(a, b, opts);
+    return opts->reverse ? result : -result;
 }
 
 static void heap_swap(file_entry_t *a, file_entry_t *b) {
@@ -90,7 +83,14 @@ min_heap_t *create_min_heap(size_t capacity, const options_t *opts) {
     min_heap_t *heap = malloc(sizeof(min_heap_t));
     if (!heap) return NULL;
     
-    heap->entries = malloc(sizeof(file_entry_t) * capacity);
+    if (spare_entries && spare_allocated >= capacity) {
+        heap->entries = spare_entries;
+        heap->allocated = spare_allocated;
+        spare_entries = NULL;
+    } else {
+        heap->entries = malloc(sizeof(file_entry_t) * capacity);
+        heap->allocated = capacity;
+    }
     if (!heap->entries) {
         free(heap);
         return NULL;
@@ -99,12 +99,20 @@ min_heap_t *create_min_heap(size_t capacity, const options_t *opts) {
     heap->size = 0;
     heap->capacity = capacity;
     heap->opts = opts;
+    heap->total_size = 0;
     return heap;
 }
 
 void free_min_heap(min_heap_t *heap) {
     if (heap) {
-        free(heap->entries);
+        // Keep the larger of this array and the spare
+        if (reuse_arrays && (!spare_entries || heap->allocated > spare_allocated)) {
+            free(spare_entries);
+            spare_entries = heap->entries;
+            spare_allocated = heap->allocated;
+        } else {
+            free(heap->entries);
+        }
         free(heap);
     }
 }
@@ -117,38 +125,151 @@ file_entry_t *get_heap_entries(min_heap_t *heap) {
     return heap ? heap->entries : NULL;
 }
 
-static int heap_insert(min_heap_t *heap, const file_entry_t *entry) {
+// Whether size bytes in count entries satisfy --until-size/--until-count;
+// with both, whichever is reached first
+static int budget_met(const options_t *opts, uint64_t size, size_t count) {
+    return (opts->until_size > 0 && size >= (uint64_t)opts->until_size) ||
+           (opts->until_count > 0 && count >= (size_t)opts->until_count);
+}
+
+// Budget selection: keep the best entries until their sizes (or number)
+// reach the budget. The heap grows while the kept set falls short; once
+// it is met, a better candidate is added and worst entries are evicted
+// from the root for as long as the rest still meets the budget, so the
+// heap holds the answer and never more than one entry beyond it.
+static int heap_insert_budget(min_heap_t *heap, const file_entry_t *entry) {
+    const options_t *opts = heap->opts;
+    if (heap->size > 0 && budget_met(opts, heap->total_size, heap->size) &&
+        heap_compare(entry, &heap->entries[0], opts) <= 0) {
+        STATS_INC(heap_rejections);
+        return 0;
+    }
+    
+    if (heap->size >= heap->capacity) {
+        size_t new_capacity = heap->capacity ? heap->capacity * 2 : 64;
+        file_entry_t *entries = realloc(heap->entries, sizeof(file_entry_t) * new_capacity);
+        if (!entries) {
+            STATS_INC(heap_rejections);
+            return 0;
+        }
+        heap->entries = entries;
+        heap->capacity = new_capacity;
+        heap->allocated = new_capacity;
+    }
+    heap->entries[heap->size] = *entry;
+    heap_sift_up(heap, heap->size);
+    heap->size++;
+    heap->total_size += entry->st.st_size > 0 ? (uint64_t)entry->st.st_size : 0;
+    STATS_INC(heap_inserts);
+    
+    while (heap->size > 1) {
+        off_t root_size = heap->entries[0].st.st_size > 0 ? heap->entries[0].st.st_size : 0;
+        if (!budget_met(opts, heap->total_size - (uint64_t)root_size, heap->size - 1)) break;
+        heap->total_size -= (uint64_t)root_size;
+        heap->entries[0] = heap->entries[--heap->size];
+        heap_sift_down(heap, 0);
+        STATS_INC(heap_replacements);
+    }
+    return 1;
+}
+
+// Returns 1 if the entry was kept, 0 if it was rejected
+int heap_insert(min_heap_t *heap, const file_entry_t *entry) {
+    if (heap->opts->until_size > 0 || heap->opts->until_count > 0) {
+        return heap_insert_budget(heap, entry);
+    }
     if (heap->size < heap->capacity) {
         // Heap not full, just insert
         heap->entries[heap->size] = *entry;
         heap_sift_up(heap, heap->size);
         heap->size++;
-        return 0;
+        STATS_INC(heap_inserts);
+        return 1;
     } else {
-        // Heap is full, check if new entry should replace the minimum
-        // When reverse=1 (max first), we keep N largest values, root is smallest of them
-        // When reverse=0 (min first), we keep N smallest values, root is largest of them
-        // So we compare: if new entry is "better" than root, replace it
-        int cmp = heap_compare(entry, &heap->entries[0], heap->opts);
-        if (heap->opts->reverse) {
-            // Max first: replace root if new entry is larger (positive comparison)
-            if (cmp > 0) {
-                heap->entries[0] = *entry;
-                heap_sift_down(heap, 0);
-            }
-        } else {
-            // Min first: replace root if new entry is smaller (negative comparison)
-            if (cmp < 0) {
-                heap->entries[0] = *entry;
-                heap_sift_down(heap, 0);
-            }
+        // Heap is full: replace the root if the new entry is better than
+        // the worst one kept, which in heap order means it compares greater
+        if (heap_compare(entry, &heap->entries[0], heap->opts) > 0) {
+            heap->entries[0] = *entry;
+            heap_sift_down(heap, 0);
+            STATS_INC(heap_replacements);
+            return 1;
         }
+        STATS_INC(heap_rejections);
         return 0;
     }
 }
 
+// Build a candidate entry and offer it to the heap; returns 1 if it was kept
+int heap_offer(min_heap_t *heap, const char *path, const struct stat *st, const options_t *opts) {
+    // The snapshot keeps every entry; only those passing the query's own
+    // filters go on to be ranked
+    if (opts->snapshot_writer) {
+        snapshot_append(opts->snapshot_writer, path, st);
+        if (opts->snapshot_filter && !(should_include_name(path, opts->snapshot_filter) &&
+                                       should_include_file(st, opts->snapshot_filter))) {
+            return 0;
+        }
+    }
+    
+    uint64_t start = g_stats_enabled ? stats_now_ns() : 0;
+    file_entry_t entry;
+    STATS_ADD(path_bytes, strlen(path));
+    strncpy(entry.path, path, MAX_PATH_LEN - 1);
+    entry.path[MAX_PATH_LEN - 1] = '\0';
+    entry.st = *st;
+    
+    int kept;
+    if (opts->queries) {
+        if (opts->sketch) {
+            set_sort_key(&entry, opts);
+            sketch_add(opts->sketch, &entry);
+        }
+        // --query: every query ranks the entry by its own keys
+        kept = query_set_offer(opts->queries, &entry);
+    } else {
+        set_sort_key(&entry, opts);
+        if (opts->sketch) {
+            sketch_add(opts->sketch, &entry);
+        }
+        // --group-by keeps a separate top-N per group instead of one overall
+        if (opts->group_map) {
+            heap = group_heap_for(opts->group_map, path, st);
+        }
+        kept = heap ? heap_insert(heap, &entry) : 0;
+    }
+    STATS_ADD(heap_ns, stats_now_ns() - start);
+    return kept;
+}
+
+static int traverse_optimized_rules(const char *path, size_t root_len, const options_t *opts, min_heap_t *heap, int current_depth, ignore_rules_t *rules, dev_t parent_dev);
+
+// Workers of a split giant directory rank into heaps as large as the
+// walk's, merged into it when the directory is done
+static void *split_heap_create(void *context) {
+    const min_heap_t *heap = context;
+    return create_min_heap(heap->capacity, heap->opts);
+}
+
+static void split_heap_offer(void *sink, const file_entry_t *entry, const options_t *opts) {
+    (void)opts;
+    heap_insert(sink, entry);
+}
+
+static void split_heap_merge(void *context, void *sink, const options_t *opts) {
+    (void)opts;
+    min_heap_t *worker_heap = sink;
+    for (size_t i = 0; i < worker_heap->size; i++) {
+        heap_insert(context, &worker_heap->entries[i]);
+    }
+    free_min_heap(worker_heap);
+}
+
 // Optimized file traversal using heap for O(1) performance
 int traverse_directory_optimized(const char *path, const options_t *opts, min_heap_t *heap, int current_depth) {
+    return traverse_optimized_rules(path, strlen(path), opts, heap, current_depth, NULL, 0);
+}
+
+static int traverse_optimized_rules(const char *path, size_t root_len, const options_t *opts, min_heap_t *heap, int current_depth, ignore_rules_t *rules, dev_t parent_dev) {
     struct stat st;
     
     // Check depth limit
@@ -156,14 +277,24 @@ int traverse_directory_optimized(const char *path, const options_t *opts, min_he
         return 0;
     }
     
-    // Get file/directory stats
-    int stat_result;
-    if (opts->dereference) {
-        stat_result = stat(path, &st);
-    } else {
-        stat_result = lstat(path, &st);
+    // --shard: another process owns this entry, and at the shard depth
+    // its whole subtree, which is then skipped without a stat()
+    int owned = 1;
+    if (opts->shard_count > 0 && current_depth <= opts->shard_depth) {
+        owned = shard_owns(path, root_len, opts);
+        if (!owned && current_depth == opts->shard_depth) {
+            return 0;
+        }
     }
     
+    // A mount point the policy skips is not even stat()ed
+    if (opts->mount_policy && current_depth > 0 && mount_path_skipped(path, opts)) {
+        return 0;
+    }
+    
+    // Get file/directory stats
+    int stat_result = stat_path(path, &st, opts);
+    
     if (stat_result != 0) {
         if (!opts->quiet) {
             perror(path);
@@ -172,43 +303,13 @@ int traverse_directory_optimized(const char *path, const options_t *opts, min_he
     }
     
     // Add current file/directory if it matches filter
-    if (should_include_file(&st, opts)) {
-        file_entry_t entry;
-        strncpy(entry.path, path, MAX_PATH_LEN - 1);
-        entry.path[MAX_PATH_LEN - 1] = '\0';
-        entry.st = st;
-        
-        // Set sort criteria
-        switch (opts->sort_type) {
-            case SORT_ATIME:
-                entry.sort_time = st.st_atime;
-                break;
-            case SORT_CTIME:
-                entry.sort_time = st.st_ctime;
-                break;
-            case SORT_MTIME:
-                entry.sort_time = st.st_mtime;
-                break;
-            case SORT_BTIME:
-#ifdef __APPLE__
-                entry.sort_time = st.st_birthtime;
-#else
-                entry.sort_time = st.st_ctime;
-#endif
-                break;
-            case SORT_SIZE:
-                entry.sort_size = st.st_size;
-                break;
-            case SORT_NAME:
-                break;
-        }
-        
-        heap_insert(heap, &entry);
+    if (owned && should_include_name(path, opts) && should_include_file(&st, opts)) {
+        heap_offer(heap, path, &st, opts);
     }
     
-    // Recursive traversal for directories
-    if (S_ISDIR(st.st_mode) && opts->recursive) {
-        DIR *dir = opendir(path);
+    // Recursive traversal for directories on filesystems the walk enters
+    if (S_ISDIR(st.st_mode) && opts->recursive && mount_may_enter(path, &st, parent_dev, current_depth, opts)) {
+        DIR *dir = open_directory(path);
         if (!dir) {
             if (!opts->quiet) {
                 perror(path);
@@ -216,13 +317,30 @@ int traverse_directory_optimized(const char *path, const options_t *opts, min_he
             return -1;
         }
         
+        // Inherit ignore rules and add this level's .gitignore/.ignore
+        ignore_rules_t *dir_rules = opts->ignore_vcs ? ignore_rules_enter(rules, path) : NULL;
+        
+        dir_split_sink_t sink = { split_heap_create, split_heap_offer, split_heap_merge, heap };
+        dir_split_t *split = NULL;
+        size_t entries_seen = 0;
+        
         struct dirent *entry;
-        while ((entry = readdir(dir)) != NULL) {
+        while ((entry = read_directory(dir)) != NULL) {
             // Skip . and ..
             if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
                 continue;
             }
             
+            // A giant directory's files go to stat() workers from here on
+            if (++entries_seen == SPLIT_START_ENTRIES && heap) {
+                split = dir_split_begin(dir, &st, current_depth + 1, &sink, opts);
+            }
+            
+            // Cheap predicates on the name and d_type run before stat()
+            if ((opts->predicates || opts->filter_type != FILTER_ALL) && should_skip_entry(entry, opts)) {
+                continue;
+            }
+            
             char full_path[MAX_PATH_LEN];
             int ret = snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
             if (ret < 0 || (size_t)ret >= sizeof(full_path)) {
@@ -231,16 +349,193 @@ int traverse_directory_optimized(const char *path, const options_t *opts, min_he
                 }
                 continue;
             }
+            STATS_ADD(path_bytes, ret);
+            
+            if (opts->ignore_vcs && ignore_should_prune(dir_rules, full_path, entry, opts)) {
+                continue;
+            }
             
-            traverse_directory_optimized(full_path, opts, heap, current_depth + 1);
+            if (split && dir_split_add(split, entry, full_path, (size_t)ret) == 0) {
+                continue;
+            }
+            
+            traverse_optimized_rules(full_path, root_len, opts, heap, current_depth + 1, dir_rules, st.st_dev);
         }
         
+        dir_split_finish(split);
+        ignore_rules_release(dir_rules);
         closedir(dir);
     }
     
     return 0;
 }
 
+// Pending directory for the breadth-first walker
+typedef struct {
+    char *path;
+    int depth;
+    dev_t dev;
+    ignore_rules_t *rules;
+} dir_task_t;
+
+typedef struct {
+    dir_task_t *tasks;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+} dir_queue_t;
+
+static int dir_queue_push(dir_queue_t *queue, const char *path, int depth, dev_t dev, ignore_rules_t *rules) {
+    if (queue->tail >= queue->capacity) {
+        // Reclaim the consumed prefix before growing
+        if (queue->head > 0) {
+            memmove(queue->tasks, queue->tasks + queue->head, sizeof(dir_task_t) * (queue->tail - queue->head));
+            queue->tail -= queue->head;
+            queue->head = 0;
+        }
+        if (queue->tail >= queue->capacity) {
+            size_t new_capacity = queue->capacity ? queue->capacity * 2 : 64;
+            dir_task_t *new_tasks = realloc(queue->tasks, sizeof(dir_task_t) * new_capacity);
+            if (!new_tasks) return -1;
+            queue->tasks = new_tasks;
+            queue->capacity = new_capacity;
+        }
+    }
+    
+    char *copy = strdup(path);
+    if (!copy) return -1;
+    
+    dir_task_t *task = &queue->tasks[queue->tail++];
+    task->path = copy;
+    task->depth = depth;
+    task->dev = dev;
+    // The queued task keeps its inherited rules alive
+    task->rules = ignore_rules_retain(rules);
+    return 0;
+}
+
+// Stat one path, offer it to the heap and queue it if it is a directory
+// that still has to be read
+static void bfs_visit(const char *path, int depth, dev_t parent_dev, ignore_rules_t *rules, const options_t *opts, min_heap_t *heap, dir_queue_t *queue) {
+    struct stat st;
+    if (opts->mount_policy && depth > 0 && mount_path_skipped(path, opts)) {
+        return;
+    }
+    
+    int stat_result = stat_path(path, &st, opts);
+    
+    if (stat_result != 0) {
+        if (!opts->quiet) {
+            perror(path);
+        }
+        return;
+    }
+    
+    if (should_include_name(path, opts) && should_include_file(&st, opts)) {
+        heap_offer(heap, path, &st, opts);
+    }
+    
+    if (S_ISDIR(st.st_mode) && opts->recursive &&
+        (opts->max_depth < 0 || depth < opts->max_depth) &&
+        mount_may_enter(path, &st, parent_dev, depth, opts)) {
+        if (dir_queue_push(queue, path, depth, st.st_dev, rules) != 0 && !opts->quiet) {
+            fprintf(stderr, "findmax: memory allocation failed\n");
+        }
+    }
+}
+
+// Breadth-first traversal of all roots that stops when opts->deadline_ms
+// elapses. Visiting level by level keeps a partial answer spread evenly
+// across the whole tree instead of exhausting the first subtree.
+// Returns 1 if the deadline cut the walk short, 0 if it completed.
+int traverse_breadth_first(char **paths, int path_count, const options_t *opts, min_heap_t *heap, size_t *unvisited) {
+    dir_queue_t queue = {0};
+    long deadline = opts->deadline_ms > 0 ? monotonic_ms() + opts->deadline_ms : 0;
+    int expired = 0;
+    size_t interrupted = 0;
+    
+    for (int i = 0; i < path_count; i++) {
+        bfs_visit(paths[i], 0, 0, NULL, opts, heap, &queue);
+    }
+    
+    while (queue.head < queue.tail) {
+        if (deadline && monotonic_ms() >= deadline) {
+            expired = 1;
+            break;
+        }
+        
+        dir_task_t task = queue.tasks[queue.head++];
+        
+        DIR *dir = open_directory(task.path);
+        if (!dir) {
+            if (!opts->quiet) {
+                perror(task.path);
+            }
+            ignore_rules_release(task.rules);
+            free(task.path);
+            continue;
+        }
+        
+        ignore_rules_t *dir_rules = opts->ignore_vcs ? ignore_rules_enter(task.rules, task.path) : NULL;
+        
+        struct dirent *entry;
+        unsigned long count = 0;
+        while ((entry = read_directory(dir)) != NULL) {
+            // Huge directories check the clock every 256 entries
+            if (deadline && (++count & 0xff) == 0 && monotonic_ms() >= deadline) {
+                expired = 1;
+                break;
+            }
+            
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            
+            if ((opts->predicates || opts->filter_type != FILTER_ALL) && should_skip_entry(entry, opts)) {
+                continue;
+            }
+            
+            char full_path[MAX_PATH_LEN];
+            int ret = snprintf(full_path, sizeof(full_path), "%s/%s", task.path, entry->d_name);
+            if (ret < 0 || (size_t)ret >= sizeof(full_path)) {
+                if (!opts->quiet) {
+                    fprintf(stderr, "findmax: path too long: %s/%s\n", task.path, entry->d_name);
+                }
+                continue;
+            }
+            STATS_ADD(path_bytes, ret);
+            
+            if (opts->ignore_vcs && ignore_should_prune(dir_rules, full_path, entry, opts)) {
+                continue;
+            }
+            
+            bfs_visit(full_path, task.depth + 1, task.dev, dir_rules, opts, heap, &queue);
+        }
+        
+        ignore_rules_release(dir_rules);
+        ignore_rules_release(task.rules);
+        closedir(dir);
+        free(task.path);
+        
+        if (expired) {
+            // The directory being read when time ran out is incomplete too
+            interrupted = 1;
+            break;
+        }
+    }
+    
+    if (unvisited) {
+        *unvisited = queue.tail - queue.head + interrupted;
+    }
+    for (size_t i = queue.head; i < queue.tail; i++) {
+        ignore_rules_release(queue.tasks[i].rules);
+        free(queue.tasks[i].path);
+    }
+    free(queue.tasks);
+    return expired;
+}
+
+#ifdef USE_OPTIMIZED
 // Modified main function to use optimized heap-based approach
 int main_optimized(int argc, char *argv[]) {
     options_t opts = {0};
@@ -255,8 +550,9 @@ int main_optimized(int argc, char *argv[]) {
     
     setlocale(LC_ALL, "");
     
-    if (parse_arguments(argc, argv, &opts, &paths, &path_count) != 0) {
-        return 1;
+    int parsed = parse_arguments(argc, argv, &opts, &paths, &path_count);
+    if (parsed != 0) {
+        return parsed == PARSE_DONE ? 0 : 1;
     }
     
     if (path_count == 0) {
@@ -314,3 +610,4 @@ int main_optimized(int argc, char *argv[]) {
     
     return 0;
 }
+#endif
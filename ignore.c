@@ -0,0 +1,330 @@
+#include "findmax.h"
+
+// .gitignore / .ignore support for --ignore-vcs.
+//
+// Each directory that carries an ignore file gets one rules node holding
+// its compiled patterns and a pointer to the node inherited from its
+// parent. Directories without ignore files simply share the parent node,
+// so the per-directory cost is two failed open() calls.
+
+#define IGNORE_LITERAL   0x01  // no glob metacharacters, compare with strcmp
+#define IGNORE_SUFFIX    0x02  // "*literal", compare the tail only
+#define IGNORE_NEGATE    0x04  // "!pattern" re-includes
+#define IGNORE_DIR_ONLY  0x08  // "pattern/" matches directories only
+#define IGNORE_ANCHORED  0x10  // contains '/', matched against the relative path
+
+typedef struct {
+    char *pattern;
+    size_t length;
+    int flags;
+} ignore_pattern_t;
+
+struct ignore_rules {
+    ignore_rules_t *parent;
+    char *base;
+    size_t base_len;
+    ignore_pattern_t *patterns;
+    size_t count;
+    size_t capacity;
+    int refcount;
+};
+
+static const char *const ignore_file_names[] = { ".gitignore", ".ignore" };
+
+// Match a gitignore glob against a string. '*' and '?' never cross '/',
+// "**" matches any number of path components.
+static int glob_match(const char *p, const char *s) {
+    while (*p) {
+        switch (*p) {
+            case '*':
+                if (p[1] == '*') {
+                    // "**/" matches zero or more leading directories
+                    if (p[2] == '/') {
+                        if (glob_match(p + 3, s)) return 1;
+                        for (const char *t = s; *t; t++) {
+                            if (*t == '/' && glob_match(p + 3, t + 1)) return 1;
+                        }
+                        return 0;
+                    }
+                    // Trailing or embedded "**" matches everything
+                    p += 2;
+                    if (!*p) return 1;
+                    for (const char *t = s; ; t++) {
+                        if (glob_match(p, t)) return 1;
+                        if (!*t) return 0;
+                    }
+                }
+                p++;
+                for (const char *t = s; ; t++) {
+                    if (glob_match(p, t)) return 1;
+                    if (!*t || *t == '/') return 0;
+                }
+            case '?':
+                if (!*s || *s == '/') return 0;
+                p++;
+                s++;
+                break;
+            case '[':
+                {
+                    if (!*s || *s == '/') return 0;
+                    const char *q = p + 1;
+                    int negate = (*q == '!' || *q == '^');
+                    if (negate) q++;
+                    int matched = 0;
+                    int first = 1;
+                    while (*q && (first || *q != ']')) {
+                        first = 0;
+                        if (q[1] == '-' && q[2] && q[2] != ']') {
+                            if ((unsigned char)*s >= (unsigned char)q[0] &&
+                                (unsigned char)*s <= (unsigned char)q[2]) {
+                                matched = 1;
+                            }
+                            q += 3;
+                        } else {
+                            if (*q == *s) matched = 1;
+                            q++;
+                        }
+                    }
+                    if (*q != ']') {
+                        // Unterminated class, treat '[' literally
+                        if (*s != '[') return 0;
+                        p++;
+                        s++;
+                        break;
+                    }
+                    if (matched == negate) return 0;
+                    p = q + 1;
+                    s++;
+                }
+                break;
+            case '\\':
+                if (p[1]) p++;
+                // fall through
+            default:
+                if (*p != *s) return 0;
+                p++;
+                s++;
+                break;
+        }
+    }
+    return *s == '\0';
+}
+
+static int compile_pattern(ignore_rules_t *rules, char *line) {
+    size_t len = strlen(line);
+    
+    // Strip line ending and unescaped trailing spaces
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+        line[--len] = '\0';
+    }
+    while (len > 0 && line[len - 1] == ' ' && !(len > 1 && line[len - 2] == '\\')) {
+        line[--len] = '\0';
+    }
+    
+    if (len == 0 || line[0] == '#') {
+        return 0;
+    }
+    
+    int flags = 0;
+    char *p = line;
+    if (*p == '!') {
+        flags |= IGNORE_NEGATE;
+        p++;
+    } else if (*p == '\\' && (p[1] == '!' || p[1] == '#')) {
+        p++;
+    }
+    
+    len = strlen(p);
+    if (len > 0 && p[len - 1] == '/') {
+        flags |= IGNORE_DIR_ONLY;
+        p[--len] = '\0';
+    }
+    if (len == 0) {
+        return 0;
+    }
+    
+    if (strchr(p, '/')) {
+        flags |= IGNORE_ANCHORED;
+        while (*p == '/') p++;
+        len = strlen(p);
+        if (len == 0) return 0;
+    }
+    
+    // Recognize the common literal and "*.ext" shapes so matching them
+    // costs a single memcmp instead of a glob walk
+    if (!strpbrk(p, "*?[\\")) {
+        flags |= IGNORE_LITERAL;
+    } else if (p[0] == '*' && p[1] != '*' && !strpbrk(p + 1, "*?[\\/")) {
+        flags |= IGNORE_SUFFIX;
+        p++;
+        len--;
+    }
+    
+    if (rules->count >= rules->capacity) {
+        size_t new_capacity = rules->capacity ? rules->capacity * 2 : 8;
+        ignore_pattern_t *new_patterns = realloc(rules->patterns, sizeof(ignore_pattern_t) * new_capacity);
+        if (!new_patterns) return -1;
+        rules->patterns = new_patterns;
+        rules->capacity = new_capacity;
+    }
+    
+    char *copy = strdup(p);
+    if (!copy) return -1;
+    
+    ignore_pattern_t *pattern = &rules->patterns[rules->count++];
+    pattern->pattern = copy;
+    pattern->length = len;
+    pattern->flags = flags;
+    return 0;
+}
+
+static int load_ignore_file(ignore_rules_t *rules, const char *dir_path, const char *file_name) {
+    char path[MAX_PATH_LEN];
+    int ret = snprintf(path, sizeof(path), "%s/%s", dir_path, file_name);
+    if (ret < 0 || (size_t)ret >= sizeof(path)) {
+        return 0;
+    }
+    
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return 0;
+    }
+    
+    char line[MAX_PATH_LEN];
+    int loaded = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        size_t before = rules->count;
+        if (compile_pattern(rules, line) != 0) {
+            break;
+        }
+        loaded += (int)(rules->count - before);
+    }
+    
+    fclose(fp);
+    return loaded;
+}
+
+static void free_rules(ignore_rules_t *rules) {
+    for (size_t i = 0; i < rules->count; i++) {
+        free(rules->patterns[i].pattern);
+    }
+    free(rules->patterns);
+    free(rules->base);
+    free(rules);
+}
+
+ignore_rules_t *ignore_rules_enter(ignore_rules_t *parent, const char *dir_path) {
+    ignore_rules_t *rules = calloc(1, sizeof(ignore_rules_t));
+    if (!rules) {
+        goto inherit;
+    }
+    
+    int loaded = 0;
+    for (size_t i = 0; i < sizeof(ignore_file_names) / sizeof(ignore_file_names[0]); i++) {
+        loaded += load_ignore_file(rules, dir_path, ignore_file_names[i]);
+    }
+    
+    if (loaded == 0 || !(rules->base = strdup(dir_path))) {
+        free_rules(rules);
+        goto inherit;
+    }
+    
+    // Match paths relative to the directory, ignoring any trailing slashes
+    rules->base_len = strlen(rules->base);
+    while (rules->base_len > 1 && rules->base[rules->base_len - 1] == '/') {
+        rules->base_len--;
+    }
+    rules->parent = parent;
+    if (parent) parent->refcount++;
+    rules->refcount = 1;
+    return rules;
+
+inherit:
+    if (parent) parent->refcount++;
+    return parent;
+}
+
+ignore_rules_t *ignore_rules_retain(ignore_rules_t *rules) {
+    if (rules) rules->refcount++;
+    return rules;
+}
+
+void ignore_rules_release(ignore_rules_t *rules) {
+    while (rules && --rules->refcount == 0) {
+        ignore_rules_t *parent = rules->parent;
+        free_rules(rules);
+        rules = parent;
+    }
+}
+
+static int pattern_matches(const ignore_pattern_t *pattern, const char *rel, const char *name) {
+    if (pattern->flags & IGNORE_ANCHORED) {
+        if (pattern->flags & IGNORE_LITERAL) {
+            return strcmp(pattern->pattern, rel) == 0;
+        }
+        return glob_match(pattern->pattern, rel);
+    }
+    
+    if (pattern->flags & IGNORE_LITERAL) {
+        return strcmp(pattern->pattern, name) == 0;
+    }
+    if (pattern->flags & IGNORE_SUFFIX) {
+        size_t name_len = strlen(name);
+        return name_len >= pattern->length &&
+               memcmp(name + name_len - pattern->length, pattern->pattern, pattern->length) == 0;
+    }
+    return glob_match(pattern->pattern, name);
+}
+
+int ignore_rules_match(const ignore_rules_t *rules, const char *path, const char *name, int is_dir) {
+    // Deeper ignore files take precedence, and within a file the last
+    // matching pattern wins
+    for (; rules; rules = rules->parent) {
+        if (strncmp(path, rules->base, rules->base_len) != 0) {
+            continue;
+        }
+        const char *rel = path + rules->base_len;
+        while (*rel == '/') rel++;
+        
+        for (size_t i = rules->count; i-- > 0; ) {
+            const ignore_pattern_t *pattern = &rules->patterns[i];
+            if ((pattern->flags & IGNORE_DIR_ONLY) && !is_dir) {
+                continue;
+            }
+            if (pattern_matches(pattern, rel, name)) {
+                return !(pattern->flags & IGNORE_NEGATE);
+            }
+        }
+    }
+    return 0;
+}
+
+// Decide whether a readdir entry should be pruned before it is stat()ed.
+// The VCS metadata directory itself is always skipped in this mode.
+int ignore_should_prune(const ignore_rules_t *rules, const char *path, const struct dirent *entry, const options_t *opts) {
+    if (strcmp(entry->d_name, ".git") == 0) {
+        STATS_INC(entries_ignored);
+        return 1;
+    }
+    if (!rules) {
+        return 0;
+    }
+    
+    int is_dir;
+#ifdef _DIRENT_HAVE_D_TYPE
+    if (entry->d_type != DT_UNKNOWN && !(entry->d_type == DT_LNK && opts->dereference)) {
+        is_dir = (entry->d_type == DT_DIR);
+    } else
+#endif
+    {
+        struct stat st;
+        int stat_result = stat_path(path, &st, opts);
+        is_dir = (stat_result == 0 && S_ISDIR(st.st_mode));
+    }
+    
+    if (ignore_rules_match(rules, path, entry->d_name, is_dir)) {
+        STATS_INC(entries_ignored);
+        return 1;
+    }
+    return 0;
+}
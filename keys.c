@@ -0,0 +1,201 @@
+#include "findmax.h"
+
+// Sort key table.
+//
+// Each key is one entry here: its name for --sort and --time, and an
+// extractor that reduces an entry to a single 64-bit integer. The
+// extracted value is stored in file_entry_t.sort_key when an entry is
+// built, so heaps, sorts and the single-best scan compare plain integers
+// whatever the key. Adding a key means adding a sort_type_t value and a
+// row below. The score key has no extractor: it runs the expression
+// compiled from --score (score.c) and packs the result with score_key().
+//
+// A key list (--sort size,mtime:asc,name) is compared key by key, in
+// list order, by compare_sort_list(). Every integer key of the list,
+// score included, is extracted once into file_entry_t.sort_vals when the
+// entry is built and compared as a plain integer; names are compared
+// with strcoll() as for a single name key. sort_key holds the score
+// whenever the list includes it.
+
+static int64_t key_mtime(const char *path, const struct stat *st) {
+    (void)path;
+    return (int64_t)st->st_mtime;
+}
+
+static int64_t key_atime(const char *path, const struct stat *st) {
+    (void)path;
+    return (int64_t)st->st_atime;
+}
+
+static int64_t key_ctime(const char *path, const struct stat *st) {
+    (void)path;
+    return (int64_t)st->st_ctime;
+}
+
+static int64_t key_btime(const char *path, const struct stat *st) {
+    (void)path;
+#ifdef __APPLE__
+    return (int64_t)st->st_birthtime;
+#else
+    return (int64_t)st->st_ctime; // Fallback to ctime on Linux
+#endif
+}
+
+static int64_t key_size(const char *path, const struct stat *st) {
+    (void)path;
+    return (int64_t)st->st_size;
+}
+
+// Allocated bytes, so sparse files rank by what they occupy on disk
+static int64_t key_blocks(const char *path, const struct stat *st) {
+    (void)path;
+    return (int64_t)st->st_blocks * 512;
+}
+
+static int64_t key_nlink(const char *path, const struct stat *st) {
+    (void)path;
+    return (int64_t)st->st_nlink;
+}
+
+// Number of components in the path as reported, ignoring empty ones
+static int64_t key_depth(const char *path, const struct stat *st) {
+    (void)st;
+    int64_t depth = 0;
+    for (const char *p = path; *p; p++) {
+        if (*p != '/' && (p == path || p[-1] == '/')) depth++;
+    }
+    return depth;
+}
+
+static int64_t key_pathlen(const char *path, const struct stat *st) {
+    (void)st;
+    return (int64_t)strlen(path);
+}
+
+const sort_key_t sort_keys[SORT_KEY_COUNT] = {
+    [SORT_MTIME]   = { "mtime",   key_mtime,   1 },
+    [SORT_ATIME]   = { "atime",   key_atime,   1 },
+    [SORT_CTIME]   = { "ctime",   key_ctime,   1 },
+    [SORT_BTIME]   = { "btime",   key_btime,   1 },
+    [SORT_SIZE]    = { "size",    key_size,    0 },
+    [SORT_NAME]    = { "name",    NULL,        0 },
+    [SORT_BLOCKS]  = { "blocks",  key_blocks,  0 },
+    [SORT_NLINK]   = { "links",   key_nlink,   0 },
+    [SORT_DEPTH]   = { "depth",   key_depth,   0 },
+    [SORT_PATHLEN] = { "pathlen", key_pathlen, 0 },
+    [SORT_SCORE]   = { "score",   NULL,        0 },
+};
+
+int sort_key_by_name(const char *name, sort_type_t *sort_type) {
+    for (int i = 0; i < SORT_KEY_COUNT; i++) {
+        if (strcmp(name, sort_keys[i].name) == 0) {
+            *sort_type = (sort_type_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Parse KEY[:asc|:desc],... into opts->sort_list; keys default to the
+// descending (max first) order and -r reverses the whole list
+int parse_sort_list(const char *spec, options_t *opts) {
+    char buf[MAX_FORMAT_LEN];
+    if (strlen(spec) >= sizeof(buf)) return -1;
+    strcpy(buf, spec);
+    
+    int count = 0, asc_seen = 0;
+    char *saveptr;
+    for (char *item = strtok_r(buf, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr)) {
+        if (count >= SORT_MAX_KEYS) return -1;
+        unsigned char asc = 0;
+        char *colon = strchr(item, ':');
+        if (colon) {
+            *colon = '\0';
+            if (strcmp(colon + 1, "asc") == 0) {
+                asc = 1;
+            } else if (strcmp(colon + 1, "desc") != 0) {
+                return -1;
+            }
+        }
+        if (sort_key_by_name(item, &opts->sort_list[count]) != 0) return -1;
+        opts->sort_asc[count++] = asc;
+        asc_seen |= asc;
+    }
+    if (count == 0) return -1;
+    
+    opts->sort_type = opts->sort_list[0];
+    // One key in its default direction needs no packing
+    opts->sort_count = (count > 1 || asc_seen) ? count : 0;
+    return 0;
+}
+
+// Whether the sort key or key list includes the --score expression
+int sort_uses_score(const options_t *opts) {
+    if (opts->sort_type == SORT_SCORE) return 1;
+    for (int i = 0; i < opts->sort_count; i++) {
+        if (opts->sort_list[i] == SORT_SCORE) return 1;
+    }
+    return 0;
+}
+
+// Map a score onto an int64_t with the same order: the IEEE bits of a
+// non-negative double already sort as integers, negative ones sort
+// backwards and have their magnitude bits flipped
+int64_t score_key(double score) {
+    if (score != score) return INT64_MIN;  // NaN ranks last
+    int64_t bits;
+    memcpy(&bits, &score, sizeof(bits));
+    return bits < 0 ? bits ^ INT64_MAX : bits;
+}
+
+// The score a score_key() result was made from
+double score_value(int64_t key) {
+    int64_t bits = key < 0 ? key ^ INT64_MAX : key;
+    double score;
+    memcpy(&score, &bits, sizeof(score));
+    return score;
+}
+
+// Integer value of one key of an entry; SORT_NAME is not an integer
+static int64_t key_value(sort_type_t type, const file_entry_t *entry, const options_t *opts) {
+    if (type == SORT_SCORE) {
+        return score_key(score_eval(opts->score, entry->path, &entry->st));
+    }
+    return sort_keys[type].extract(entry->path, &entry->st);
+}
+
+// Natural order of two entries under a key list; ascending keys compare
+// the other way round
+int compare_sort_list(const file_entry_t *a, const file_entry_t *b, const options_t *opts) {
+    for (int i = 0; i < opts->sort_count; i++) {
+        sort_type_t type = opts->sort_list[i];
+        int result;
+        if (type == SORT_NAME) {
+            const char *name_a = strrchr(a->path, '/');
+            const char *name_b = strrchr(b->path, '/');
+            result = strcoll(name_a ? name_a + 1 : a->path, name_b ? name_b + 1 : b->path);
+        } else {
+            result = (a->sort_vals[i] > b->sort_vals[i]) - (a->sort_vals[i] < b->sort_vals[i]);
+        }
+        if (result != 0) return opts->sort_asc[i] ? -result : result;
+    }
+    return 0;
+}
+
+void set_sort_key(file_entry_t *entry, const options_t *opts) {
+    if (opts->sort_count == 0) {
+        entry->sort_key = opts->sort_type == SORT_NAME ? 0 : key_value(opts->sort_type, entry, opts);
+        return;
+    }
+    // A key list also keeps its score in sort_key, wherever score stands in it
+    entry->sort_key = 0;
+    for (int i = 0; i < opts->sort_count; i++) {
+        sort_type_t type = opts->sort_list[i];
+        if (type == SORT_NAME) {
+            entry->sort_vals[i] = 0;
+        } else {
+            entry->sort_vals[i] = key_value(type, entry, opts);
+            if (type == SORT_SCORE) entry->sort_key = entry->sort_vals[i];
+        }
+    }
+}
@@ -1,6 +1,32 @@
 #include "findmax.h"
 
+// Release what a run allocated and pass its status on; every return of
+// findmax_main() goes through here once options are parsed
+static int finish_main(options_t *opts, char **paths, int allocated_paths, int status) {
+    free_options(opts);
+    if (allocated_paths) {
+        free(paths);
+    }
+    return status;
+}
+
+#ifndef FINDMAX_NO_MAIN
 int main(int argc, char *argv[]) {
+    // Set locale for proper string comparison
+    setlocale(LC_ALL, "");
+    
+    // The same binary is installed as findmaxd
+    const char *name = strrchr(argv[0], '/');
+    if (strcmp(name ? name + 1 : argv[0], "findmaxd") == 0) {
+        return daemon_main(argc, argv);
+    }
+    return findmax_main(argc, argv, NULL);
+}
+#endif
+
+// Run one findmax command line. findmaxd calls this for every query, with
+// index set to its snapshot of the roots it serves.
+int findmax_main(int argc, char *argv[], snapshot_t *index) {
     options_t opts = {0};
     char **paths = NULL;
     int path_count = 0;
@@ -12,30 +38,68 @@ int main(int argc, char *argv[]) {
     opts.num_files = DEFAULT_NUM_FILES;
     opts.max_depth = -1; // No limit by default
     opts.reverse = 1; // Default: max first (reverse normal order)
+    opts.max_groups = DEFAULT_MAX_GROUPS;
+    opts.shard_depth = DEFAULT_SHARD_DEPTH;
     
-    // Set locale for proper string comparison
-    setlocale(LC_ALL, "");
-    
-    // Parse command line arguments
-    if (parse_arguments(argc, argv, &opts, &paths, &path_count) != 0) {
+    // Parse command line arguments; parsing reorders argv, so --connect
+    // sends the original
+    char **args = malloc(sizeof(char *) * (size_t)argc);
+    if (!args) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
         return 1;
     }
+    memcpy(args, argv, sizeof(char *) * (size_t)argc);
+    int parsed = parse_arguments(argc, argv, &opts, &paths, &path_count);
+    if (parsed != 0) {
+        free(args);
+        return parsed == PARSE_DONE ? 0 : 1;
+    }
+    if (opts.connect && !index) {
+        int status = daemon_query(opts.connect, args, argc, paths, path_count);
+        free(args);
+        return finish_main(&opts, NULL, 0, status);
+    }
+    if (opts.batch) {
+        int status = batch_main(args, argc);
+        free(args);
+        return finish_main(&opts, NULL, 0, status);
+    }
+    free(args);
+    // The server only answers queries that passed the --connect checks
+    if (index && !opts.connect) {
+        fprintf(stderr, "findmax: findmaxd only answers --connect queries\n");
+        return finish_main(&opts, NULL, 0, 1);
+    }
+    
+    g_stats_enabled = (opts.stats != 0);
     
-    // If no paths specified, use current directory
+    // If no paths specified, use current directory (--merge: stdin)
     int allocated_paths = 0;
     if (path_count == 0) {
         paths = malloc(sizeof(char*));
-        paths[0] = ".";
+        paths[0] = opts.merge ? "-" : ".";
         path_count = 1;
         allocated_paths = 1;
     }
     
+    if (opts.diff_snapshot) {
+        int status = diff_main(paths, path_count, &opts);
+        if (opts.stats) {
+            print_scan_stats(opts.stats);
+        }
+        return finish_main(&opts, paths, allocated_paths, status);
+    }
+    
     // Optimization: if num_files == 1, use direct comparison instead of heap
-    if (opts.num_files == 1) {
+    if (opts.num_files == 1 && opts.deadline_ms == 0 && opts.approx_dirs == 0 &&
+        !opts.save_snapshot && !opts.from_snapshot && !opts.files_from && !opts.group_by &&
+        !opts.total && !opts.queries && !opts.histogram && !opts.quantile_count &&
+        !opts.until_size && !opts.until_count && !opts.exec && !opts.shard_count && !opts.merge && !index) {
         file_entry_t best = {0};
         best.path[0] = '\0';
         
         // Traverse all specified paths using direct comparison
+        stats_phase_begin(PHASE_TRAVERSE);
         for (int i = 0; i < path_count; i++) {
             if (traverse_directory_single(paths[i], &opts, &best, 0) != 0) {
                 if (!opts.quiet) {
@@ -43,16 +107,20 @@ int main(int argc, char *argv[]) {
                 }
             }
         }
+        stats_phase_end(PHASE_TRAVERSE);
         
         // Print result if found
+        stats_phase_begin(PHASE_OUTPUT);
         if (best.path[0] != '\0') {
             print_file_entry(&best, &opts);
         }
+        fflush(stdout);
+        stats_phase_end(PHASE_OUTPUT);
         
-        if (allocated_paths) {
-            free(paths);
+        if (opts.stats) {
+            print_scan_stats(opts.stats);
         }
-        return 0;
+        return finish_main(&opts, paths, allocated_paths, 0);
     }
     
     // Use heap-based optimization: maintain only top N files during traversal
@@ -60,30 +128,93 @@ int main(int argc, char *argv[]) {
     min_heap_t *heap = create_min_heap(opts.num_files, &opts);
     if (!heap) {
         fprintf(stderr, "findmax: memory allocation failed\n");
-        if (allocated_paths) {
-            free(paths);
-        }
-        return 1;
+        return finish_main(&opts, paths, allocated_paths, 1);
+    }
+    
+    // Snapshots: the writer is fed by heap_offer(), the reader replaces
+    // the traversal entirely
+    snapshot_t *snapshot = NULL;
+    if (opts.from_snapshot && !(snapshot = snapshot_open(opts.from_snapshot))) {
+        free_min_heap(heap);
+        return finish_main(&opts, paths, allocated_paths, 1);
+    }
+    if (opts.save_snapshot && !(opts.snapshot_writer = snapshot_create(opts.save_snapshot))) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
+        snapshot_close(snapshot);
+        free_min_heap(heap);
+        return finish_main(&opts, paths, allocated_paths, 1);
     }
     
-    // Traverse all specified paths using optimized heap approach
-    for (int i = 0; i < path_count; i++) {
-        if (traverse_directory_optimized(paths[i], &opts, heap, 0) != 0) {
-            if (!opts.quiet) {
-                fprintf(stderr, "findmax: error processing '%s'\n", paths[i]);
+    // Every entry offered to the heap is also counted in the sketch
+    if ((opts.histogram || opts.quantile_count) && !(opts.sketch = sketch_create(&opts))) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
+        free_min_heap(heap);
+        return finish_main(&opts, paths, allocated_paths, 1);
+    }
+    
+    // With --group-by, heap_offer() routes candidates to per-group heaps
+    // and the overall heap stays empty
+    if (opts.group_by && !(opts.group_map = group_map_create(paths, path_count, &opts))) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
+        free_min_heap(heap);
+        return finish_main(&opts, paths, allocated_paths, 1);
+    }
+    
+    // --save-snapshot records every entry the walk stat()s, so the walk
+    // runs without the entry filters and heap_offer() applies them after
+    // recording
+    options_t walk_opts = opts;
+    if (opts.snapshot_writer) {
+        walk_opts.filter_type = FILTER_ALL;
+        walk_opts.predicates = 0;
+        walk_opts.snapshot_filter = &opts;
+    }
+    
+    // Traverse all specified paths using optimized heap approach; with a
+    // deadline, walk breadth-first so a partial answer covers the whole tree
+    int partial = 0;
+    int failed = 0;
+    size_t unvisited = 0;
+    approx_report_t approx = {0};
+    stats_phase_begin(PHASE_TRAVERSE);
+    if (index) {
+        failed = snapshot_query_roots(index, paths, path_count, &walk_opts, heap) != 0;
+    } else if (snapshot) {
+        failed = snapshot_query(snapshot, &walk_opts, heap) != 0;
+        snapshot_close(snapshot);
+    } else if (opts.merge) {
+        failed = traverse_merge(paths, path_count, &walk_opts, heap) != 0;
+    } else if (opts.total) {
+        failed = traverse_totals(paths, path_count, &walk_opts, heap) != 0;
+    } else if (opts.files_from) {
+        failed = traverse_files_from(opts.files_from, opts.files_from_delim, &walk_opts, heap) != 0;
+    } else if (opts.approx_dirs > 0) {
+        traverse_approximate(paths, path_count, &walk_opts, heap, &approx);
+    } else if (opts.deadline_ms > 0) {
+        partial = traverse_breadth_first(paths, path_count, &walk_opts, heap, &unvisited);
+    } else {
+        for (int i = 0; i < path_count; i++) {
+            if (traverse_directory_optimized(paths[i], &walk_opts, heap, 0) != 0) {
+                if (!opts.quiet) {
+                    fprintf(stderr, "findmax: error processing '%s'\n", paths[i]);
+                }
             }
         }
     }
+    stats_phase_end(PHASE_TRAVERSE);
+    
+    if (opts.snapshot_writer) {
+        failed |= snapshot_finish(opts.snapshot_writer) != 0;
+        opts.snapshot_writer = NULL;
+    }
     
     // Extract results from heap and sort them properly for output
+    stats_phase_begin(PHASE_SORT);
     file_list_t *results = create_file_list();
     if (!results) {
         fprintf(stderr, "findmax: memory allocation failed\n");
         free_min_heap(heap);
-        if (allocated_paths) {
-            free(paths);
-        }
-        return 1;
+        return finish_main(&opts, paths, allocated_paths, 1);
     }
     
     // Copy heap contents to results
@@ -99,21 +230,64 @@ int main(int argc, char *argv[]) {
     
     // Sort results for proper output order (heap maintains min at top, we need final sort)
     sort_files(results, &opts);
+    stats_phase_end(PHASE_SORT);
     
-    // Print results (top N files)
-    size_t print_count = (results->count < (size_t)opts.num_files) ? results->count : (size_t)opts.num_files;
-    for (size_t i = 0; i < print_count; i++) {
-        print_file_entry(&results->entries[i], &opts);
+    // Print results (top N files, or top N of every group)
+    stats_phase_begin(PHASE_OUTPUT);
+    if (opts.queries) {
+        query_set_print(opts.queries);
+    } else if (opts.group_map) {
+        group_map_print(opts.group_map, &opts);
+    } else {
+        // A budget keeps exactly the entries that make up the answer
+        int budget = opts.until_size > 0 || opts.until_count > 0;
+        size_t print_count = (budget || results->count < (size_t)opts.num_files) ? results->count : (size_t)opts.num_files;
+        uint64_t selected = 0;
+        if (opts.shard_count > 0) {
+            print_shard_records(results->entries, print_count, &opts);
+        }
+        for (size_t i = 0; i < print_count; i++) {
+            // With --exec the results go to the command instead
+            if (!opts.exec && !opts.shard_count) {
+                print_file_entry(&results->entries[i], &opts);
+            }
+            selected += results->entries[i].st.st_size > 0 ? (uint64_t)results->entries[i].st.st_size : 0;
+        }
+        if (opts.exec && exec_run(opts.exec, results->entries, print_count, opts.exec_jobs) != 0) {
+            failed = 1;
+        }
+        if (opts.until_size > 0 && selected < (uint64_t)opts.until_size &&
+            (opts.until_count <= 0 || print_count < (size_t)opts.until_count) && !opts.quiet) {
+            fprintf(stderr, "findmax: size target not reached: all %zu matching entries total %llu bytes\n",
+                    print_count, (unsigned long long)selected);
+        }
+    }
+    if (opts.sketch) {
+        sketch_print(opts.sketch, &opts);
+    }
+    fflush(stdout);
+    stats_phase_end(PHASE_OUTPUT);
+    
+    if (opts.approx_dirs > 0 && !opts.quiet) {
+        fprintf(stderr, "findmax: %s: sampled %zu directories, %zu left unread, %zu entries examined, estimated recall %.0f%%\n",
+                approx.dirs_unvisited ? "approximate" : "exact",
+                approx.dirs_sampled, approx.dirs_unvisited, approx.entries_examined,
+                100.0 * approx_confidence(&approx));
+    }
+    
+    // Mark best-so-far results after they have been printed
+    if (partial && !opts.quiet) {
+        fprintf(stderr, "findmax: deadline reached, results are partial (%zu directories not visited)\n", unvisited);
+    }
+    
+    if (opts.stats) {
+        print_scan_stats(opts.stats);
     }
     
     // Cleanup
     free_file_list(results);
     free_min_heap(heap);
-    if (allocated_paths) {
-        free(paths);
-    }
-    
-    return 0;
+    return finish_main(&opts, paths, allocated_paths, failed ? 1 : partial ? 2 : 0);
 }
 
 void print_usage(void) {
@@ -130,14 +304,84 @@ void print_usage(void) {
     printf("                      mtime/modification, birth/creation)\n");
     printf("  -S                  file size\n");
     printf("  -n, --name          file name, order in current locale setting\n");
+    printf("      --sort KEY[,KEY...]  sort by KEY: mtime, atime, ctime, btime, size, name,\n");
+    printf("                      blocks (allocated bytes), links, depth or pathlen;\n");
+    printf("                      later keys break ties, KEY:asc sorts that key smallest\n");
+    printf("                      first (e.g. --sort=size,mtime:asc,name)\n");
+    printf("      --score EXPR    sort by an expression over size, blocks, mtime, atime,\n");
+    printf("                      ctime, btime, links, depth, pathlen, uid, gid and now,\n");
+    printf("                      with + - * / ( ), min(), max(), log() and K/M/G/T or\n");
+    printf("                      s/m/h/d/w suffixes (e.g. 'size * (now - atime)');\n");
+    printf("                      usable as the key 'score' in --sort and --query\n");
     printf("  -f, --file-only     print plain file only\n");
     printf("  -d, --dir-only      print directory only\n");
     printf("  -F, --format FMT    output format\n");
     printf("  -NUM                show top NUM files, default 1\n");
+    printf("      --until-size SIZE   instead of NUM files, show the top files whose sizes\n");
+    printf("                      add up to at least SIZE bytes (K, M, G, T suffixes)\n");
+    printf("      --until-count N     at most N files; with --until-size, stop at either\n");
     printf("  -v, --verbose       verbose output\n");
     printf("  -q, --quiet         quiet mode\n");
     printf("  -L, --dereference  follow symbolic links\n");
     printf("      --maxdepth NUM  limit directory traversal depth\n");
+    printf("      --approx[=DIRS] sample at most DIRS directories (default 1024), weighted\n");
+    printf("                      by size and refined where candidates are found\n");
+    printf("      --stats[=FMT]   print scan counters and phase timings to stderr\n");
+    printf("                      as text (default) or json\n");
+    printf("      --ignore-vcs    skip .git and paths listed in .gitignore/.ignore\n");
+    printf("      --min-size SIZE only files of at least SIZE bytes (K, M, G, T suffixes)\n");
+    printf("      --max-size SIZE only files of at most SIZE bytes\n");
+    printf("      --newer TIME    only files newer than TIME (@EPOCH, YYYY-MM-DD[ HH:MM[:SS]],\n");
+    printf("                      or an age such as 30m, 12h, 7d, 2w)\n");
+    printf("      --older TIME    only files older than TIME\n");
+    printf("      --glob GLOB     only files whose name matches GLOB\n");
+    printf("      --uid USER      only files owned by USER (name or number)\n");
+    printf("      --gid GROUP     only files owned by GROUP (name or number)\n");
+    printf("      --type TYPES    only these types: f d l s p b c (e.g. --type=f,l)\n");
+    printf("      --deadline DUR  stop after DUR (500ms, 2s, 1m) and print best-so-far,\n");
+    printf("                      walking breadth-first; exit status 2 if partial\n");
+    printf("      --files-from FILE   read newline-separated paths from FILE (- for stdin)\n");
+    printf("      --files0-from FILE  read NUL-separated paths from FILE (- for stdin)\n");
+    printf("      --save-snapshot FILE  also record every entry's metadata in FILE\n");
+    printf("      --from-snapshot FILE  answer the query from FILE instead of the file system\n");
+    printf("      --diff OLD      rank changes since snapshot OLD, printed as DELTA<TAB>entry\n");
+    printf("      --diff-by KEY   growth (size increase, default), new (size of files not\n");
+    printf("                      in OLD) or mtime (seconds the mtime advanced)\n");
+    printf("      --join KEY      match entries by path (default) or inode (dev, ino)\n");
+    printf("      --shard K/N     walk only shard K of N: entries down to --shard-depth\n");
+    printf("                      (default 1) are split by a hash of their relative path;\n");
+    printf("                      prints the top entries as records for --merge\n");
+    printf("      --shard-depth D split the tree at depth D below each FILE\n");
+    printf("      --merge         read shard records from each FILE (- or none for stdin)\n");
+    printf("                      and print the combined top entries\n");
+    printf("      --connect SOCKET  ask the findmaxd listening on SOCKET instead of walking;\n");
+    printf("                      FILE must be under one of the roots it indexes\n");
+    printf("      --batch         read one query (options and FILEs) per line of stdin and\n");
+    printf("                      answer each, followed by a '# findmax exit STATUS' line\n");
+    printf("  -x, --xdev          do not descend into directories on other filesystems\n");
+    printf("      --pseudo-fs     also read proc, sysfs, cgroup and other pseudo filesystems,\n");
+    printf("                      which are skipped below the roots by default\n");
+    printf("      --mount-policy FILE  per-mount rules, one per line: PATH or type:FSTYPE,\n");
+    printf("                      then skip, read, deadline DUR or threads N\n");
+    printf("      --threads N     stat() the files of directories with more than 1024\n");
+    printf("                      entries on N threads (default: CPUs, at most 8)\n");
+    printf("      --exec 'CMD [ARG...] [{} +]'  run CMD with the results appended, as many\n");
+    printf("                      per run as fit in the argument limit, instead of printing\n");
+    printf("      --exec-each 'CMD [ARG...]'  run CMD once per result, {} replaced by the path\n");
+    printf("  -P, --max-procs N   run up to N commands at a time (default 1)\n");
+    printf("      --query [LABEL=]KEYS[/N[/TYPES]]  add a ranking by the --sort KEYS\n");
+    printf("                      (top N, only TYPES as in --type); repeat to answer\n");
+    printf("                      several from one traversal, each under LABEL:\n");
+    printf("      --histogram     after the results, print entry counts and bytes by type\n");
+    printf("                      and a log2 histogram of the sort key (age for times)\n");
+    printf("      --quantiles[=P,...]  print these percentiles of the sort key\n");
+    printf("                      (default 50,90,99,99.9), within 1.6%%\n");
+    printf("      --total[=KEY]   rank directories by the cumulative size (default), disk\n");
+    printf("                      blocks or file count of their subtree, as du does\n");
+    printf("      --group-by KEY  top N per group instead of overall: dir[:DEPTH] (parent\n");
+    printf("                      directory, or DEPTH levels below FILE), ext, uid or gid\n");
+    printf("      --max-groups N  track at most N groups (default %d)\n", DEFAULT_MAX_GROUPS);
+    printf("      --flat          print grouped results as KEY<TAB>entry lines\n");
     printf("      --version       show version information\n");
     printf("      --help          show this help\n");
 }
@@ -149,9 +393,114 @@ void print_version(void) {
     printf("Fast file finding utility optimized for O(1) queries.\n");
 }
 
+// Parse a size with an optional binary suffix: 100, 10K, 1.5M, 2G, 1T
+static int parse_size(const char *arg, off_t *size) {
+    char *endptr;
+    double value = strtod(arg, &endptr);
+    if (endptr == arg || value < 0) {
+        return -1;
+    }
+    
+    double scale = 1;
+    switch (toupper((unsigned char)*endptr)) {
+        case 'K': scale = 1024.0; endptr++; break;
+        case 'M': scale = 1024.0 * 1024; endptr++; break;
+        case 'G': scale = 1024.0 * 1024 * 1024; endptr++; break;
+        case 'T': scale = 1024.0 * 1024 * 1024 * 1024; endptr++; break;
+        case 'B': break;
+    }
+    if (*endptr == 'i') endptr++;
+    if (toupper((unsigned char)*endptr) == 'B') endptr++;
+    if (*endptr != '\0') {
+        return -1;
+    }
+    
+    *size = (off_t)(value * scale);
+    return 0;
+}
+
+// Parse a point in time: @EPOCH, YYYY-MM-DD[ HH:MM[:SS]] (local time),
+// or an age relative to now such as 90s, 30m, 12h, 7d, 2w
+static int parse_time_spec(const char *arg, time_t *t) {
+    char *endptr;
+    
+    if (arg[0] == '@') {
+        long long epoch = strtoll(arg + 1, &endptr, 10);
+        if (endptr == arg + 1 || *endptr != '\0') return -1;
+        *t = (time_t)epoch;
+        return 0;
+    }
+    
+    struct tm tm = {0};
+    int year, mon, day, hour = 0, min = 0, sec = 0;
+    char sep;
+    int n = sscanf(arg, "%d-%d-%d%c%d:%d:%d", &year, &mon, &day, &sep, &hour, &min, &sec);
+    if (n == 3 || (n >= 6 && (sep == ' ' || sep == 'T'))) {
+        tm.tm_year = year - 1900;
+        tm.tm_mon = mon - 1;
+        tm.tm_mday = day;
+        tm.tm_hour = hour;
+        tm.tm_min = min;
+        tm.tm_sec = sec;
+        tm.tm_isdst = -1;
+        *t = mktime(&tm);
+        return (*t == (time_t)-1) ? -1 : 0;
+    }
+    
+    double amount = strtod(arg, &endptr);
+    if (endptr == arg || amount < 0) {
+        return -1;
+    }
+    double unit;
+    switch (*endptr) {
+        case 's': case '\0': unit = 1; break;
+        case 'm': unit = 60; break;
+        case 'h': unit = 3600; break;
+        case 'd': unit = 86400; break;
+        case 'w': unit = 7 * 86400; break;
+        default: return -1;
+    }
+    if (*endptr && endptr[1] != '\0') {
+        return -1;
+    }
+    *t = time(NULL) - (time_t)(amount * unit);
+    return 0;
+}
+
+// Free everything options own; fields are reset so it can run twice
+void free_options(options_t *opts) {
+    group_map_free(opts->group_map);
+    query_set_free(opts->queries);
+    sketch_free(opts->sketch);
+    score_free(opts->score);
+    exec_free(opts->exec);
+    mount_policy_free(opts->mount_policy);
+    opts->group_map = NULL;
+    opts->queries = NULL;
+    opts->sketch = NULL;
+    opts->score = NULL;
+    opts->exec = NULL;
+    opts->mount_policy = NULL;
+}
+
+static int parse_options(int argc, char *argv[], options_t *opts, char ***paths, int *path_count);
+
+// Parse a command line into opts: 0 to run it, PARSE_DONE after --help or
+// --version, 1 on an error. Anything but 0 leaves nothing allocated in
+// opts, so a rejected --batch line does not leak.
 int parse_arguments(int argc, char *argv[], options_t *opts, char ***paths, int *path_count) {
+    int status = parse_options(argc, argv, opts, paths, path_count);
+    if (status != 0) {
+        free_options(opts);
+    }
+    return status;
+}
+
+static int parse_options(int argc, char *argv[], options_t *opts, char ***paths, int *path_count) {
     int opt;
     int option_index = 0;
+    const char *query_specs[MAX_QUERIES];
+    int query_count = 0;
     
     // Handle -NUM arguments first
     for (int i = 1; i < argc; i++) {
@@ -184,10 +533,52 @@ int parse_arguments(int argc, char *argv[], options_t *opts, char ***paths, int
         {"maxdepth", required_argument, 0, 1001},
         {"version", no_argument, 0, 1002},
         {"help", no_argument, 0, 1003},
+        {"ignore-vcs", no_argument, 0, 1004},
+        {"min-size", required_argument, 0, 1005},
+        {"max-size", required_argument, 0, 1006},
+        {"newer", required_argument, 0, 1007},
+        {"older", required_argument, 0, 1008},
+        {"glob", required_argument, 0, 1009},
+        {"uid", required_argument, 0, 1010},
+        {"gid", required_argument, 0, 1011},
+        {"type", required_argument, 0, 1012},
+        {"deadline", required_argument, 0, 1013},
+        {"approx", optional_argument, 0, 1014},
+        {"stats", optional_argument, 0, 1015},
+        {"save-snapshot", required_argument, 0, 1016},
+        {"from-snapshot", required_argument, 0, 1017},
+        {"diff", required_argument, 0, 1018},
+        {"diff-by", required_argument, 0, 1019},
+        {"join", required_argument, 0, 1020},
+        {"files-from", required_argument, 0, 1021},
+        {"files0-from", required_argument, 0, 1022},
+        {"group-by", required_argument, 0, 1023},
+        {"max-groups", required_argument, 0, 1024},
+        {"flat", no_argument, 0, 1025},
+        {"total", optional_argument, 0, 1026},
+        {"sort", required_argument, 0, 1027},
+        {"query", required_argument, 0, 1028},
+        {"histogram", no_argument, 0, 1029},
+        {"quantiles", optional_argument, 0, 1030},
+        {"score", required_argument, 0, 1031},
+        {"until-size", required_argument, 0, 1032},
+        {"until-count", required_argument, 0, 1033},
+        {"shard", required_argument, 0, 1036},
+        {"shard-depth", required_argument, 0, 1037},
+        {"merge", no_argument, 0, 1038},
+        {"connect", required_argument, 0, 1039},
+        {"batch", no_argument, 0, 1040},
+        {"xdev", no_argument, 0, 'x'},
+        {"pseudo-fs", no_argument, 0, 1041},
+        {"mount-policy", required_argument, 0, 1042},
+        {"threads", required_argument, 0, 1043},
+        {"exec", required_argument, 0, 1034},
+        {"exec-each", required_argument, 0, 1035},
+        {"max-procs", required_argument, 0, 'P'},
         {0, 0, 0, 0}
     };
     
-    while ((opt = getopt_long(argc, argv, "RructnSfdF:vqL", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "RructnSfdF:vqLxP:", long_options, &option_index)) != -1) {
         switch (opt) {
             case 'R':
                 opts->recursive = 1;
@@ -197,18 +588,23 @@ int parse_arguments(int argc, char *argv[], options_t *opts, char ***paths, int
                 break;
             case 'u':
                 opts->sort_type = SORT_ATIME;
+                opts->sort_count = 0;
                 break;
             case 'c':
                 opts->sort_type = SORT_CTIME;
+                opts->sort_count = 0;
                 break;
             case 't':
                 opts->sort_type = SORT_MTIME;
+                opts->sort_count = 0;
                 break;
             case 'S':
                 opts->sort_type = SORT_SIZE;
+                opts->sort_count = 0;
                 break;
             case 'n':
                 opts->sort_type = SORT_NAME;
+                opts->sort_count = 0;
                 break;
             case 'f':
                 opts->filter_type = FILTER_FILE_ONLY;
@@ -229,6 +625,9 @@ int parse_arguments(int argc, char *argv[], options_t *opts, char ***paths, int
             case 'L':
                 opts->dereference = 1;
                 break;
+            case 'x':
+                opts->xdev = 1;
+                break;
             case 1000: // --time
                 if (strcmp(optarg, "atime") == 0 || strcmp(optarg, "access") == 0 || strcmp(optarg, "use") == 0) {
                     opts->sort_type = SORT_ATIME;
@@ -242,6 +641,7 @@ int parse_arguments(int argc, char *argv[], options_t *opts, char ***paths, int
                     fprintf(stderr, "findmax: invalid time type '%s'\n", optarg);
                     return 1;
                 }
+                opts->sort_count = 0;
                 break;
             case 1001: // --maxdepth
                 {
@@ -256,13 +656,334 @@ int parse_arguments(int argc, char *argv[], options_t *opts, char ***paths, int
                 break;
             case 1002: // --version
                 print_version();
-                exit(0);
+                return PARSE_DONE;
             case 1003: // --help
                 print_usage();
-                exit(0);
+                return PARSE_DONE;
+            case 1004: // --ignore-vcs
+                opts->ignore_vcs = 1;
+                break;
+            case 1005: // --min-size
+            case 1006: // --max-size
+                {
+                    off_t size;
+                    if (parse_size(optarg, &size) != 0) {
+                        fprintf(stderr, "findmax: invalid size '%s'\n", optarg);
+                        return 1;
+                    }
+                    if (opt == 1005) {
+                        opts->min_size = size;
+                        opts->predicates |= PRED_MIN_SIZE;
+                    } else {
+                        opts->max_size = size;
+                        opts->predicates |= PRED_MAX_SIZE;
+                    }
+                }
+                break;
+            case 1007: // --newer
+            case 1008: // --older
+                {
+                    time_t t;
+                    if (parse_time_spec(optarg, &t) != 0) {
+                        fprintf(stderr, "findmax: invalid time '%s'\n", optarg);
+                        return 1;
+                    }
+                    if (opt == 1007) {
+                        opts->newer_than = t;
+                        opts->predicates |= PRED_NEWER;
+                    } else {
+                        opts->older_than = t;
+                        opts->predicates |= PRED_OLDER;
+                    }
+                }
+                break;
+            case 1009: // --glob
+                strncpy(opts->name_glob, optarg, MAX_FORMAT_LEN - 1);
+                opts->name_glob[MAX_FORMAT_LEN - 1] = '\0';
+                opts->predicates |= PRED_NAME;
+                break;
+            case 1010: // --uid
+                {
+                    char *endptr;
+                    unsigned long id = strtoul(optarg, &endptr, 10);
+                    if (*optarg == '\0' || *endptr != '\0') {
+                        struct passwd *pw = getpwnam(optarg);
+                        if (!pw) {
+                            fprintf(stderr, "findmax: invalid user '%s'\n", optarg);
+                            return 1;
+                        }
+                        id = pw->pw_uid;
+                    }
+                    opts->uid = (uid_t)id;
+                    opts->predicates |= PRED_UID;
+                }
+                break;
+            case 1011: // --gid
+                {
+                    char *endptr;
+                    unsigned long id = strtoul(optarg, &endptr, 10);
+                    if (*optarg == '\0' || *endptr != '\0') {
+                        struct group *gr = getgrnam(optarg);
+                        if (!gr) {
+                            fprintf(stderr, "findmax: invalid group '%s'\n", optarg);
+                            return 1;
+                        }
+                        id = gr->gr_gid;
+                    }
+                    opts->gid = (gid_t)id;
+                    opts->predicates |= PRED_GID;
+                }
+                break;
+            case 1012: // --type
+                if (parse_type_list(optarg, &opts->type_mask) != 0) {
+                    fprintf(stderr, "findmax: invalid type '%s'\n", optarg);
+                    return 1;
+                }
+                opts->predicates |= PRED_TYPE;
+                break;
+            case 1014: // --approx[=DIRS]
+                opts->approx_dirs = 1024;
+                if (optarg) {
+                    char *endptr;
+                    opts->approx_dirs = strtol(optarg, &endptr, 10);
+                    if (*endptr != '\0' || opts->approx_dirs <= 0) {
+                        fprintf(stderr, "findmax: invalid approx budget '%s'\n", optarg);
+                        return 1;
+                    }
+                }
+                break;
+            case 1015: // --stats[=text|json]
+                if (!optarg || strcmp(optarg, "text") == 0) {
+                    opts->stats = STATS_TEXT;
+                } else if (strcmp(optarg, "json") == 0) {
+                    opts->stats = STATS_JSON;
+                } else {
+                    fprintf(stderr, "findmax: invalid stats format '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 1013: // --deadline
+                if (parse_duration(optarg, &opts->deadline_ms) != 0 || opts->deadline_ms <= 0) {
+                    fprintf(stderr, "findmax: invalid deadline '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 1016: // --save-snapshot
+                opts->save_snapshot = optarg;
+                break;
+            case 1017: // --from-snapshot
+                opts->from_snapshot = optarg;
+                break;
+            case 1018: // --diff
+                opts->diff_snapshot = optarg;
+                break;
+            case 1019: // --diff-by
+                if (strcmp(optarg, "growth") == 0) {
+                    opts->diff_by = DIFF_BY_GROWTH;
+                } else if (strcmp(optarg, "new") == 0) {
+                    opts->diff_by = DIFF_BY_NEW;
+                } else if (strcmp(optarg, "mtime") == 0) {
+                    opts->diff_by = DIFF_BY_MTIME;
+                } else {
+                    fprintf(stderr, "findmax: invalid diff ranking '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 1020: // --join
+                if (strcmp(optarg, "path") == 0) {
+                    opts->diff_join = DIFF_JOIN_PATH;
+                } else if (strcmp(optarg, "inode") == 0) {
+                    opts->diff_join = DIFF_JOIN_INODE;
+                } else {
+                    fprintf(stderr, "findmax: invalid join key '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 1021: // --files-from
+            case 1022: // --files0-from
+                opts->files_from = optarg;
+                opts->files_from_delim = (opt == 1021) ? '\n' : '\0';
+                break;
+            case 1023: // --group-by
+                opts->group_depth = 0;
+                if (strcmp(optarg, "dir") == 0 || strncmp(optarg, "dir:", 4) == 0) {
+                    opts->group_by = GROUP_BY_DIR;
+                    if (optarg[3] == ':') {
+                        char *endptr;
+                        long depth = strtol(optarg + 4, &endptr, 10);
+                        if (optarg[4] == '\0' || *endptr != '\0' || depth <= 0 || depth > 4096) {
+                            fprintf(stderr, "findmax: invalid group depth '%s'\n", optarg + 4);
+                            return 1;
+                        }
+                        opts->group_depth = (int)depth;
+                    }
+                } else if (strcmp(optarg, "ext") == 0) {
+                    opts->group_by = GROUP_BY_EXT;
+                } else if (strcmp(optarg, "uid") == 0) {
+                    opts->group_by = GROUP_BY_UID;
+                } else if (strcmp(optarg, "gid") == 0) {
+                    opts->group_by = GROUP_BY_GID;
+                } else {
+                    fprintf(stderr, "findmax: invalid group key '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 1024: // --max-groups
+                {
+                    char *endptr;
+                    opts->max_groups = strtol(optarg, &endptr, 10);
+                    if (*optarg == '\0' || *endptr != '\0' || opts->max_groups <= 0) {
+                        fprintf(stderr, "findmax: invalid group limit '%s'\n", optarg);
+                        return 1;
+                    }
+                }
+                break;
+            case 1025: // --flat
+                opts->group_flat = 1;
+                break;
+            case 1027: // --sort KEY[:asc|:desc],...
+                if (parse_sort_list(optarg, opts) != 0) {
+                    fprintf(stderr, "findmax: invalid sort key '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 1031: // --score EXPR
+                score_free(opts->score);
+                if (!(opts->score = score_compile(optarg, time(NULL)))) {
+                    return 1;
+                }
+                opts->sort_type = SORT_SCORE;
+                opts->sort_count = 0;
+                break;
+            case 1032: // --until-size SIZE
+                if (parse_size(optarg, &opts->until_size) != 0 || opts->until_size <= 0) {
+                    fprintf(stderr, "findmax: invalid size '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 1033: // --until-count N
+                {
+                    char *endptr;
+                    long count = strtol(optarg, &endptr, 10);
+                    if (*optarg == '\0' || *endptr != '\0' || count <= 0) {
+                        fprintf(stderr, "findmax: invalid count '%s'\n", optarg);
+                        return 1;
+                    }
+                    opts->until_count = count;
+                }
+                break;
+            case 1036: // --shard K/N
+                if (parse_shard(optarg, opts) != 0) {
+                    fprintf(stderr, "findmax: invalid shard '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 1037: // --shard-depth DEPTH
+                {
+                    char *endptr;
+                    long depth = strtol(optarg, &endptr, 10);
+                    if (*optarg == '\0' || *endptr != '\0' || depth < 1 || depth > 1000) {
+                        fprintf(stderr, "findmax: invalid shard depth '%s'\n", optarg);
+                        return 1;
+                    }
+                    opts->shard_depth = (int)depth;
+                }
+                break;
+            case 1038: // --merge
+                opts->merge = 1;
+                break;
+            case 1039: // --connect SOCKET
+                opts->connect = optarg;
+                break;
+            case 1040: // --batch
+                opts->batch = 1;
+                break;
+            case 1041: // --pseudo-fs
+                opts->pseudo_fs = 1;
+                break;
+            case 1042: // --mount-policy FILE
+                mount_policy_free(opts->mount_policy);
+                if (!(opts->mount_policy = mount_policy_load(optarg))) {
+                    return 1;
+                }
+                break;
+            case 1043: // --threads N
+                {
+                    char *endptr;
+                    long threads = strtol(optarg, &endptr, 10);
+                    if (*optarg == '\0' || *endptr != '\0' || threads <= 0 || threads > SPLIT_MAX_WORKERS) {
+                        fprintf(stderr, "findmax: invalid number of threads '%s'\n", optarg);
+                        return 1;
+                    }
+                    opts->threads = (int)threads;
+                }
+                break;
+            case 1034: // --exec CMD [{} +]
+            case 1035: // --exec-each CMD
+                exec_free(opts->exec);
+                if (!(opts->exec = exec_parse(optarg, opt == 1035))) {
+                    return 1;
+                }
+                break;
+            case 'P': // --max-procs N
+                {
+                    char *endptr;
+                    long jobs = strtol(optarg, &endptr, 10);
+                    if (*optarg == '\0' || *endptr != '\0' || jobs <= 0 || jobs > 1024) {
+                        fprintf(stderr, "findmax: invalid number of processes '%s'\n", optarg);
+                        return 1;
+                    }
+                    opts->exec_jobs = (int)jobs;
+                }
+                break;
+            case 1028: // --query
+                if (query_count >= MAX_QUERIES) {
+                    fprintf(stderr, "findmax: at most %d queries are supported\n", MAX_QUERIES);
+                    return 1;
+                }
+                query_specs[query_count++] = optarg;
+                break;
+            case 1029: // --histogram
+                opts->histogram = 1;
+                break;
+            case 1030: // --quantiles[=P,P...]
+                {
+                    const char *list = optarg ? optarg : "50,90,99,99.9";
+                    opts->quantile_count = 0;
+                    while (*list) {
+                        char *endptr;
+                        double q = strtod(list, &endptr);
+                        if (endptr == list || q < 0 || q > 100 || (*endptr != ',' && *endptr != '\0') ||
+                            opts->quantile_count >= MAX_QUANTILES) {
+                            fprintf(stderr, "findmax: invalid quantiles '%s'\n", optarg);
+                            return 1;
+                        }
+                        opts->quantiles[opts->quantile_count++] = q;
+                        list = *endptr ? endptr + 1 : endptr;
+                    }
+                    if (opts->quantile_count == 0) {
+                        fprintf(stderr, "findmax: invalid quantiles '%s'\n", optarg);
+                        return 1;
+                    }
+                }
+                break;
+            case 1026: // --total[=size|blocks|count]
+                if (!optarg || strcmp(optarg, "size") == 0) {
+                    opts->total = TOTAL_SIZE;
+                } else if (strcmp(optarg, "blocks") == 0) {
+                    opts->total = TOTAL_BLOCKS;
+                } else if (strcmp(optarg, "count") == 0) {
+                    opts->total = TOTAL_COUNT;
+                } else {
+                    fprintf(stderr, "findmax: invalid total '%s'\n", optarg);
+                    return 1;
+                }
+                break;
             case '?':
             default:
-                print_usage();
+                if (!batch_active()) {
+                    print_usage();
+                }
                 return 1;
         }
     }
@@ -273,5 +994,86 @@ int parse_arguments(int argc, char *argv[], options_t *opts, char ***paths, int
         *paths = &argv[optind];
     }
     
+    if (opts->files_from && (*path_count > 0 || opts->from_snapshot || opts->approx_dirs > 0 || opts->deadline_ms > 0)) {
+        fprintf(stderr, "findmax: --files-from cannot be combined with FILE, --from-snapshot, --approx or --deadline\n");
+        return 1;
+    }
+    if (opts->diff_snapshot && (opts->approx_dirs > 0 || opts->deadline_ms > 0)) {
+        fprintf(stderr, "findmax: --diff needs a complete scan and cannot be combined with --approx or --deadline\n");
+        return 1;
+    }
+    if (opts->total) {
+        if (opts->diff_snapshot || opts->files_from || opts->save_snapshot || opts->from_snapshot ||
+            opts->approx_dirs > 0 || opts->deadline_ms > 0) {
+            fprintf(stderr, "findmax: --total needs a complete walk and cannot be combined with --diff, --files-from, snapshots, --approx or --deadline\n");
+            return 1;
+        }
+        // Totals are ranked as sizes and always walk the whole tree
+        opts->sort_type = SORT_SIZE;
+        opts->sort_count = 0;
+        opts->recursive = 1;
+    }
+    if (opts->score && (opts->diff_snapshot || opts->total)) {
+        fprintf(stderr, "findmax: --score cannot be combined with --diff or --total\n");
+        return 1;
+    }
+    if ((opts->shard_count || opts->merge) &&
+        (opts->diff_snapshot || opts->files_from || opts->save_snapshot || opts->from_snapshot ||
+         opts->approx_dirs > 0 || opts->deadline_ms > 0 || opts->total || opts->group_by ||
+         query_count > 0 || opts->histogram || opts->quantile_count)) {
+        fprintf(stderr, "findmax: --shard and --merge cannot be combined with --diff, --files-from, snapshots, --approx, --deadline, --total, --group-by, --query, --histogram or --quantiles\n");
+        return 1;
+    }
+    if (opts->shard_count && (opts->merge || opts->exec)) {
+        fprintf(stderr, "findmax: --shard prints records for --merge and cannot be combined with --merge or --exec\n");
+        return 1;
+    }
+    if (opts->connect &&
+        (opts->dereference || opts->ignore_vcs || opts->diff_snapshot || opts->files_from ||
+         opts->save_snapshot || opts->from_snapshot || opts->approx_dirs > 0 || opts->deadline_ms > 0 ||
+         opts->total || opts->shard_count || opts->merge || opts->exec || opts->xdev || opts->pseudo_fs ||
+         opts->mount_policy)) {
+        fprintf(stderr, "findmax: --connect answers from the server's index and cannot be combined with -L, --ignore-vcs, --diff, --files-from, snapshots, --approx, --deadline, --total, --shard, --merge, --exec, -x, --pseudo-fs or --mount-policy\n");
+        return 1;
+    }
+    if (opts->batch && (*path_count > 0 || opts->connect || opts->files_from)) {
+        fprintf(stderr, "findmax: --batch reads queries from stdin and cannot be combined with FILE, --connect or --files-from\n");
+        return 1;
+    }
+    if (opts->exec && (opts->diff_snapshot || query_count > 0 || opts->group_by)) {
+        fprintf(stderr, "findmax: --exec cannot be combined with --diff, --query or --group-by\n");
+        return 1;
+    }
+    if ((opts->until_size > 0 || opts->until_count > 0) && opts->diff_snapshot) {
+        fprintf(stderr, "findmax: --until-size and --until-count cannot be combined with --diff\n");
+        return 1;
+    }
+    if (sort_uses_score(opts) && !opts->score) {
+        fprintf(stderr, "findmax: sort key 'score' needs --score EXPR\n");
+        return 1;
+    }
+    if (opts->diff_snapshot && (opts->histogram || opts->quantile_count)) {
+        fprintf(stderr, "findmax: --histogram and --quantiles cannot be combined with --diff\n");
+        return 1;
+    }
+    if (query_count > 0) {
+        if (opts->diff_snapshot || opts->total || opts->group_by) {
+            fprintf(stderr, "findmax: --query cannot be combined with --diff, --total or --group-by\n");
+            return 1;
+        }
+        // Built last so every query inherits the complete set of options
+        if (!(opts->queries = query_set_create(query_specs, query_count, opts))) {
+            return 1;
+        }
+    }
+    if (opts->diff_snapshot && opts->group_by) {
+        fprintf(stderr, "findmax: --group-by cannot be combined with --diff\n");
+        return 1;
+    }
+    if (opts->from_snapshot && (*path_count > 0 || opts->approx_dirs > 0 || opts->deadline_ms > 0)) {
+        fprintf(stderr, "findmax: --from-snapshot reads no paths and cannot be combined with FILE, --approx or --deadline\n");
+        return 1;
+    }
+    
     return 0;
 }
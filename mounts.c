@@ -0,0 +1,384 @@
+#include "findmax.h"
+#ifdef __linux__
+#include <sys/vfs.h>
+#else
+#include <sys/param.h>
+#include <sys/mount.h>
+#endif
+
+// Filesystem boundaries during a walk (--xdev, --pseudo-fs, --mount-policy).
+//
+// A directory is on another filesystem when its st_dev differs from that
+// of the directory it was found in, which the walk has from stat() anyway,
+// so staying inside one filesystem costs nothing. Only at a crossing is
+// the filesystem type read, once per device, with statfs(): pseudo
+// filesystems such as proc, sysfs and cgroup hold nothing worth ranking,
+// report sizes that are not disk usage and can block on reads, so they
+// are not entered unless --pseudo-fs is given. Roots named on the command
+// line are always read.
+//
+// A policy file adds rules per mount point or filesystem type:
+//     /mnt/archive   skip
+//     type:nfs       deadline 30s
+//     type:tmpfs     read
+//     type:cifs      threads 2
+// "skip" leaves the mount unread, "deadline" stops entering its
+// directories once that long has passed since the walk first entered a
+// mount the rule matches, "read" enters it even if it is a pseudo
+// filesystem and "threads" caps the stat() workers of its giant
+// directories (bigdir.c), for servers that slow down under load. A mount
+// point rule wins over a type rule. Skipped mount points are recognised by
+// path before they are stat()ed, so a hung network mount listed there is
+// never touched; the path is compared as the walk spells it, which is the
+// absolute path when the root is.
+
+#define MOUNT_MAX_RULES 256
+
+typedef enum {
+    MOUNT_READ,
+    MOUNT_SKIP,
+    MOUNT_DEADLINE,
+    MOUNT_THREADS
+} mount_action_t;
+
+typedef struct {
+    char *path;   // mount point, or NULL for a type: rule
+    char *type;
+    mount_action_t action;
+    long deadline_ms;
+    int threads;
+    long started_ms;  // when the walk first entered a matching mount, or 0
+    int reported;
+} mount_rule_t;
+
+// Rule that applies to each device crossed so far
+typedef struct {
+    dev_t dev;
+    mount_rule_t *rule;
+} mount_dev_t;
+
+struct mount_policy {
+    mount_rule_t rules[MOUNT_MAX_RULES];
+    size_t count;
+    int has_deadlines;
+    mount_dev_t *devs;
+    size_t dev_count;
+    size_t dev_capacity;
+};
+
+typedef struct {
+    dev_t dev;
+    char type[32];
+    int pseudo;
+} mount_fs_t;
+
+static const char *const pseudo_types[] = {
+    "proc", "procfs", "linprocfs", "sysfs", "devpts", "devfs", "fdescfs",
+    "cgroup", "cgroup2", "debugfs", "tracefs", "securityfs", "pstore", "bpf",
+    "configfs", "fusectl", "mqueue", "binfmt_misc", "efivarfs", "selinuxfs",
+    "nsfs", "hugetlbfs", "autofs",
+};
+
+#ifdef __linux__
+// statfs() f_type magic numbers (linux/magic.h) for the types a policy or
+// a pseudo filesystem check is likely to name
+static const struct {
+    unsigned long magic;
+    const char *name;
+} fs_magics[] = {
+    { 0x9fa0, "proc" },
+    { 0x62656572, "sysfs" },
+    { 0x1cd1, "devpts" },
+    { 0x27e0eb, "cgroup" },
+    { 0x63677270, "cgroup2" },
+    { 0x64626720, "debugfs" },
+    { 0x74726163, "tracefs" },
+    { 0x73636673, "securityfs" },
+    { 0x6165676c, "pstore" },
+    { 0xcafe4a11, "bpf" },
+    { 0x62656570, "configfs" },
+    { 0x65735543, "fusectl" },
+    { 0x19800202, "mqueue" },
+    { 0x42494e4d, "binfmt_misc" },
+    { 0xde5e81e4, "efivarfs" },
+    { 0xf97cff8c, "selinuxfs" },
+    { 0x6e736673, "nsfs" },
+    { 0x958458f6, "hugetlbfs" },
+    { 0x0187, "autofs" },
+    { 0x01021994, "tmpfs" },
+    { 0x858458f6, "ramfs" },
+    { 0x6969, "nfs" },
+    { 0xff534d42, "cifs" },
+    { 0xfe534d42, "smb2" },
+    { 0x517b, "smb" },
+    { 0x00c36400, "ceph" },
+    { 0x65735546, "fuse" },
+    { 0x794c7630, "overlay" },
+    { 0xef53, "ext4" },
+    { 0x58465342, "xfs" },
+    { 0x9123683e, "btrfs" },
+    { 0x2fc12fc1, "zfs" },
+    { 0x4d44, "vfat" },
+    { 0x5346544e, "ntfs" },
+    { 0x73717368, "squashfs" },
+    { 0x9660, "iso9660" },
+};
+#endif
+
+static mount_fs_t *fs_cache;
+static size_t fs_cache_count;
+static size_t fs_cache_capacity;
+
+// Type of the filesystem holding path, looked up once per device
+static const mount_fs_t *mount_fs(const char *path, dev_t dev) {
+    for (size_t i = 0; i < fs_cache_count; i++) {
+        if (fs_cache[i].dev == dev) return &fs_cache[i];
+    }
+    
+    mount_fs_t fs = { dev, "unknown", 0 };
+#ifdef __linux__
+    struct statfs sfs;
+    if (statfs(path, &sfs) == 0) {
+        unsigned long magic = (unsigned long)sfs.f_type & 0xffffffffUL;
+        snprintf(fs.type, sizeof(fs.type), "0x%lx", magic);
+        for (size_t i = 0; i < sizeof(fs_magics) / sizeof(fs_magics[0]); i++) {
+            if (fs_magics[i].magic == magic) {
+                snprintf(fs.type, sizeof(fs.type), "%s", fs_magics[i].name);
+                break;
+            }
+        }
+    }
+#else
+    struct statfs sfs;
+    if (statfs(path, &sfs) == 0) {
+        snprintf(fs.type, sizeof(fs.type), "%s", sfs.f_fstypename);
+    }
+#endif
+    for (size_t i = 0; i < sizeof(pseudo_types) / sizeof(pseudo_types[0]); i++) {
+        if (strcmp(fs.type, pseudo_types[i]) == 0) fs.pseudo = 1;
+    }
+    
+    if (fs_cache_count >= fs_cache_capacity) {
+        size_t new_capacity = fs_cache_capacity ? fs_cache_capacity * 2 : 16;
+        mount_fs_t *new_cache = realloc(fs_cache, sizeof(mount_fs_t) * new_capacity);
+        if (!new_cache) {
+            // Uncached, so looked up again at the next crossing
+            static mount_fs_t scratch;
+            scratch = fs;
+            return &scratch;
+        }
+        fs_cache = new_cache;
+        fs_cache_capacity = new_capacity;
+    }
+    fs_cache[fs_cache_count] = fs;
+    return &fs_cache[fs_cache_count++];
+}
+
+mount_policy_t *mount_policy_load(const char *file) {
+    FILE *in = fopen(file, "r");
+    if (!in) {
+        perror(file);
+        return NULL;
+    }
+    mount_policy_t *policy = calloc(1, sizeof(mount_policy_t));
+    if (!policy) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
+        fclose(in);
+        return NULL;
+    }
+    
+    char *line = NULL;
+    size_t capacity = 0;
+    size_t number = 0;
+    int failed = 0;
+    while (!failed && getline(&line, &capacity, in) != -1) {
+        number++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char *target = strtok(line, " \t\r\n");
+        if (!target) continue;
+        char *action = strtok(NULL, " \t\r\n");
+        char *argument = action ? strtok(NULL, " \t\r\n") : NULL;
+        
+        mount_rule_t rule = {0};
+        char *endptr;
+        long threads;
+        if (action && strcmp(action, "skip") == 0 && !argument) {
+            rule.action = MOUNT_SKIP;
+        } else if (action && strcmp(action, "read") == 0 && !argument) {
+            rule.action = MOUNT_READ;
+        } else if (action && strcmp(action, "deadline") == 0 && argument &&
+                   parse_duration(argument, &rule.deadline_ms) == 0 && rule.deadline_ms > 0) {
+            rule.action = MOUNT_DEADLINE;
+        } else if (action && strcmp(action, "threads") == 0 && argument &&
+                   (threads = strtol(argument, &endptr, 10)) > 0 && *endptr == '\0' &&
+                   threads <= SPLIT_MAX_WORKERS) {
+            rule.threads = (int)threads;
+            rule.action = MOUNT_THREADS;
+        } else {
+            fprintf(stderr, "findmax: %s:%zu: expected 'PATH|type:FSTYPE skip|read|deadline DUR|threads N'\n", file, number);
+            failed = 1;
+            break;
+        }
+        if (strtok(NULL, " \t\r\n") || policy->count >= MOUNT_MAX_RULES) {
+            fprintf(stderr, "findmax: %s:%zu: %s\n", file, number,
+                    policy->count >= MOUNT_MAX_RULES ? "too many rules" : "unexpected text after the rule");
+            failed = 1;
+            break;
+        }
+        
+        if (strncmp(target, "type:", 5) == 0) {
+            rule.type = strdup(target + 5);
+        } else {
+            // Compared against walk paths, which never end in a slash
+            size_t len = strlen(target);
+            while (len > 1 && target[len - 1] == '/') target[--len] = '\0';
+            rule.path = strdup(target);
+        }
+        if (!rule.type && !rule.path) {
+            fprintf(stderr, "findmax: memory allocation failed\n");
+            failed = 1;
+            break;
+        }
+        if (rule.action == MOUNT_DEADLINE) policy->has_deadlines = 1;
+        policy->rules[policy->count++] = rule;
+    }
+    
+    if (ferror(in)) {
+        perror(file);
+        failed = 1;
+    }
+    free(line);
+    fclose(in);
+    if (failed) {
+        mount_policy_free(policy);
+        return NULL;
+    }
+    return policy;
+}
+
+void mount_policy_free(mount_policy_t *policy) {
+    if (!policy) return;
+    for (size_t i = 0; i < policy->count; i++) {
+        free(policy->rules[i].path);
+        free(policy->rules[i].type);
+    }
+    free(policy->devs);
+    free(policy);
+}
+
+// Whether two paths are equal, any run of slashes counting as one: a walk
+// from / spells its paths //usr, //mnt and so on
+static int same_path(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        if (*a == '/') {
+            while (a[1] == '/') a++;
+            while (b[1] == '/') b++;
+        }
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+int mount_path_skipped(const char *path, const options_t *opts) {
+    const mount_policy_t *policy = opts->mount_policy;
+    for (size_t i = 0; i < policy->count; i++) {
+        const mount_rule_t *rule = &policy->rules[i];
+        if (rule->action == MOUNT_SKIP && rule->path && same_path(rule->path, path)) {
+            STATS_INC(mounts_skipped);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Rule for a mount point at path holding a filesystem of the given type
+static mount_rule_t *match_rule(mount_policy_t *policy, const char *path, const char *type) {
+    mount_rule_t *by_type = NULL;
+    for (size_t i = 0; i < policy->count; i++) {
+        mount_rule_t *rule = &policy->rules[i];
+        if (rule->path && same_path(rule->path, path)) return rule;
+        if (!by_type && rule->type && strcmp(rule->type, type) == 0) by_type = rule;
+    }
+    return by_type;
+}
+
+static mount_rule_t *dev_rule(const mount_policy_t *policy, dev_t dev) {
+    for (size_t i = 0; i < policy->dev_count; i++) {
+        if (policy->devs[i].dev == dev) return policy->devs[i].rule;
+    }
+    return NULL;
+}
+
+static void remember_dev(mount_policy_t *policy, dev_t dev, mount_rule_t *rule) {
+    for (size_t i = 0; i < policy->dev_count; i++) {
+        if (policy->devs[i].dev == dev) {
+            policy->devs[i].rule = rule;
+            return;
+        }
+    }
+    if (policy->dev_count >= policy->dev_capacity) {
+        size_t new_capacity = policy->dev_capacity ? policy->dev_capacity * 2 : 16;
+        mount_dev_t *new_devs = realloc(policy->devs, sizeof(mount_dev_t) * new_capacity);
+        if (!new_devs) return;
+        policy->devs = new_devs;
+        policy->dev_capacity = new_capacity;
+    }
+    policy->devs[policy->dev_count].dev = dev;
+    policy->devs[policy->dev_count].rule = rule;
+    policy->dev_count++;
+}
+
+// Whether a deadline rule still lets the walk enter one more directory
+static int deadline_allows(mount_rule_t *rule, const options_t *opts) {
+    if (!rule || rule->action != MOUNT_DEADLINE) return 1;
+    long now = monotonic_ms();
+    if (rule->started_ms == 0) {
+        rule->started_ms = now;
+        return 1;
+    }
+    if (now - rule->started_ms < rule->deadline_ms) return 1;
+    if (!rule->reported && !opts->quiet) {
+        fprintf(stderr, "findmax: %s%s: mount deadline reached, the rest is not read\n",
+                rule->path ? "" : "type:", rule->path ? rule->path : rule->type);
+    }
+    rule->reported = 1;
+    return 0;
+}
+
+// Worker thread cap of a "threads" rule for a device the walk has
+// entered, or 0
+int mount_thread_limit(dev_t dev, const options_t *opts) {
+    if (!opts->mount_policy) return 0;
+    const mount_rule_t *rule = dev_rule(opts->mount_policy, dev);
+    return rule && rule->action == MOUNT_THREADS ? rule->threads : 0;
+}
+
+int mount_may_enter(const char *path, const struct stat *st, dev_t parent_dev, int depth, const options_t *opts) {
+    mount_policy_t *policy = opts->mount_policy;
+    if (depth > 0 && st->st_dev == parent_dev) {
+        return policy && policy->has_deadlines ? deadline_allows(dev_rule(policy, st->st_dev), opts) : 1;
+    }
+    if (depth == 0 && !policy) {
+        return 1;
+    }
+    if (depth > 0 && opts->xdev) {
+        STATS_INC(mounts_skipped);
+        return 0;
+    }
+    
+    const mount_fs_t *fs = mount_fs(path, st->st_dev);
+    mount_rule_t *rule = policy ? match_rule(policy, path, fs->type) : NULL;
+    if (policy) {
+        remember_dev(policy, st->st_dev, rule);
+    }
+    if (depth > 0) {
+        int skipped = rule ? rule->action == MOUNT_SKIP : fs->pseudo && !opts->pseudo_fs;
+        if (skipped) {
+            STATS_INC(mounts_skipped);
+            return 0;
+        }
+    }
+    return deadline_allows(rule, opts);
+}
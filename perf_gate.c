@@ -0,0 +1,363 @@
+/*
+ * Deterministic performance regression gate for findmax
+ * Copyright (C) 2026 Lenik <findmax@bodz.net>
+ *
+ * Builds a fixed fixture tree, runs each traversal mode in-process and
+ * compares cost counters that do not depend on machine load (directories
+ * opened, entries read, stat calls, heap inserts, path bytes, allocations
+ * and peak heap bytes) against a committed baseline file.
+ */
+
+#include "findmax.h"
+#include <fcntl.h>
+#include <malloc.h>
+#include <sys/time.h>
+
+#define GATE_FANOUT 4
+#define GATE_DEPTH 3
+#define GATE_FILES 16
+#define GATE_MAX_METRICS 256
+
+// Default slack written by --update: counters are exact for a given tree,
+// allocation sizes vary a little with the libc and file system
+#define TOLERANCE_COUNT 0
+#define TOLERANCE_BYTES 10
+
+#ifdef __GLIBC__
+// Replace the allocator for the whole process (glibc supports this
+// directly), forwarding to the real implementation. Counting is only
+// active while a case runs.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+#define HAVE_ALLOC_COUNTS 1
+
+static int alloc_counting = 0;
+static uint64_t alloc_calls = 0;
+static uint64_t alloc_bytes = 0;
+static long long alloc_live = 0;
+static long long alloc_peak = 0;
+
+static void count_alloc(void *ptr) {
+    if (!alloc_counting || !ptr) return;
+    size_t size = malloc_usable_size(ptr);
+    alloc_calls++;
+    alloc_bytes += size;
+    alloc_live += (long long)size;
+    if (alloc_live > alloc_peak) alloc_peak = alloc_live;
+}
+
+static void count_free(void *ptr) {
+    if (!alloc_counting || !ptr) return;
+    alloc_live -= (long long)malloc_usable_size(ptr);
+}
+
+void *malloc(size_t size) {
+    void *ptr = __libc_malloc(size);
+    count_alloc(ptr);
+    return ptr;
+}
+
+void *calloc(size_t count, size_t size) {
+    void *ptr = __libc_calloc(count, size);
+    count_alloc(ptr);
+    return ptr;
+}
+
+void *realloc(void *ptr, size_t size) {
+    count_free(ptr);
+    void *new_ptr = __libc_realloc(ptr, size);
+    if (!new_ptr && ptr && size) {
+        // Original block is still allocated
+        if (alloc_counting) alloc_live += (long long)malloc_usable_size(ptr);
+        return NULL;
+    }
+    count_alloc(new_ptr);
+    return new_ptr;
+}
+
+void free(void *ptr) {
+    count_free(ptr);
+    __libc_free(ptr);
+}
+#endif
+
+typedef enum {
+    GATE_SINGLE,
+    GATE_HEAP,
+    GATE_BFS,
+    GATE_LIST
+} gate_mode_t;
+
+typedef struct {
+    const char *name;
+    gate_mode_t mode;
+    sort_type_t sort_type;
+    int num_files;
+    filter_type_t filter_type;
+    int ignore_vcs;
+} gate_case_t;
+
+static const gate_case_t gate_cases[] = {
+    { "single", GATE_SINGLE, SORT_MTIME, 1, FILTER_ALL, 0 },
+    { "heap-size-10", GATE_HEAP, SORT_SIZE, 10, FILTER_ALL, 0 },
+    { "heap-name-100", GATE_HEAP, SORT_NAME, 100, FILTER_ALL, 0 },
+    { "heap-dirs", GATE_HEAP, SORT_MTIME, 10, FILTER_DIR_ONLY, 0 },
+    { "heap-ignore-vcs", GATE_HEAP, SORT_SIZE, 10, FILTER_ALL, 1 },
+    { "bfs-size-10", GATE_BFS, SORT_SIZE, 10, FILTER_ALL, 0 },
+    { "list-sort", GATE_LIST, SORT_SIZE, 10, FILTER_FILE_ONLY, 0 },
+};
+
+typedef struct {
+    char name[64];
+    unsigned long long value;
+    int tolerance;
+} gate_metric_t;
+
+static gate_metric_t measured[GATE_MAX_METRICS];
+static int measured_count = 0;
+
+static void record(const char *case_name, const char *metric, unsigned long long value, int tolerance) {
+    if (measured_count >= GATE_MAX_METRICS) return;
+    gate_metric_t *m = &measured[measured_count++];
+    snprintf(m->name, sizeof(m->name), "%s.%s", case_name, metric);
+    m->value = value;
+    m->tolerance = tolerance;
+}
+
+// Fixed layout: names, sizes and times depend only on the position, and
+// some names carry a .tmp suffix that the root .gitignore excludes
+static void generate_tree(const char *dir, int level, unsigned *counter) {
+    char path[MAX_PATH_LEN];
+    
+    for (int i = 0; i < GATE_FILES; i++) {
+        unsigned n = (*counter)++;
+        snprintf(path, sizeof(path), "%s/file_%0*u%s", dir, (int)(3 + n % 13), n, (n % 5 == 0) ? ".tmp" : ".dat");
+        int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+        if (fd < 0) {
+            perror(path);
+            continue;
+        }
+        if (ftruncate(fd, (off_t)((n * 7919u) % 1000003u)) != 0) {
+            perror(path);
+        }
+        close(fd);
+        
+        struct timeval times[2];
+        times[0].tv_sec = times[1].tv_sec = 1000000000 + (time_t)((n * 104729u) % 700000000u);
+        times[0].tv_usec = times[1].tv_usec = 0;
+        utimes(path, times);
+    }
+    
+    if (level < GATE_DEPTH) {
+        for (int i = 0; i < GATE_FANOUT; i++) {
+            snprintf(path, sizeof(path), "%s/dir_%d_%d", dir, level, i);
+            if (mkdir(path, 0755) != 0) {
+                perror(path);
+                continue;
+            }
+            generate_tree(path, level + 1, counter);
+        }
+    }
+}
+
+static void run_case(const gate_case_t *gc, char *root) {
+    options_t opts = {0};
+    opts.sort_type = gc->sort_type;
+    opts.filter_type = gc->filter_type;
+    opts.recursive = 1;
+    opts.max_depth = -1;
+    opts.reverse = 1;
+    opts.num_files = gc->num_files;
+    opts.ignore_vcs = gc->ignore_vcs;
+    opts.quiet = 1;
+    strcpy(opts.format, "%n");
+    
+    memset(&g_scan_stats, 0, sizeof(g_scan_stats));
+    g_stats_enabled = 1;
+#ifdef HAVE_ALLOC_COUNTS
+    alloc_calls = alloc_bytes = 0;
+    alloc_live = alloc_peak = 0;
+    alloc_counting = 1;
+#endif
+    
+    switch (gc->mode) {
+        case GATE_SINGLE:
+            {
+                file_entry_t best = {0};
+                traverse_directory_single(root, &opts, &best, 0);
+            }
+            break;
+        case GATE_HEAP:
+        case GATE_BFS:
+            {
+                min_heap_t *heap = create_min_heap(opts.num_files, &opts);
+                if (gc->mode == GATE_HEAP) {
+                    traverse_directory_optimized(root, &opts, heap, 0);
+                } else {
+                    char *roots[] = { root };
+                    size_t unvisited;
+                    traverse_breadth_first(roots, 1, &opts, heap, &unvisited);
+                }
+                free_min_heap(heap);
+            }
+            break;
+        case GATE_LIST:
+            {
+                file_list_t *files = create_file_list();
+                traverse_directory(root, &opts, files);
+                sort_files(files, &opts);
+                free_file_list(files);
+            }
+            break;
+    }
+    
+#ifdef HAVE_ALLOC_COUNTS
+    alloc_counting = 0;
+#endif
+    g_stats_enabled = 0;
+    
+    const scan_stats_t *s = &g_scan_stats;
+    record(gc->name, "dirs_opened", s->dirs_opened, TOLERANCE_COUNT);
+    record(gc->name, "entries_read", s->entries_read, TOLERANCE_COUNT);
+    record(gc->name, "stat_calls", s->stat_calls, TOLERANCE_COUNT);
+    record(gc->name, "heap_inserts", s->heap_inserts, TOLERANCE_COUNT);
+    record(gc->name, "path_bytes", s->path_bytes, TOLERANCE_COUNT);
+#ifdef HAVE_ALLOC_COUNTS
+    record(gc->name, "alloc_calls", alloc_calls, TOLERANCE_COUNT);
+    record(gc->name, "alloc_bytes", alloc_bytes, TOLERANCE_BYTES);
+    record(gc->name, "peak_heap_bytes", (unsigned long long)alloc_peak, TOLERANCE_BYTES);
+#endif
+}
+
+static int write_baseline(const char *file) {
+    FILE *fp = fopen(file, "w");
+    if (!fp) {
+        perror(file);
+        return 1;
+    }
+    fprintf(fp, "# findmax perf gate baseline: metric value tolerance-percent\n");
+    fprintf(fp, "# Regenerate with: perf_gate --update %s\n", file);
+    for (int i = 0; i < measured_count; i++) {
+        fprintf(fp, "%s %llu %d\n", measured[i].name, measured[i].value, measured[i].tolerance);
+    }
+    fclose(fp);
+    printf("perf_gate: wrote %d metrics to %s\n", measured_count, file);
+    return 0;
+}
+
+// Compare every baseline line against the measurement. Metrics missing
+// from this build (e.g. allocation counts without glibc) are skipped.
+static int check_baseline(const char *file) {
+    FILE *fp = fopen(file, "r");
+    if (!fp) {
+        perror(file);
+        return 1;
+    }
+    
+    char line[256];
+    int regressions = 0;
+    int improvements = 0;
+    int checked = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        char name[64];
+        unsigned long long baseline;
+        int tolerance;
+        if (line[0] == '#' || sscanf(line, "%63s %llu %d", name, &baseline, &tolerance) != 3) {
+            continue;
+        }
+        
+        const gate_metric_t *m = NULL;
+        for (int i = 0; i < measured_count; i++) {
+            if (strcmp(measured[i].name, name) == 0) {
+                m = &measured[i];
+                break;
+            }
+        }
+        if (!m) {
+            continue;
+        }
+        checked++;
+        
+        unsigned long long limit = baseline + baseline * (unsigned long long)tolerance / 100;
+        if (m->value > limit) {
+            printf("REGRESSION %-36s %llu > %llu (baseline %llu, +%d%%)\n", name, m->value, limit, baseline, tolerance);
+            regressions++;
+        } else if (m->value < baseline) {
+            printf("improved   %-36s %llu < %llu\n", name, m->value, baseline);
+            improvements++;
+        } else {
+            printf("ok         %-36s %llu\n", name, m->value);
+        }
+    }
+    fclose(fp);
+    
+    printf("perf_gate: %d metrics checked, %d regressions, %d improvements\n", checked, regressions, improvements);
+    if (improvements > 0 && regressions == 0) {
+        printf("perf_gate: costs went down, consider refreshing the baseline with --update\n");
+    }
+    return regressions > 0 || checked == 0;
+}
+
+static void usage(void) {
+    printf("Usage: perf_gate [--update] BASELINE\n");
+    printf("Run the traversal modes over a fixed fixture tree and compare\n");
+    printf("deterministic cost counters against BASELINE. --update rewrites\n");
+    printf("BASELINE from the current build instead of checking it.\n");
+}
+
+int main(int argc, char *argv[]) {
+    int update = 0;
+    const char *baseline = NULL;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--update") == 0) {
+            update = 1;
+        } else if (strcmp(argv[i], "--help") == 0) {
+            usage();
+            return 0;
+        } else if (!baseline) {
+            baseline = argv[i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (!baseline) {
+        usage();
+        return 1;
+    }
+    
+    setlocale(LC_ALL, "");
+    
+    // Fixed-length root so path_bytes does not depend on the temp name
+    char root[] = "/tmp/findmax_gate_XXXXXX";
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    
+    unsigned counter = 0;
+    generate_tree(root, 0, &counter);
+    char gitignore[MAX_PATH_LEN];
+    snprintf(gitignore, sizeof(gitignore), "%s/.gitignore", root);
+    FILE *fp = fopen(gitignore, "w");
+    if (fp) {
+        fprintf(fp, "*.tmp\ndir_1_3/\n");
+        fclose(fp);
+    }
+    
+    for (size_t c = 0; c < sizeof(gate_cases) / sizeof(gate_cases[0]); c++) {
+        run_case(&gate_cases[c], root);
+    }
+    
+    char cmd[MAX_PATH_LEN + 16];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "perf_gate: failed to remove %s\n", root);
+    }
+    
+    return update ? write_baseline(baseline) : check_baseline(baseline);
+}
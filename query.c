@@ -0,0 +1,143 @@
+#include "findmax.h"
+
+// Several rankings from one traversal (--query, repeatable).
+//
+// Each query is a sort key list, a count and an optional type filter with
+// its own options and bounded heap. heap_offer() hands every entry that
+// passed the traversal's filters to query_set_offer(), which re-extracts
+// the key for each query from the one struct stat and inserts it into
+// that query's heap, so N newest, N oldest and N largest cost one stat
+// per entry instead of three walks.
+
+typedef struct {
+    char label[MAX_FORMAT_LEN];
+    options_t opts;
+    min_heap_t *heap;
+} query_t;
+
+struct query_set {
+    query_t queries[MAX_QUERIES];
+    int count;
+};
+
+// Parse [LABEL=]KEY[:asc|:desc][,KEY...][/N[/TYPES]] into query
+static int parse_query(query_t *query, const char *spec, const options_t *opts) {
+    char buf[MAX_FORMAT_LEN];
+    if (strlen(spec) >= sizeof(buf)) return -1;
+    strcpy(buf, spec);
+    
+    char *keys = buf;
+    char *eq = strchr(buf, '=');
+    if (eq) {
+        *eq = '\0';
+        keys = eq + 1;
+    }
+    snprintf(query->label, sizeof(query->label), "%s", eq ? buf : spec);
+    
+    query->opts = *opts;
+    query->opts.queries = NULL;
+    query->opts.group_map = NULL;
+    query->opts.snapshot_writer = NULL;
+    
+    char *count = strchr(keys, '/');
+    if (count) {
+        *count++ = '\0';
+        char *types = strchr(count, '/');
+        if (types) {
+            *types++ = '\0';
+            unsigned mask;
+            if (parse_type_list(types, &mask) != 0) return -1;
+            // Narrows a global --type, never widens it
+            query->opts.type_mask = (opts->predicates & PRED_TYPE) ? (opts->type_mask & mask) : mask;
+            query->opts.predicates |= PRED_TYPE;
+        }
+        char *endptr;
+        long n = strtol(count, &endptr, 10);
+        if (*count == '\0' || *endptr != '\0' || n <= 0 || n > 1000000) return -1;
+        query->opts.num_files = (int)n;
+    }
+    
+    // The key list replaces the global one; -r still applies
+    if (parse_sort_list(keys, &query->opts) != 0) return -1;
+    return sort_uses_score(&query->opts) && !opts->score ? -1 : 0;
+}
+
+query_set_t *query_set_create(const char **specs, int count, const options_t *opts) {
+    query_set_t *set = calloc(1, sizeof(query_set_t));
+    if (!set) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        query_t *query = &set->queries[i];
+        if (parse_query(query, specs[i], opts) != 0) {
+            fprintf(stderr, "findmax: invalid query '%s'\n", specs[i]);
+            query_set_free(set);
+            return NULL;
+        }
+        if (!(query->heap = create_min_heap(query->opts.num_files, &query->opts))) {
+            fprintf(stderr, "findmax: memory allocation failed\n");
+            query_set_free(set);
+            return NULL;
+        }
+        set->count++;
+    }
+    return set;
+}
+
+void query_set_free(query_set_t *set) {
+    if (!set) return;
+    for (int i = 0; i < set->count; i++) {
+        free_min_heap(set->queries[i].heap);
+    }
+    free(set);
+}
+
+int query_set_count(const query_set_t *set) {
+    return set->count;
+}
+
+min_heap_t *query_set_heap(const query_set_t *set, int index) {
+    return set->queries[index].heap;
+}
+
+// Offer one entry (path and st filled in) to every query it qualifies
+// for; returns 1 if any query kept it
+int query_set_offer(query_set_t *set, file_entry_t *entry) {
+    int kept = 0;
+    for (int i = 0; i < set->count; i++) {
+        query_t *query = &set->queries[i];
+        if ((query->opts.predicates & PRED_TYPE) &&
+            !(query->opts.type_mask & file_type_bit(entry->st.st_mode))) {
+            continue;
+        }
+        set_sort_key(entry, &query->opts);
+        kept |= heap_insert(query->heap, entry);
+    }
+    return kept;
+}
+
+// Print every query's results under a "LABEL:" header, in the order the
+// queries were given
+void query_set_print(query_set_t *set) {
+    for (int i = 0; i < set->count; i++) {
+        query_t *query = &set->queries[i];
+        file_list_t *results = create_file_list();
+        if (!results) {
+            fprintf(stderr, "findmax: memory allocation failed\n");
+            return;
+        }
+        file_entry_t *entries = get_heap_entries(query->heap);
+        size_t size = get_heap_size(query->heap);
+        for (size_t j = 0; j < size; j++) {
+            if (add_file_entry(results, entries[j].path, &entries[j].st, &query->opts) != 0) break;
+        }
+        sort_files(results, &query->opts);
+        
+        printf("%s%s:\n", i ? "\n" : "", query->label);
+        for (size_t j = 0; j < results->count; j++) {
+            print_file_entry(&results->entries[j], &query->opts);
+        }
+        free_file_list(results);
+    }
+}
@@ -0,0 +1,344 @@
+#include "findmax.h"
+#include <math.h>
+
+// Score expressions for --score.
+//
+// An expression such as "size * (now - atime)" is parsed once by a small
+// recursive-descent parser into bytecode for a stack machine, then run
+// for every candidate. Constant subexpressions are folded as they are
+// emitted: "now" is read when the expression is compiled, so terms like
+// "now - 30*86400" become a single constant and only the parts that
+// depend on the entry are left for the per-file loop. Arithmetic is done
+// in doubles so products of sizes and ages cannot overflow; set_sort_key()
+// packs the result into an order-preserving 64-bit key for the heap.
+
+#define SCORE_MAX_CODE 128
+#define SCORE_MAX_STACK 32
+
+typedef enum {
+    OP_CONST,
+    OP_FIELD,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_NEG,
+    OP_MIN,
+    OP_MAX,
+    OP_LOG,
+    OP_END
+} score_opcode_t;
+
+// Fields an expression can read; the sort keys plus owner ids
+typedef enum {
+    FIELD_SIZE,
+    FIELD_BLOCKS,
+    FIELD_MTIME,
+    FIELD_ATIME,
+    FIELD_CTIME,
+    FIELD_BTIME,
+    FIELD_LINKS,
+    FIELD_DEPTH,
+    FIELD_PATHLEN,
+    FIELD_UID,
+    FIELD_GID
+} score_field_t;
+
+typedef struct {
+    score_opcode_t code;
+    score_field_t field;
+    double value;
+} score_op_t;
+
+struct score_program {
+    score_op_t code[SCORE_MAX_CODE];
+    int length;
+};
+
+typedef struct {
+    const char *expr;
+    const char *pos;
+    score_program_t *program;
+    int depth;  // stack depth after the code emitted so far
+    int max_depth;
+    time_t now;
+    int failed;
+} score_parser_t;
+
+static const struct {
+    const char *name;
+    score_field_t field;
+} score_fields[] = {
+    { "size", FIELD_SIZE },
+    { "blocks", FIELD_BLOCKS },
+    { "mtime", FIELD_MTIME },
+    { "atime", FIELD_ATIME },
+    { "ctime", FIELD_CTIME },
+    { "btime", FIELD_BTIME },
+    { "links", FIELD_LINKS },
+    { "depth", FIELD_DEPTH },
+    { "pathlen", FIELD_PATHLEN },
+    { "uid", FIELD_UID },
+    { "gid", FIELD_GID },
+};
+
+static void parse_error(score_parser_t *parser, const char *message) {
+    if (!parser->failed) {
+        fprintf(stderr, "findmax: invalid score '%s' at column %d: %s\n",
+                parser->expr, (int)(parser->pos - parser->expr) + 1, message);
+    }
+    parser->failed = 1;
+}
+
+static double apply(score_opcode_t code, double a, double b) {
+    switch (code) {
+        case OP_ADD: return a + b;
+        case OP_SUB: return a - b;
+        case OP_MUL: return a * b;
+        case OP_DIV: return b != 0 ? a / b : 0;  // a zero divisor scores 0
+        case OP_NEG: return -a;
+        case OP_MIN: return a < b ? a : b;
+        case OP_MAX: return a > b ? a : b;
+        case OP_LOG: return a > 0 ? log(a) : 0;
+        default: return 0;
+    }
+}
+
+static int is_const(const score_program_t *program, int index) {
+    return index >= 0 && program->code[index].code == OP_CONST;
+}
+
+// Append one instruction. An operator whose operands were all constants
+// (each operand is then exactly one OP_CONST, the last ones emitted) is
+// replaced by the constant it computes.
+static void emit(score_parser_t *parser, score_opcode_t code, score_field_t field, double value) {
+    score_program_t *program = parser->program;
+    int n = program->length;
+    int arity = (code == OP_CONST || code == OP_FIELD) ? 0 : (code == OP_NEG || code == OP_LOG) ? 1 : 2;
+    
+    if (arity == 1 && is_const(program, n - 1)) {
+        program->code[n - 1].value = apply(code, program->code[n - 1].value, 0);
+        return;
+    }
+    if (arity == 2 && is_const(program, n - 1) && is_const(program, n - 2)) {
+        program->code[n - 2].value = apply(code, program->code[n - 2].value, program->code[n - 1].value);
+        program->length--;
+        parser->depth--;
+        return;
+    }
+    
+    if (n >= SCORE_MAX_CODE - 1) {
+        parse_error(parser, "expression too long");
+        return;
+    }
+    program->code[n].code = code;
+    program->code[n].field = field;
+    program->code[n].value = value;
+    program->length++;
+    parser->depth += arity == 0 ? 1 : 1 - arity;
+    if (parser->depth > parser->max_depth) parser->max_depth = parser->depth;
+}
+
+static void skip_space(score_parser_t *parser) {
+    while (isspace((unsigned char)*parser->pos)) parser->pos++;
+}
+
+static int accept(score_parser_t *parser, char c) {
+    skip_space(parser);
+    if (*parser->pos != c) return 0;
+    parser->pos++;
+    return 1;
+}
+
+static void parse_sum(score_parser_t *parser);
+
+// Parenthesised argument list of a function with the given arity
+static void parse_arguments_of(score_parser_t *parser, int arity) {
+    if (!accept(parser, '(')) {
+        parse_error(parser, "expected '('");
+        return;
+    }
+    for (int i = 0; i < arity; i++) {
+        if (i > 0 && !accept(parser, ',')) {
+            parse_error(parser, "expected ','");
+            return;
+        }
+        parse_sum(parser);
+    }
+    if (!accept(parser, ')')) {
+        parse_error(parser, "expected ')'");
+    }
+}
+
+static void parse_name(score_parser_t *parser) {
+    const char *start = parser->pos;
+    while (isalnum((unsigned char)*parser->pos) || *parser->pos == '_') parser->pos++;
+    size_t len = (size_t)(parser->pos - start);
+    // Accept the struct stat spelling too (st_size, st_atime, ...)
+    if (len > 3 && strncmp(start, "st_", 3) == 0) {
+        start += 3;
+        len -= 3;
+    }
+    
+    if (len == 3 && strncmp(start, "now", 3) == 0) {
+        emit(parser, OP_CONST, 0, (double)parser->now);
+        return;
+    }
+    if (len == 3 && (strncmp(start, "min", 3) == 0 || strncmp(start, "max", 3) == 0)) {
+        parse_arguments_of(parser, 2);
+        emit(parser, start[1] == 'i' ? OP_MIN : OP_MAX, 0, 0);
+        return;
+    }
+    if (len == 3 && strncmp(start, "log", 3) == 0) {
+        parse_arguments_of(parser, 1);
+        emit(parser, OP_LOG, 0, 0);
+        return;
+    }
+    for (size_t i = 0; i < sizeof(score_fields) / sizeof(score_fields[0]); i++) {
+        if (strlen(score_fields[i].name) == len && strncmp(start, score_fields[i].name, len) == 0) {
+            emit(parser, OP_FIELD, score_fields[i].field, 0);
+            return;
+        }
+    }
+    parser->pos = start;
+    parse_error(parser, "unknown name");
+}
+
+// primary: NUMBER [unit] | NAME | FUNC(args) | (sum) | -primary
+static void parse_primary(score_parser_t *parser) {
+    skip_space(parser);
+    char c = *parser->pos;
+    if (accept(parser, '-')) {
+        parse_primary(parser);
+        emit(parser, OP_NEG, 0, 0);
+    } else if (accept(parser, '(')) {
+        parse_sum(parser);
+        if (!accept(parser, ')')) parse_error(parser, "expected ')'");
+    } else if (isdigit((unsigned char)c) || c == '.') {
+        char *endptr;
+        double value = strtod(parser->pos, &endptr);
+        parser->pos = endptr;
+        // Binary size suffixes as for --min-size, durations as for --newer
+        switch (*parser->pos) {
+            case 'K': value *= 1024.0; parser->pos++; break;
+            case 'M': value *= 1024.0 * 1024; parser->pos++; break;
+            case 'G': value *= 1024.0 * 1024 * 1024; parser->pos++; break;
+            case 'T': value *= 1024.0 * 1024 * 1024 * 1024; parser->pos++; break;
+            case 's': parser->pos++; break;
+            case 'm': value *= 60; parser->pos++; break;
+            case 'h': value *= 3600; parser->pos++; break;
+            case 'd': value *= 86400; parser->pos++; break;
+            case 'w': value *= 7 * 86400; parser->pos++; break;
+            default: break;
+        }
+        emit(parser, OP_CONST, 0, value);
+    } else if (isalpha((unsigned char)c) || c == '_') {
+        parse_name(parser);
+    } else {
+        parse_error(parser, c ? "unexpected character" : "unexpected end");
+    }
+}
+
+static void parse_product(score_parser_t *parser) {
+    parse_primary(parser);
+    while (!parser->failed) {
+        if (accept(parser, '*')) {
+            parse_primary(parser);
+            emit(parser, OP_MUL, 0, 0);
+        } else if (accept(parser, '/')) {
+            parse_primary(parser);
+            emit(parser, OP_DIV, 0, 0);
+        } else {
+            break;
+        }
+    }
+}
+
+static void parse_sum(score_parser_t *parser) {
+    parse_product(parser);
+    while (!parser->failed) {
+        if (accept(parser, '+')) {
+            parse_product(parser);
+            emit(parser, OP_ADD, 0, 0);
+        } else if (accept(parser, '-')) {
+            parse_product(parser);
+            emit(parser, OP_SUB, 0, 0);
+        } else {
+            break;
+        }
+    }
+}
+
+score_program_t *score_compile(const char *expr, time_t now) {
+    score_program_t *program = calloc(1, sizeof(score_program_t));
+    if (!program) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
+        return NULL;
+    }
+    score_parser_t parser = { expr, expr, program, 0, 0, now, 0 };
+    parse_sum(&parser);
+    skip_space(&parser);
+    if (!parser.failed && *parser.pos) {
+        parse_error(&parser, "unexpected character");
+    }
+    if (!parser.failed && parser.max_depth > SCORE_MAX_STACK) {
+        parse_error(&parser, "expression nested too deeply");
+    }
+    if (parser.failed) {
+        free(program);
+        return NULL;
+    }
+    program->code[program->length].code = OP_END;
+    return program;
+}
+
+void score_free(score_program_t *program) {
+    free(program);
+}
+
+// Number of instructions left after folding, for tests and benchmarks
+int score_length(const score_program_t *program) {
+    return program->length;
+}
+
+static double field_value(score_field_t field, const char *path, const struct stat *st) {
+    switch (field) {
+        case FIELD_SIZE: return (double)st->st_size;
+        case FIELD_BLOCKS: return (double)st->st_blocks * 512;
+        case FIELD_MTIME: return (double)st->st_mtime;
+        case FIELD_ATIME: return (double)st->st_atime;
+        case FIELD_CTIME: return (double)st->st_ctime;
+        case FIELD_BTIME: return (double)sort_keys[SORT_BTIME].extract(path, st);
+        case FIELD_LINKS: return (double)st->st_nlink;
+        case FIELD_DEPTH: return (double)sort_keys[SORT_DEPTH].extract(path, st);
+        case FIELD_PATHLEN: return (double)sort_keys[SORT_PATHLEN].extract(path, st);
+        case FIELD_UID: return (double)st->st_uid;
+        case FIELD_GID: return (double)st->st_gid;
+        default: return 0;
+    }
+}
+
+double score_eval(const score_program_t *program, const char *path, const struct stat *st) {
+    double stack[SCORE_MAX_STACK];
+    int sp = 0;
+    for (const score_op_t *op = program->code; ; op++) {
+        switch (op->code) {
+            case OP_CONST:
+                stack[sp++] = op->value;
+                break;
+            case OP_FIELD:
+                stack[sp++] = field_value(op->field, path, st);
+                break;
+            case OP_NEG:
+            case OP_LOG:
+                stack[sp - 1] = apply(op->code, stack[sp - 1], 0);
+                break;
+            case OP_END:
+                return sp ? stack[0] : 0;
+            default:
+                sp--;
+                stack[sp - 1] = apply(op->code, stack[sp - 1], stack[sp]);
+                break;
+        }
+    }
+}
@@ -0,0 +1,180 @@
+#include "findmax.h"
+
+// Splitting one walk between processes (--shard K/N) and combining their
+// results (--merge).
+//
+// Every entry down to --shard-depth belongs to the shard picked by a hash
+// of its path relative to the root argument, and everything below a
+// directory at that depth belongs to the directory's shard. The hash
+// depends on nothing but the relative path, so N processes given the same
+// roots (on any host, in any directory order) agree on the split without
+// talking to each other and together offer every entry exactly once. A
+// shard skips the subtrees it does not own without stat()ing them; only
+// the directories above the shard depth are read by all of them.
+//
+// A shard prints its local top-N as records that keep everything the
+// ranking and -F need: one line per entry, the stat fields in decimal
+// (mode in octal) and then the path, with backslash and newline escaped.
+// --merge reads those records and ranks them again as a traversal would;
+// the global top-N is always among the union of the local ones.
+
+#define SHARD_HEADER "# findmax shard"
+
+int parse_shard(const char *arg, options_t *opts) {
+    char *endptr;
+    long k = strtol(arg, &endptr, 10);
+    if (endptr == arg || *endptr != '/') return -1;
+    const char *n_arg = endptr + 1;
+    long n = strtol(n_arg, &endptr, 10);
+    if (endptr == n_arg || *endptr != '\0' || n < 1 || n > 65536 || k < 1 || k > n) return -1;
+    opts->shard_index = (int)k;
+    opts->shard_count = (int)n;
+    return 0;
+}
+
+// Shard (1..N) of a path relative to its root
+static int shard_of(const char *relative, int count) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (const unsigned char *p = (const unsigned char *)relative; *p; p++) {
+        h = (h ^ *p) * 0x100000001B3ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return (int)(h % (uint64_t)count) + 1;
+}
+
+// Whether this process owns path, found under a root argument that is its
+// first root_len bytes. Only asked down to --shard-depth; deeper entries
+// share their ancestor's shard.
+int shard_owns(const char *path, size_t root_len, const options_t *opts) {
+    const char *relative = path + root_len;
+    while (*relative == '/') relative++;
+    return shard_of(relative, opts->shard_count) == opts->shard_index;
+}
+
+static void print_escaped_path(const char *path) {
+    for (const char *p = path; *p; p++) {
+        if (*p == '\\') fputs("\\\\", stdout);
+        else if (*p == '\n') fputs("\\n", stdout);
+        else putchar(*p);
+    }
+}
+
+// Print a shard's results as merge records
+void print_shard_records(const file_entry_t *entries, size_t count, const options_t *opts) {
+    printf("%s %d/%d\n", SHARD_HEADER, opts->shard_index, opts->shard_count);
+    for (size_t i = 0; i < count; i++) {
+        const struct stat *st = &entries[i].st;
+        printf("%lo %lu %lu %lu %llu %llu %lld %lld %lld %lld %lld %lld ",
+               (unsigned long)st->st_mode, (unsigned long)st->st_uid, (unsigned long)st->st_gid,
+               (unsigned long)st->st_nlink, (unsigned long long)st->st_dev,
+               (unsigned long long)st->st_ino, (long long)st->st_size, (long long)st->st_blocks,
+               (long long)st->st_atime, (long long)st->st_mtime, (long long)st->st_ctime,
+               (long long)sort_keys[SORT_BTIME].extract(entries[i].path, st));
+        print_escaped_path(entries[i].path);
+        putchar('\n');
+    }
+}
+
+// Parse one record line into path and st; returns 0 on success
+static int parse_record(char *line, char *path, struct stat *st) {
+    unsigned long mode, uid, gid, nlink;
+    unsigned long long dev, ino;
+    long long size, blocks, atime, mtime, ctime, btime;
+    int consumed = 0;
+    if (sscanf(line, "%lo %lu %lu %lu %llu %llu %lld %lld %lld %lld %lld %lld%n",
+               &mode, &uid, &gid, &nlink, &dev, &ino, &size, &blocks,
+               &atime, &mtime, &ctime, &btime, &consumed) != 12 || line[consumed] != ' ') {
+        return -1;
+    }
+    
+    memset(st, 0, sizeof(*st));
+    st->st_mode = (mode_t)mode;
+    st->st_uid = (uid_t)uid;
+    st->st_gid = (gid_t)gid;
+    st->st_nlink = (nlink_t)nlink;
+    st->st_dev = (dev_t)dev;
+    st->st_ino = (ino_t)ino;
+    st->st_size = (off_t)size;
+    st->st_blocks = (blkcnt_t)blocks;
+    st->st_atime = (time_t)atime;
+    st->st_mtime = (time_t)mtime;
+    st->st_ctime = (time_t)ctime;
+#ifdef __APPLE__
+    st->st_birthtime = (time_t)btime;
+#else
+    (void)btime;
+#endif
+    
+    size_t len = 0;
+    // Exactly one space before the path, which may itself start with one
+    for (const char *p = line + consumed + 1; *p; p++) {
+        if (len + 1 >= MAX_PATH_LEN) return -1;
+        if (*p == '\\') {
+            p++;
+            if (*p == 'n') path[len++] = '\n';
+            else if (*p == '\\') path[len++] = '\\';
+            else return -1;
+        } else {
+            path[len++] = *p;
+        }
+    }
+    path[len] = '\0';
+    return len > 0 ? 0 : -1;
+}
+
+// Offer every record of one shard output file (- for stdin) to the heap
+static int merge_file(const char *file, const options_t *opts, min_heap_t *heap) {
+    FILE *in = strcmp(file, "-") == 0 ? stdin : fopen(file, "r");
+    if (!in) {
+        perror(file);
+        return -1;
+    }
+    
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t len;
+    size_t number = 0;
+    int failed = 0;
+    char path[MAX_PATH_LEN];
+    while ((len = getline(&line, &capacity, in)) != -1) {
+        number++;
+        if (len > 0 && line[len - 1] == '\n') {
+            line[--len] = '\0';
+        }
+        if (len == 0 || line[0] == '#') {
+            continue;
+        }
+        struct stat st;
+        if (parse_record(line, path, &st) != 0) {
+            fprintf(stderr, "findmax: %s:%zu: not a shard record\n", file, number);
+            failed = 1;
+            continue;
+        }
+        STATS_INC(entries_read);
+        if (should_include_name(path, opts) && should_include_file(&st, opts)) {
+            heap_offer(heap, path, &st, opts);
+        }
+    }
+    
+    if (ferror(in)) {
+        perror(file);
+        failed = 1;
+    }
+    free(line);
+    if (in != stdin) {
+        fclose(in);
+    }
+    return failed ? -1 : 0;
+}
+
+int traverse_merge(char **files, int file_count, const options_t *opts, min_heap_t *heap) {
+    int failed = 0;
+    for (int i = 0; i < file_count; i++) {
+        if (merge_file(files[i], opts, heap) != 0) {
+            failed = 1;
+        }
+    }
+    return failed ? -1 : 0;
+}
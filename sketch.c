@@ -0,0 +1,250 @@
+#include "findmax.h"
+
+// Distribution sketches for --histogram and --quantiles.
+//
+// Every entry offered to the heap is also counted here, under the value
+// of the active sort key (an age for time keys, the size when sorting by
+// name, a --score rounded down with negatives as 0). Values go into fixed
+// log-linear buckets: values below 64 exactly, larger ones by their power
+// of two and the next six bits, so a bucket spans at most 1/64 of its
+// value. Finding the bucket is a count of leading zeros and a shift,
+// memory is a fixed 30 KiB whatever the tree size, and both the log2
+// histogram and quantiles (within 1.6%) are read from the same counters.
+
+#define SUB_BITS 6
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define BUCKETS ((64 - SUB_BITS + 1) * SUB_BUCKETS)
+#define TYPE_SLOTS 8
+
+typedef enum {
+    UNIT_COUNT,
+    UNIT_BYTES,
+    UNIT_SECONDS
+} value_unit_t;
+
+struct sketch {
+    uint64_t buckets[BUCKETS];
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t type_count[TYPE_SLOTS];
+    uint64_t type_bytes[TYPE_SLOTS];
+    sort_type_t key;
+    value_unit_t unit;
+    time_t now;
+};
+
+static int leading_zeros(uint64_t v) {
+#if defined(__GNUC__)
+    return __builtin_clzll(v);
+#else
+    int n = 0;
+    while (!(v & (1ULL << 63))) {
+        v <<= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static size_t bucket_of(uint64_t v) {
+    if (v < SUB_BUCKETS) return (size_t)v;
+    int exp = 63 - leading_zeros(v);
+    size_t sub = (size_t)(v >> (exp - SUB_BITS)) & (SUB_BUCKETS - 1);
+    return (size_t)(exp - SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+// Smallest value in a bucket
+static uint64_t bucket_low(size_t index) {
+    if (index < SUB_BUCKETS) return index;
+    int exp = (int)(index / SUB_BUCKETS) + SUB_BITS - 1;
+    return (uint64_t)(SUB_BUCKETS + index % SUB_BUCKETS) << (exp - SUB_BITS);
+}
+
+static uint64_t bucket_high(size_t index) {
+    if (index < SUB_BUCKETS) return index;
+    int exp = (int)(index / SUB_BUCKETS) + SUB_BITS - 1;
+    return ((uint64_t)(SUB_BUCKETS + index % SUB_BUCKETS + 1) << (exp - SUB_BITS)) - 1;
+}
+
+static int type_slot(mode_t mode) {
+    unsigned bit = file_type_bit(mode);
+    int slot = 0;
+    while (bit > 1) {
+        bit >>= 1;
+        slot++;
+    }
+    return bit ? slot + 1 : 0;
+}
+
+sketch_t *sketch_create(const options_t *opts) {
+    sketch_t *sketch = calloc(1, sizeof(sketch_t));
+    if (!sketch) return NULL;
+    sketch->min = UINT64_MAX;
+    sketch->key = opts->sort_type;
+    sketch->now = time(NULL);
+    if (sort_keys[sketch->key].is_time) {
+        sketch->unit = UNIT_SECONDS;
+    } else if (sketch->key == SORT_SIZE || sketch->key == SORT_BLOCKS || sketch->key == SORT_NAME) {
+        sketch->unit = UNIT_BYTES;
+    } else {
+        sketch->unit = UNIT_COUNT;
+    }
+    return sketch;
+}
+
+void sketch_free(sketch_t *sketch) {
+    free(sketch);
+}
+
+// Count an entry whose sort_key is already set, so a score is read back
+// from it rather than evaluated again
+void sketch_add(sketch_t *sketch, const file_entry_t *entry) {
+    const struct stat *st = &entry->st;
+    int64_t value;
+    if (sketch->key == SORT_NAME) {
+        value = (int64_t)st->st_size;
+    } else if (sketch->key == SORT_SCORE) {
+        double score = score_value(entry->sort_key);
+        value = score < 9.2e18 ? (int64_t)score : INT64_MAX;
+    } else {
+        value = sort_keys[sketch->key].extract(entry->path, st);
+        if (sketch->unit == UNIT_SECONDS) value = (int64_t)sketch->now - value;
+    }
+    uint64_t v = value > 0 ? (uint64_t)value : 0;
+    
+    sketch->buckets[bucket_of(v)]++;
+    sketch->count++;
+    if (v < sketch->min) sketch->min = v;
+    if (v > sketch->max) sketch->max = v;
+    
+    int slot = type_slot(st->st_mode);
+    sketch->type_count[slot]++;
+    sketch->type_bytes[slot] += (uint64_t)st->st_size;
+}
+
+static void format_value(uint64_t v, value_unit_t unit, char *buf, size_t size) {
+    static const char *const byte_units[] = { "B", "KiB", "MiB", "GiB", "TiB", "PiB", "EiB" };
+    switch (unit) {
+        case UNIT_BYTES:
+            {
+                int u = 0;
+                double d = (double)v;
+                while (d >= 1024 && u < 6) {
+                    d /= 1024;
+                    u++;
+                }
+                if (u == 0) snprintf(buf, size, "%llu B", (unsigned long long)v);
+                else snprintf(buf, size, "%.1f %s", d, byte_units[u]);
+            }
+            break;
+        case UNIT_SECONDS:
+            if (v < 120) snprintf(buf, size, "%llus", (unsigned long long)v);
+            else if (v < 7200) snprintf(buf, size, "%.1fm", v / 60.0);
+            else if (v < 172800) snprintf(buf, size, "%.1fh", v / 3600.0);
+            else snprintf(buf, size, "%.1fd", v / 86400.0);
+            break;
+        case UNIT_COUNT:
+        default:
+            snprintf(buf, size, "%llu", (unsigned long long)v);
+            break;
+    }
+}
+
+// Value at quantile q (0..1): the middle of the bucket holding that rank,
+// clamped to the exact extremes
+uint64_t sketch_quantile(const sketch_t *sketch, double q) {
+    if (!sketch->count) return 0;
+    if (q <= 0) return sketch->min;
+    if (q >= 1) return sketch->max;
+    uint64_t rank = (uint64_t)(q * (double)sketch->count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > sketch->count) rank = sketch->count;
+    
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += sketch->buckets[i];
+        if (seen >= rank) {
+            uint64_t mid = bucket_low(i) + (bucket_high(i) - bucket_low(i)) / 2;
+            if (mid < sketch->min) mid = sketch->min;
+            if (mid > sketch->max) mid = sketch->max;
+            return mid;
+        }
+    }
+    return sketch->max;
+}
+
+static void print_histogram(const sketch_t *sketch) {
+    // Fold the fine buckets into powers of two: [0], [1], [2, 4), ...
+    uint64_t log2_counts[65] = {0};
+    for (size_t i = 0; i < BUCKETS; i++) {
+        if (!sketch->buckets[i]) continue;
+        uint64_t low = bucket_low(i);
+        log2_counts[low ? 64 - leading_zeros(low) : 0] += sketch->buckets[i];
+    }
+    
+    uint64_t peak = 0;
+    for (int b = 0; b <= 64; b++) {
+        if (log2_counts[b] > peak) peak = log2_counts[b];
+    }
+    
+    printf("histogram of %s:\n", sketch->unit == UNIT_SECONDS ? "age" : sort_keys[sketch->key].name);
+    for (int b = 0; b <= 64; b++) {
+        if (!log2_counts[b]) continue;
+        char low[32], high[32];
+        format_value(b ? 1ULL << (b - 1) : 0, sketch->unit, low, sizeof(low));
+        if (b == 0) {
+            snprintf(high, sizeof(high), "%s", low);
+        } else {
+            format_value(b < 64 ? (1ULL << b) - 1 : UINT64_MAX, sketch->unit, high, sizeof(high));
+        }
+        int width = (int)(40 * log2_counts[b] / peak);
+        printf("  %10s .. %-10s %12llu %5.1f%% ", low, high,
+               (unsigned long long)log2_counts[b], 100.0 * log2_counts[b] / sketch->count);
+        for (int i = 0; i < (width ? width : 1); i++) putchar('#');
+        putchar('\n');
+    }
+}
+
+static void print_types(const sketch_t *sketch) {
+    static const char *const type_names[TYPE_SLOTS] = {
+        "other", "file", "dir", "symlink", "socket", "fifo", "block", "char"
+    };
+    uint64_t bytes = 0;
+    for (int t = 0; t < TYPE_SLOTS; t++) bytes += sketch->type_bytes[t];
+    
+    char total[32];
+    format_value(bytes, UNIT_BYTES, total, sizeof(total));
+    printf("entries: %llu, %s total\n", (unsigned long long)sketch->count, total);
+    for (int t = 0; t < TYPE_SLOTS; t++) {
+        if (!sketch->type_count[t]) continue;
+        format_value(sketch->type_bytes[t], UNIT_BYTES, total, sizeof(total));
+        printf("  %-8s %12llu  %s\n", type_names[t], (unsigned long long)sketch->type_count[t], total);
+    }
+}
+
+// Print after the results: totals per type, then quantiles and the
+// histogram as requested
+void sketch_print(const sketch_t *sketch, const options_t *opts) {
+    printf("\n");
+    print_types(sketch);
+    if (!sketch->count) return;
+    
+    if (opts->quantile_count > 0) {
+        char value[32];
+        printf("quantiles of %s:\n", sketch->unit == UNIT_SECONDS ? "age" : sort_keys[sketch->key].name);
+        format_value(sketch->min, sketch->unit, value, sizeof(value));
+        printf("  %-6s %s\n", "min", value);
+        for (int i = 0; i < opts->quantile_count; i++) {
+            char label[16];
+            snprintf(label, sizeof(label), "p%g", opts->quantiles[i]);
+            format_value(sketch_quantile(sketch, opts->quantiles[i] / 100.0), sketch->unit, value, sizeof(value));
+            printf("  %-6s %s\n", label, value);
+        }
+        format_value(sketch->max, sketch->unit, value, sizeof(value));
+        printf("  %-6s %s\n", "max", value);
+    }
+    if (opts->histogram) {
+        print_histogram(sketch);
+    }
+}
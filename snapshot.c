@@ -0,0 +1,557 @@
+#include "findmax.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+
+// Metadata snapshots for --save-snapshot / --from-snapshot.
+//
+// A snapshot is a single file that is mmap()ed read-only and scanned
+// front to back. After a fixed header come the metadata columns, one
+// array per stat field in record order, then the paths. Paths are
+// front-coded: each record stores the length of the prefix it shares with
+// the previous path and only the remaining bytes. Readers decode front to
+// back, so only the first path is stored in full. A depth-first scan
+// keeps siblings adjacent, which is what makes the shared prefixes long.
+//
+// Integers are stored in host byte order; the header records it so a
+// snapshot moved to a machine of the other endianness is rejected.
+
+#define SNAPSHOT_MAGIC "FMXSNAP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t count;
+    uint64_t paths_offset;
+    uint64_t paths_size;
+    uint64_t created;
+} snapshot_header_t;
+
+// 64-bit columns first, then 32-bit ones, so every column stays aligned
+typedef enum {
+    COL_DEV,
+    COL_INO,
+    COL_SIZE,
+    COL_BLOCKS,
+    COL_MTIME,
+    COL_ATIME,
+    COL_CTIME,
+    COL_WIDE_COUNT
+} snapshot_wide_column_t;
+
+typedef enum {
+    COL_MODE,
+    COL_UID,
+    COL_GID,
+    COL_NLINK,
+    COL_NARROW_COUNT
+} snapshot_narrow_column_t;
+
+struct snapshot_writer {
+    char *file;
+    uint64_t *wide[COL_WIDE_COUNT];
+    uint32_t *narrow[COL_NARROW_COUNT];
+    size_t count;
+    size_t capacity;
+    unsigned char *paths;
+    size_t paths_size;
+    size_t paths_capacity;
+    char previous[MAX_PATH_LEN];
+    size_t previous_len;
+    int failed;
+};
+
+struct snapshot {
+    unsigned char *map;
+    size_t map_size;
+    const snapshot_header_t *header;
+    const uint64_t *wide[COL_WIDE_COUNT];
+    const uint32_t *narrow[COL_NARROW_COUNT];
+    const unsigned char *paths;
+    const unsigned char *paths_end;
+    // Sequential cursor for snapshot_next()
+    size_t index;
+    const unsigned char *cursor;
+    char path[MAX_PATH_LEN];
+    size_t path_len;
+    // The findmaxd client snapshot_query_roots() answers for, if set
+    int has_reader;
+    uid_t reader_uid;
+    gid_t *reader_groups;
+    int reader_group_count;
+};
+
+static size_t column_offset(uint64_t count, int wide_column, int narrow_column) {
+    size_t offset = sizeof(snapshot_header_t);
+    offset += (size_t)count * sizeof(uint64_t) * (size_t)wide_column;
+    offset += (size_t)count * sizeof(uint32_t) * (size_t)narrow_column;
+    return offset;
+}
+
+static size_t align8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+static void put_varint(unsigned char *out, size_t *pos, uint64_t value) {
+    while (value >= 0x80) {
+        out[(*pos)++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[(*pos)++] = (unsigned char)value;
+}
+
+static int get_varint(const unsigned char **p, const unsigned char *end, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*p >= end) return -1;
+        unsigned char byte = *(*p)++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+snapshot_writer_t *snapshot_create(const char *file) {
+    snapshot_writer_t *writer = calloc(1, sizeof(snapshot_writer_t));
+    if (!writer) return NULL;
+    writer->file = strdup(file);
+    if (!writer->file) {
+        free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+static int writer_grow(snapshot_writer_t *writer) {
+    size_t new_capacity = writer->capacity ? writer->capacity * 2 : 1024;
+    for (int c = 0; c < COL_WIDE_COUNT; c++) {
+        uint64_t *column = realloc(writer->wide[c], sizeof(uint64_t) * new_capacity);
+        if (!column) return -1;
+        writer->wide[c] = column;
+    }
+    for (int c = 0; c < COL_NARROW_COUNT; c++) {
+        uint32_t *column = realloc(writer->narrow[c], sizeof(uint32_t) * new_capacity);
+        if (!column) return -1;
+        writer->narrow[c] = column;
+    }
+    writer->capacity = new_capacity;
+    return 0;
+}
+
+int snapshot_append(snapshot_writer_t *writer, const char *path, const struct stat *st) {
+    if (writer->failed) return -1;
+    if (writer->count >= writer->capacity && writer_grow(writer) != 0) {
+        writer->failed = 1;
+        return -1;
+    }
+    
+    // Worst case: two 10-byte varints and the whole path
+    size_t len = strlen(path);
+    if (writer->paths_size + len + 20 > writer->paths_capacity) {
+        size_t new_capacity = writer->paths_capacity ? writer->paths_capacity * 2 : 65536;
+        while (new_capacity < writer->paths_size + len + 20) new_capacity *= 2;
+        unsigned char *paths = realloc(writer->paths, new_capacity);
+        if (!paths) {
+            writer->failed = 1;
+            return -1;
+        }
+        writer->paths = paths;
+        writer->paths_capacity = new_capacity;
+    }
+    
+    size_t i = writer->count;
+    size_t shared = 0;
+    size_t limit = len < writer->previous_len ? len : writer->previous_len;
+    while (shared < limit && path[shared] == writer->previous[shared]) shared++;
+    put_varint(writer->paths, &writer->paths_size, shared);
+    put_varint(writer->paths, &writer->paths_size, len - shared);
+    memcpy(writer->paths + writer->paths_size, path + shared, len - shared);
+    writer->paths_size += len - shared;
+    
+    if (len < MAX_PATH_LEN) {
+        memcpy(writer->previous + shared, path + shared, len - shared + 1);
+        writer->previous_len = len;
+    }
+    
+    writer->wide[COL_DEV][i] = (uint64_t)st->st_dev;
+    writer->wide[COL_INO][i] = (uint64_t)st->st_ino;
+    writer->wide[COL_SIZE][i] = (uint64_t)st->st_size;
+    writer->wide[COL_BLOCKS][i] = (uint64_t)st->st_blocks;
+    writer->wide[COL_MTIME][i] = (uint64_t)st->st_mtime;
+    writer->wide[COL_ATIME][i] = (uint64_t)st->st_atime;
+    writer->wide[COL_CTIME][i] = (uint64_t)st->st_ctime;
+    writer->narrow[COL_MODE][i] = (uint32_t)st->st_mode;
+    writer->narrow[COL_UID][i] = (uint32_t)st->st_uid;
+    writer->narrow[COL_GID][i] = (uint32_t)st->st_gid;
+    writer->narrow[COL_NLINK][i] = (uint32_t)st->st_nlink;
+    writer->count++;
+    return 0;
+}
+
+static void free_writer(snapshot_writer_t *writer) {
+    for (int c = 0; c < COL_WIDE_COUNT; c++) free(writer->wide[c]);
+    for (int c = 0; c < COL_NARROW_COUNT; c++) free(writer->narrow[c]);
+    free(writer->paths);
+    free(writer->file);
+    free(writer);
+}
+
+static int write_all(FILE *fp, const void *data, size_t size) {
+    return size == 0 || fwrite(data, 1, size, fp) == size ? 0 : -1;
+}
+
+// Write the snapshot to FILE.tmp and rename it into place, so readers
+// never see a half-written file. Frees the writer either way.
+int snapshot_finish(snapshot_writer_t *writer) {
+    if (writer->failed) {
+        fprintf(stderr, "findmax: %s: memory allocation failed\n", writer->file);
+        free_writer(writer);
+        return -1;
+    }
+    
+    char tmp[MAX_PATH_LEN];
+    int ret = snprintf(tmp, sizeof(tmp), "%s.tmp", writer->file);
+    if (ret < 0 || (size_t)ret >= sizeof(tmp)) {
+        fprintf(stderr, "findmax: path too long: %s\n", writer->file);
+        free_writer(writer);
+        return -1;
+    }
+    
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        perror(tmp);
+        free_writer(writer);
+        return -1;
+    }
+    
+    size_t count = writer->count;
+    size_t paths_offset = align8(column_offset(count, COL_WIDE_COUNT, COL_NARROW_COUNT));
+    
+    snapshot_header_t header = {0};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.count = count;
+    header.paths_offset = paths_offset;
+    header.paths_size = writer->paths_size;
+    header.created = (uint64_t)time(NULL);
+    
+    static const unsigned char padding[8] = {0};
+    int failed = write_all(fp, &header, sizeof(header));
+    for (int c = 0; c < COL_WIDE_COUNT && !failed; c++) {
+        failed = write_all(fp, writer->wide[c], sizeof(uint64_t) * count);
+    }
+    for (int c = 0; c < COL_NARROW_COUNT && !failed; c++) {
+        failed = write_all(fp, writer->narrow[c], sizeof(uint32_t) * count);
+    }
+    if (!failed) {
+        failed = write_all(fp, padding, paths_offset - column_offset(count, COL_WIDE_COUNT, COL_NARROW_COUNT));
+    }
+    if (!failed) {
+        failed = write_all(fp, writer->paths, writer->paths_size);
+    }
+    if (fclose(fp) != 0) {
+        failed = 1;
+    }
+    
+    if (failed || rename(tmp, writer->file) != 0) {
+        perror(writer->file);
+        unlink(tmp);
+        free_writer(writer);
+        return -1;
+    }
+    
+    free_writer(writer);
+    return 0;
+}
+
+snapshot_t *snapshot_open(const char *file) {
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        perror(file);
+        return NULL;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(snapshot_header_t)) {
+        fprintf(stderr, "findmax: %s: not a findmax snapshot\n", file);
+        close(fd);
+        return NULL;
+    }
+    
+    unsigned char *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(file);
+        return NULL;
+    }
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+    
+    const snapshot_header_t *header = (const snapshot_header_t *)map;
+    size_t map_size = (size_t)st.st_size;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        header->version != SNAPSHOT_VERSION || header->byte_order != SNAPSHOT_BYTE_ORDER ||
+        header->count > map_size ||
+        header->paths_offset < column_offset(header->count, COL_WIDE_COUNT, COL_NARROW_COUNT) ||
+        header->paths_offset > map_size || header->paths_size > map_size - header->paths_offset) {
+        fprintf(stderr, "findmax: %s: not a findmax snapshot or unsupported version\n", file);
+        munmap(map, map_size);
+        return NULL;
+    }
+    
+    snapshot_t *snap = calloc(1, sizeof(snapshot_t));
+    if (!snap) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
+        munmap(map, map_size);
+        return NULL;
+    }
+    snap->map = map;
+    snap->map_size = map_size;
+    snap->header = header;
+    for (int c = 0; c < COL_WIDE_COUNT; c++) {
+        snap->wide[c] = (const uint64_t *)(map + column_offset(header->count, c, 0));
+    }
+    for (int c = 0; c < COL_NARROW_COUNT; c++) {
+        snap->narrow[c] = (const uint32_t *)(map + column_offset(header->count, COL_WIDE_COUNT, c));
+    }
+    snap->paths = map + header->paths_offset;
+    snap->paths_end = snap->paths + header->paths_size;
+    snapshot_rewind(snap);
+    return snap;
+}
+
+void snapshot_close(snapshot_t *snap) {
+    if (!snap) return;
+    munmap(snap->map, snap->map_size);
+    free(snap->reader_groups);
+    free(snap);
+}
+
+size_t snapshot_count(const snapshot_t *snap) {
+    return (size_t)snap->header->count;
+}
+
+void snapshot_rewind(snapshot_t *snap) {
+    snap->index = 0;
+    snap->cursor = snap->paths;
+    snap->path[0] = '\0';
+    snap->path_len = 0;
+}
+
+// Decode the next record into path and st. Returns 1 on success, 0 at the
+// end, -1 if the file is corrupt. Fields the snapshot does not keep are
+// zero in st.
+int snapshot_next(snapshot_t *snap, const char **path, struct stat *st) {
+    if (snap->index >= snap->header->count) {
+        return 0;
+    }
+    
+    uint64_t shared, suffix;
+    if (get_varint(&snap->cursor, snap->paths_end, &shared) != 0 ||
+        get_varint(&snap->cursor, snap->paths_end, &suffix) != 0 ||
+        shared > snap->path_len || shared + suffix >= MAX_PATH_LEN ||
+        suffix > (uint64_t)(snap->paths_end - snap->cursor)) {
+        return -1;
+    }
+    memcpy(snap->path + shared, snap->cursor, suffix);
+    snap->cursor += suffix;
+    snap->path_len = shared + suffix;
+    snap->path[snap->path_len] = '\0';
+    
+    size_t i = snap->index++;
+    memset(st, 0, sizeof(*st));
+    st->st_dev = (dev_t)snap->wide[COL_DEV][i];
+    st->st_ino = (ino_t)snap->wide[COL_INO][i];
+    st->st_size = (off_t)snap->wide[COL_SIZE][i];
+    st->st_blocks = (blkcnt_t)snap->wide[COL_BLOCKS][i];
+    st->st_mtime = (time_t)snap->wide[COL_MTIME][i];
+    st->st_atime = (time_t)snap->wide[COL_ATIME][i];
+    st->st_ctime = (time_t)snap->wide[COL_CTIME][i];
+    st->st_mode = (mode_t)snap->narrow[COL_MODE][i];
+    st->st_uid = (uid_t)snap->narrow[COL_UID][i];
+    st->st_gid = (gid_t)snap->narrow[COL_GID][i];
+    st->st_nlink = (nlink_t)snap->narrow[COL_NLINK][i];
+    *path = snap->path;
+    return 1;
+}
+
+// Answer a query from the snapshot: every record that passes the filters
+// is offered to the heap exactly as a traversal would.
+int snapshot_query(snapshot_t *snap, const options_t *opts, min_heap_t *heap) {
+    const char *path;
+    struct stat st;
+    int status;
+    
+    snapshot_rewind(snap);
+    while ((status = snapshot_next(snap, &path, &st)) > 0) {
+        STATS_INC(entries_read);
+        if (should_include_name(path, opts) && should_include_file(&st, opts)) {
+            heap_offer(heap, path, &st, opts);
+        }
+    }
+    if (status < 0) {
+        fprintf(stderr, "findmax: snapshot is corrupt after %zu records\n", snap->index);
+        return -1;
+    }
+    return 0;
+}
+
+// Answer queries for uid from now on: snapshot_query_roots() then lists
+// only what uid, with gid and its supplementary groups, could list
+int snapshot_set_reader(snapshot_t *snap, uid_t uid, gid_t gid) {
+    int count = 16;
+    gid_t *groups = NULL;
+    struct passwd *pw = getpwuid(uid);
+    for (;;) {
+        gid_t *grown = realloc(groups, sizeof(gid_t) * (size_t)count);
+        if (!grown) {
+            free(groups);
+            return -1;
+        }
+        groups = grown;
+        if (!pw) {
+            groups[0] = gid;
+            count = 1;
+            break;
+        }
+        int wanted = count;
+        if (getgrouplist(pw->pw_name, gid, groups, &wanted) >= 0) {
+            count = wanted;
+            break;
+        }
+        count = wanted > count ? wanted : count * 2;
+    }
+    free(snap->reader_groups);
+    snap->has_reader = 1;
+    snap->reader_uid = uid;
+    snap->reader_groups = groups;
+    snap->reader_group_count = count;
+    return 0;
+}
+
+// Whether the reader holds all the permission bits in want (as in
+// access(): 4 read, 1 search) on an entry, judged by its mode bits alone
+static int reader_may(const snapshot_t *snap, const struct stat *st, unsigned want) {
+    if (snap->reader_uid == 0) return 1;
+    unsigned bits;
+    if (st->st_uid == snap->reader_uid) {
+        bits = (unsigned)(st->st_mode >> 6) & 7;
+    } else {
+        bits = (unsigned)st->st_mode & 7;
+        for (int i = 0; i < snap->reader_group_count; i++) {
+            if (snap->reader_groups[i] == st->st_gid) {
+                bits = (unsigned)(st->st_mode >> 3) & 7;
+                break;
+            }
+        }
+    }
+    return (bits & want) == want;
+}
+
+// Whether the reader may search every directory above root, which lies
+// outside the snapshot and is checked on the file system
+static int reader_reaches(const snapshot_t *snap, const char *root) {
+    char prefix[MAX_PATH_LEN];
+    struct stat st;
+    for (const char *p = strchr(root, '/'); p; p = strchr(p + 1, '/')) {
+        size_t len = p == root ? 1 : (size_t)(p - root);
+        if (len >= sizeof(prefix)) return 0;
+        memcpy(prefix, root, len);
+        prefix[len] = '\0';
+        if (stat(prefix, &st) != 0 || !reader_may(snap, &st, 1)) return 0;
+    }
+    return 1;
+}
+
+// Answer a query for the given roots from a snapshot of a larger tree,
+// as a walk of just those roots would: records at or below each root,
+// within -R and --maxdepth of it. Every root must itself be in the
+// snapshot. With a reader set, a record is only listed if the reader can
+// reach its root and read and search every directory from the root down
+// to it, as the walk would have needed to.
+int snapshot_query_roots(snapshot_t *snap, char **roots, int root_count, const options_t *opts, min_heap_t *heap) {
+    const char *path;
+    struct stat st;
+    int status;
+    size_t *root_len = malloc(sizeof(size_t) * (size_t)root_count);
+    unsigned char *found = calloc((size_t)root_count, 1);
+    // open[i][d]: the reader may list the directory at depth d below root
+    // i last seen, and every one above it
+    unsigned char (*open)[MAX_PATH_LEN / 2] = NULL;
+    unsigned char *reachable = NULL;
+    if (snap->has_reader) {
+        open = malloc(sizeof(*open) * (size_t)root_count);
+        reachable = malloc((size_t)root_count);
+    }
+    if (!root_len || !found || (snap->has_reader && (!open || !reachable))) {
+        fprintf(stderr, "findmax: memory allocation failed\n");
+        free(root_len);
+        free(found);
+        free(open);
+        free(reachable);
+        return -1;
+    }
+    for (int i = 0; i < root_count; i++) {
+        root_len[i] = strlen(roots[i]);
+        if (reachable) reachable[i] = (unsigned char)reader_reaches(snap, roots[i]);
+    }
+    
+    snapshot_rewind(snap);
+    while ((status = snapshot_next(snap, &path, &st)) > 0) {
+        for (int i = 0; i < root_count; i++) {
+            const char *rest = path + root_len[i];
+            if (strncmp(path, roots[i], root_len[i]) != 0 || (*rest != '\0' && *rest != '/')) {
+                continue;
+            }
+            int depth = 0;
+            for (const char *p = rest; *p; p++) {
+                if (*p == '/') depth++;
+            }
+            if (depth == 0) {
+                found[i] = 1;
+            }
+            if (open) {
+                int visible = depth == 0 ? reachable[i] : open[i][depth - 1];
+                if (S_ISDIR(st.st_mode) && depth < MAX_PATH_LEN / 2) {
+                    open[i][depth] = (unsigned char)(visible && reader_may(snap, &st, 4 | 1));
+                }
+                if (!visible) continue;
+            }
+            if (depth > 0 && !opts->recursive) {
+                continue;
+            }
+            if (opts->max_depth >= 0 && depth > opts->max_depth) {
+                continue;
+            }
+            STATS_INC(entries_read);
+            if (should_include_name(path, opts) && should_include_file(&st, opts)) {
+                heap_offer(heap, path, &st, opts);
+            }
+        }
+    }
+    
+    int failed = 0;
+    if (status < 0) {
+        fprintf(stderr, "findmax: snapshot is corrupt after %zu records\n", snap->index);
+        failed = 1;
+    }
+    for (int i = 0; i < root_count && !failed; i++) {
+        if (!found[i]) {
+            fprintf(stderr, "findmax: %s: not in the index\n", roots[i]);
+            failed = 1;
+        } else if (reachable && !reachable[i]) {
+            fprintf(stderr, "findmax: %s: %s\n", roots[i], strerror(EACCES));
+            failed = 1;
+        }
+    }
+    free(root_len);
+    free(found);
+    free(open);
+    free(reachable);
+    return failed ? -1 : 0;
+}
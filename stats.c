@@ -0,0 +1,191 @@
+#include "findmax.h"
+#include <fcntl.h>
+#include <sys/resource.h>
+
+// Scan statistics for --stats. Every counter update is guarded by
+// g_stats_enabled, so a disabled run pays one predictable branch per
+// event and never reads the clock.
+
+int g_stats_enabled = 0;
+scan_stats_t g_scan_stats;
+
+static const char *const phase_names[PHASE_COUNT] = { "traverse", "sort", "output" };
+static uint64_t phase_wall_start[PHASE_COUNT];
+static uint64_t phase_cpu_start[PHASE_COUNT];
+
+uint64_t stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// The same clock in milliseconds, for deadlines
+long monotonic_ms(void) {
+    return (long)(stats_now_ns() / 1000000);
+}
+
+static uint64_t cpu_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void count_error(int err) {
+    g_scan_stats.errors++;
+    g_scan_stats.errors_by_errno[(err > 0 && err < STATS_MAX_ERRNO) ? err : 0]++;
+}
+
+void stats_phase_begin(stats_phase_t phase) {
+    if (!g_stats_enabled) return;
+    phase_wall_start[phase] = stats_now_ns();
+    phase_cpu_start[phase] = cpu_now_ns();
+}
+
+void stats_phase_end(stats_phase_t phase) {
+    if (!g_stats_enabled) return;
+    g_scan_stats.phase_wall_ns[phase] += stats_now_ns() - phase_wall_start[phase];
+    g_scan_stats.phase_cpu_ns[phase] += cpu_now_ns() - phase_cpu_start[phase];
+}
+
+// stat() or lstat() depending on --dereference
+int stat_path(const char *path, struct stat *st, const options_t *opts) {
+    if (!g_stats_enabled) {
+        return opts->dereference ? stat(path, st) : lstat(path, st);
+    }
+    
+    uint64_t start = stats_now_ns();
+    int stat_result = opts->dereference ? stat(path, st) : lstat(path, st);
+    g_scan_stats.stat_ns += stats_now_ns() - start;
+    g_scan_stats.stat_calls++;
+    if (stat_result != 0) {
+        count_error(errno);
+    }
+    return stat_result;
+}
+
+// fstatat() relative to an open directory, with the same --dereference
+// semantics and accounting as stat_path()
+int stat_path_at(int dirfd, const char *name, struct stat *st, const options_t *opts) {
+    int flags = opts->dereference ? 0 : AT_SYMLINK_NOFOLLOW;
+    if (!g_stats_enabled) {
+        return fstatat(dirfd, name, st, flags);
+    }
+    
+    uint64_t start = stats_now_ns();
+    int stat_result = fstatat(dirfd, name, st, flags);
+    g_scan_stats.stat_ns += stats_now_ns() - start;
+    g_scan_stats.stat_calls++;
+    if (stat_result != 0) {
+        count_error(errno);
+    }
+    return stat_result;
+}
+
+DIR *open_directory(const char *path) {
+    DIR *dir = opendir(path);
+    if (g_stats_enabled) {
+        if (dir) {
+            g_scan_stats.dirs_opened++;
+        } else {
+            int err = errno;
+            count_error(err);
+            errno = err;
+        }
+    }
+    return dir;
+}
+
+struct dirent *read_directory(DIR *dir) {
+    if (!g_stats_enabled) {
+        return readdir(dir);
+    }
+    
+    uint64_t start = stats_now_ns();
+    struct dirent *entry = readdir(dir);
+    g_scan_stats.readdir_ns += stats_now_ns() - start;
+    if (entry) {
+        g_scan_stats.entries_read++;
+    }
+    return entry;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+static void print_stats_text(FILE *out) {
+    const scan_stats_t *s = &g_scan_stats;
+    
+    fprintf(out, "findmax statistics:\n");
+    fprintf(out, "  directories opened   %llu\n", (unsigned long long)s->dirs_opened);
+    fprintf(out, "  entries read         %llu\n", (unsigned long long)s->entries_read);
+    fprintf(out, "  stat calls           %llu\n", (unsigned long long)s->stat_calls);
+    fprintf(out, "  stat calls avoided   %llu\n", (unsigned long long)s->stat_avoided);
+    fprintf(out, "  entries ignored      %llu\n", (unsigned long long)s->entries_ignored);
+    fprintf(out, "  mounts skipped       %llu\n", (unsigned long long)s->mounts_skipped);
+    fprintf(out, "  heap inserts         %llu\n", (unsigned long long)s->heap_inserts);
+    fprintf(out, "  heap replacements    %llu\n", (unsigned long long)s->heap_replacements);
+    fprintf(out, "  heap rejections      %llu\n", (unsigned long long)s->heap_rejections);
+    fprintf(out, "  path bytes copied    %llu\n", (unsigned long long)s->path_bytes);
+    fprintf(out, "  peak RSS             %ld KiB\n", peak_rss_kb());
+    fprintf(out, "  errors               %llu\n", (unsigned long long)s->errors);
+    for (int i = 0; i < STATS_MAX_ERRNO; i++) {
+        if (s->errors_by_errno[i]) {
+            fprintf(out, "    %-18s %llu\n", i ? strerror(i) : "other",
+                    (unsigned long long)s->errors_by_errno[i]);
+        }
+    }
+    fprintf(out, "  time in readdir      %.3f ms\n", s->readdir_ns / 1e6);
+    fprintf(out, "  time in stat         %.3f ms\n", s->stat_ns / 1e6);
+    fprintf(out, "  time in heap         %.3f ms\n", s->heap_ns / 1e6);
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        fprintf(out, "  phase %-8s       wall %.3f ms, cpu %.3f ms\n", phase_names[i],
+                s->phase_wall_ns[i] / 1e6, s->phase_cpu_ns[i] / 1e6);
+    }
+}
+
+static void print_stats_json(FILE *out) {
+    const scan_stats_t *s = &g_scan_stats;
+    
+    fprintf(out, "{\"dirs_opened\":%llu,\"entries_read\":%llu,\"stat_calls\":%llu,"
+            "\"stat_avoided\":%llu,\"entries_ignored\":%llu,\"mounts_skipped\":%llu,"
+            "\"heap_inserts\":%llu,\"heap_replacements\":%llu,\"heap_rejections\":%llu,"
+            "\"path_bytes\":%llu,\"peak_rss_kb\":%ld,\"errors\":%llu,\"errors_by_errno\":{",
+            (unsigned long long)s->dirs_opened, (unsigned long long)s->entries_read,
+            (unsigned long long)s->stat_calls, (unsigned long long)s->stat_avoided,
+            (unsigned long long)s->entries_ignored, (unsigned long long)s->mounts_skipped,
+            (unsigned long long)s->heap_inserts,
+            (unsigned long long)s->heap_replacements, (unsigned long long)s->heap_rejections,
+            (unsigned long long)s->path_bytes, peak_rss_kb(), (unsigned long long)s->errors);
+    int first = 1;
+    for (int i = 0; i < STATS_MAX_ERRNO; i++) {
+        if (s->errors_by_errno[i]) {
+            fprintf(out, "%s\"%d\":%llu", first ? "" : ",", i, (unsigned long long)s->errors_by_errno[i]);
+            first = 0;
+        }
+    }
+    fprintf(out, "},\"readdir_ns\":%llu,\"stat_ns\":%llu,\"heap_ns\":%llu,\"phases\":{",
+            (unsigned long long)s->readdir_ns, (unsigned long long)s->stat_ns,
+            (unsigned long long)s->heap_ns);
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        fprintf(out, "%s\"%s\":{\"wall_ns\":%llu,\"cpu_ns\":%llu}", i ? "," : "", phase_names[i],
+                (unsigned long long)s->phase_wall_ns[i], (unsigned long long)s->phase_cpu_ns[i]);
+    }
+    fprintf(out, "}}\n");
+}
+
+void print_scan_stats(int format) {
+    if (format == STATS_JSON) {
+        print_stats_json(stderr);
+    } else {
+        print_stats_text(stderr);
+    }
+}
@@ -149,6 +149,44 @@ static int test_should_include_file(void) {
     TEST_PASS("File filtering");
 }
 
+static int test_predicate_filters(void) {
+    struct stat st = {0};
+    options_t opts = {0};
+    st.st_mode = S_IFREG | 0644;
+    st.st_size = 4096;
+    st.st_mtime = 1500000000;
+    st.st_uid = 1000;
+    
+    opts.predicates = PRED_MIN_SIZE | PRED_MAX_SIZE;
+    opts.min_size = 1024;
+    opts.max_size = 8192;
+    TEST_ASSERT(should_include_file(&st, &opts), "Size within bounds should be included");
+    st.st_size = 100;
+    TEST_ASSERT(!should_include_file(&st, &opts), "Size below minimum should be excluded");
+    
+    opts.predicates = PRED_NEWER | PRED_OLDER;
+    opts.newer_than = 1400000000;
+    opts.older_than = 1600000000;
+    TEST_ASSERT(should_include_file(&st, &opts), "Time within bounds should be included");
+    opts.older_than = 1500000000;
+    TEST_ASSERT(!should_include_file(&st, &opts), "Time bounds are exclusive");
+    
+    opts.predicates = PRED_UID | PRED_TYPE;
+    opts.uid = 1000;
+    opts.type_mask = TYPE_LNK | TYPE_REG;
+    TEST_ASSERT(should_include_file(&st, &opts), "Matching owner and type should be included");
+    st.st_mode = S_IFSOCK | 0644;
+    TEST_ASSERT(!should_include_file(&st, &opts), "Socket should not match f,l");
+    
+    opts.predicates = PRED_NAME;
+    strcpy(opts.name_glob, "*.log");
+    TEST_ASSERT(should_include_name("/var/log/syslog.log", &opts), "Glob should match basename");
+    TEST_ASSERT(!should_include_name("/var/log.d/syslog", &opts), "Glob should not match directory part");
+    TEST_ASSERT(should_include_name("logs.log/", &opts), "Trailing slash should be ignored");
+    
+    TEST_PASS("Predicate filters");
+}
+
 static int test_traverse_directory(void) {
     char* temp_dir = create_temp_dir();
     TEST_ASSERT(temp_dir != NULL, "Failed to create temp directory");
@@ -282,8 +320,8 @@ static int test_sorting_by_time(void) {
         TEST_ASSERT(found_new && found_old, "Should find both files");
         
         // Check that sorting is working (files should be ordered by timestamp)
-        time_t first_time = files->entries[0].sort_time;
-        time_t second_time = files->entries[1].sort_time;
+        time_t first_time = (time_t)files->entries[0].sort_key;
+        time_t second_time = (time_t)files->entries[1].sort_key;
         
         // Default behavior: newest first (max first), so first should be >= second
         // If timestamps are equal, that's also fine due to filesystem granularity
@@ -334,8 +372,8 @@ static int test_sorting_by_size(void) {
         TEST_ASSERT(found_large && found_small, "Should find both files");
         
         // Check that sorting is working (files should be ordered by size)
-        off_t first_size = files->entries[0].sort_size;
-        off_t second_size = files->entries[1].sort_size;
+        off_t first_size = (off_t)files->entries[0].sort_key;
+        off_t second_size = (off_t)files->entries[1].sort_key;
         
         // Files should be sorted with largest first (default behavior - max first)
         TEST_ASSERT(first_size >= second_size, 
@@ -418,8 +456,8 @@ static int test_reverse_sorting(void) {
         TEST_ASSERT(found_first && found_second, "Should find both files");
         
         // Check that reverse sorting is working (files should be ordered by timestamp, oldest first)
-        time_t first_time = files->entries[0].sort_time;
-        time_t second_time = files->entries[1].sort_time;
+        time_t first_time = (time_t)files->entries[0].sort_key;
+        time_t second_time = (time_t)files->entries[1].sort_key;
         
         // With --reverse flag: oldest first (min first), so first should be <= second
         TEST_ASSERT(first_time <= second_time, 
@@ -432,6 +470,1190 @@ static int test_reverse_sorting(void) {
     TEST_PASS("Reverse sorting");
 }
 
+static int test_ignore_vcs(void) {
+    char* temp_dir = create_temp_dir();
+    TEST_ASSERT(temp_dir != NULL, "Failed to create temp directory");
+    
+    char path[512];
+    snprintf(path, sizeof(path), "%s/.gitignore", temp_dir);
+    create_file(path, "build/\n*.o\n!keep.o\n/top.txt\n");
+    snprintf(path, sizeof(path), "%s/build", temp_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/build/out.bin", temp_dir);
+    create_file(path, "out");
+    snprintf(path, sizeof(path), "%s/main.o", temp_dir);
+    create_file(path, "obj");
+    snprintf(path, sizeof(path), "%s/keep.o", temp_dir);
+    create_file(path, "keep");
+    snprintf(path, sizeof(path), "%s/top.txt", temp_dir);
+    create_file(path, "top");
+    snprintf(path, sizeof(path), "%s/src", temp_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/src/top.txt", temp_dir);
+    create_file(path, "nested");
+    snprintf(path, sizeof(path), "%s/src/.ignore", temp_dir);
+    create_file(path, "gen_*\n");
+    snprintf(path, sizeof(path), "%s/src/gen_table.c", temp_dir);
+    create_file(path, "gen");
+    
+    options_t opts = {0};
+    opts.sort_type = SORT_MTIME;
+    opts.filter_type = FILTER_FILE_ONLY;
+    opts.recursive = 1;
+    opts.max_depth = -1;
+    opts.reverse = 1;
+    opts.ignore_vcs = 1;
+    strcpy(opts.format, "%n");
+    opts.num_files = 10;
+    file_list_t* files = create_file_list();
+    
+    traverse_directory(temp_dir, &opts, files);
+    
+    int found_build = 0, found_main = 0, found_keep = 0, found_top = 0, found_nested = 0, found_gen = 0;
+    for (size_t i = 0; i < files->count; i++) {
+        const char *p = files->entries[i].path + strlen(temp_dir);
+        if (strcmp(p, "/build/out.bin") == 0) found_build = 1;
+        if (strcmp(p, "/main.o") == 0) found_main = 1;
+        if (strcmp(p, "/keep.o") == 0) found_keep = 1;
+        if (strcmp(p, "/top.txt") == 0) found_top = 1;
+        if (strcmp(p, "/src/top.txt") == 0) found_nested = 1;
+        if (strcmp(p, "/src/gen_table.c") == 0) found_gen = 1;
+    }
+    
+    TEST_ASSERT(!found_build, "Ignored directory should be pruned");
+    TEST_ASSERT(!found_main, "*.o should be ignored");
+    TEST_ASSERT(found_keep, "Negated pattern should re-include keep.o");
+    TEST_ASSERT(!found_top, "Anchored pattern should ignore top-level file");
+    TEST_ASSERT(found_nested, "Anchored pattern should not match nested file");
+    TEST_ASSERT(!found_gen, "Nested .ignore rules should apply");
+    
+    free_file_list(files);
+    cleanup_temp_dir(temp_dir);
+    free(temp_dir);
+    TEST_PASS("Ignore VCS rules");
+}
+
+static int test_breadth_first(void) {
+    char* temp_dir = create_temp_dir();
+    TEST_ASSERT(temp_dir != NULL, "Failed to create temp directory");
+    
+    char path[512];
+    snprintf(path, sizeof(path), "%s/a", temp_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/a/b", temp_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/a/small.txt", temp_dir);
+    create_file(path, "x");
+    snprintf(path, sizeof(path), "%s/a/b/large.txt", temp_dir);
+    create_file(path, "a much larger file body");
+    snprintf(path, sizeof(path), "%s/medium.txt", temp_dir);
+    create_file(path, "medium body");
+    
+    options_t opts = {0};
+    opts.sort_type = SORT_SIZE;
+    opts.filter_type = FILTER_FILE_ONLY;
+    opts.recursive = 1;
+    opts.max_depth = -1;
+    opts.reverse = 1;
+    opts.num_files = 2;
+    opts.deadline_ms = 60000;
+    
+    min_heap_t *heap = create_min_heap(opts.num_files, &opts);
+    size_t unvisited = 99;
+    char *roots[] = { temp_dir };
+    int partial = traverse_breadth_first(roots, 1, &opts, heap, &unvisited);
+    TEST_ASSERT(partial == 0, "Walk should complete before the deadline");
+    TEST_ASSERT(unvisited == 0, "No directories should be left unvisited");
+    TEST_ASSERT(get_heap_size(heap) == 2, "Heap should hold top 2 files");
+    
+    int found_large = 0, found_medium = 0;
+    file_entry_t *entries = get_heap_entries(heap);
+    for (size_t i = 0; i < get_heap_size(heap); i++) {
+        if (strstr(entries[i].path, "large.txt")) found_large = 1;
+        if (strstr(entries[i].path, "medium.txt")) found_medium = 1;
+    }
+    TEST_ASSERT(found_large && found_medium, "Should keep the two largest files");
+    free_min_heap(heap);
+    
+    // Depth limit applies to the breadth-first walk as well
+    opts.max_depth = 1;
+    heap = create_min_heap(opts.num_files, &opts);
+    traverse_breadth_first(roots, 1, &opts, heap, &unvisited);
+    entries = get_heap_entries(heap);
+    for (size_t i = 0; i < get_heap_size(heap); i++) {
+        TEST_ASSERT(!strstr(entries[i].path, "large.txt"), "maxdepth should stop the walk");
+    }
+    free_min_heap(heap);
+    
+    cleanup_temp_dir(temp_dir);
+    free(temp_dir);
+    TEST_PASS("Breadth-first traversal");
+}
+
+static int test_approximate(void) {
+    char* temp_dir = create_temp_dir();
+    TEST_ASSERT(temp_dir != NULL, "Failed to create temp directory");
+    
+    char path[512];
+    for (int i = 0; i < 4; i++) {
+        snprintf(path, sizeof(path), "%s/d%d", temp_dir, i);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/d%d/f.txt", temp_dir, i);
+        create_file(path, i == 2 ? "the largest file of them all" : "tiny");
+    }
+    
+    options_t opts = {0};
+    opts.sort_type = SORT_SIZE;
+    opts.filter_type = FILTER_FILE_ONLY;
+    opts.recursive = 1;
+    opts.max_depth = -1;
+    opts.reverse = 1;
+    opts.num_files = 1;
+    opts.approx_dirs = 100;
+    
+    // A budget covering the whole tree gives the exact answer
+    char *roots[] = { temp_dir };
+    approx_report_t report;
+    min_heap_t *heap = create_min_heap(opts.num_files, &opts);
+    traverse_approximate(roots, 1, &opts, heap, &report);
+    TEST_ASSERT(report.dirs_unvisited == 0, "Budget should cover the tree");
+    TEST_ASSERT(approx_confidence(&report) == 1.0, "Full coverage should be exact");
+    TEST_ASSERT(get_heap_size(heap) == 1 && strstr(get_heap_entries(heap)[0].path, "d2/f.txt"),
+               "Should find the largest file");
+    free_min_heap(heap);
+    
+    // A budget of one directory stops after the root
+    opts.approx_dirs = 1;
+    heap = create_min_heap(opts.num_files, &opts);
+    traverse_approximate(roots, 1, &opts, heap, &report);
+    TEST_ASSERT(report.dirs_sampled == 1, "Should sample one directory");
+    TEST_ASSERT(report.dirs_unvisited == 4, "Subdirectories should remain unread");
+    TEST_ASSERT(approx_confidence(&report) < 1.0, "Partial coverage should lower confidence");
+    free_min_heap(heap);
+
+    // Each run restarts the sampler, so a repeated run samples the same directories
+    char first[MAX_PATH_LEN] = "";
+    opts.approx_dirs = 3;
+    for (int run = 0; run < 2; run++) {
+        heap = create_min_heap(opts.num_files, &opts);
+        traverse_approximate(roots, 1, &opts, heap, &report);
+        const char *found = get_heap_size(heap) ? get_heap_entries(heap)[0].path : "";
+        if (run == 0)
+            snprintf(first, sizeof(first), "%s", found);
+        else
+            TEST_ASSERT(strcmp(first, found) == 0, "Repeated runs should sample alike");
+        free_min_heap(heap);
+    }
+
+    cleanup_temp_dir(temp_dir);
+    free(temp_dir);
+    TEST_PASS("Approximate traversal");
+}
+
+static int test_scan_stats(void) {
+    char* temp_dir = create_temp_dir();
+    TEST_ASSERT(temp_dir != NULL, "Failed to create temp directory");
+    
+    char path[512];
+    for (int i = 0; i < 5; i++) {
+        snprintf(path, sizeof(path), "%s/file%d.txt", temp_dir, i);
+        create_file(path, "data");
+    }
+    
+    options_t opts = {0};
+    opts.sort_type = SORT_MTIME;
+    opts.recursive = 1;
+    opts.max_depth = -1;
+    opts.reverse = 1;
+    opts.num_files = 2;
+    
+    memset(&g_scan_stats, 0, sizeof(g_scan_stats));
+    g_stats_enabled = 1;
+    min_heap_t *heap = create_min_heap(opts.num_files, &opts);
+    traverse_directory_optimized(temp_dir, &opts, heap, 0);
+    g_stats_enabled = 0;
+    
+    TEST_ASSERT(g_scan_stats.dirs_opened == 1, "Should open one directory");
+    TEST_ASSERT(g_scan_stats.entries_read == 7, "Should read 5 files plus . and ..");
+    TEST_ASSERT(g_scan_stats.stat_calls == 6, "Should stat the root and 5 files");
+    TEST_ASSERT(g_scan_stats.heap_inserts + g_scan_stats.heap_replacements +
+                g_scan_stats.heap_rejections == 6, "Every candidate should be accounted for");
+    TEST_ASSERT(g_scan_stats.heap_inserts == 2, "Heap of 2 should take 2 plain inserts");
+    
+    // Disabled collection must leave the counters alone
+    uint64_t stat_calls = g_scan_stats.stat_calls;
+    traverse_directory_optimized(temp_dir, &opts, heap, 0);
+    TEST_ASSERT(g_scan_stats.stat_calls == stat_calls, "Disabled stats should not count");
+    
+    free_min_heap(heap);
+    cleanup_temp_dir(temp_dir);
+    free(temp_dir);
+    TEST_PASS("Scan statistics");
+}
+
+static int test_snapshot(void) {
+    char* temp_dir = create_temp_dir();
+    TEST_ASSERT(temp_dir != NULL, "Failed to create temp directory");
+    
+    // Enough records that most paths are stored as a shared prefix and a suffix
+    char path[512];
+    for (int i = 0; i < 100; i++) {
+        snprintf(path, sizeof(path), "%s/file_with_a_shared_prefix_%03d.txt", temp_dir, i);
+        create_file(path, i == 42 ? "the largest file of them all" : "tiny");
+    }
+    char snap_file[512];
+    snprintf(snap_file, sizeof(snap_file), "%s.snap", temp_dir);
+    
+    options_t opts = {0};
+    opts.sort_type = SORT_SIZE;
+    opts.recursive = 1;
+    opts.max_depth = -1;
+    opts.reverse = 1;
+    opts.num_files = 3;
+    opts.snapshot_writer = snapshot_create(snap_file);
+    TEST_ASSERT(opts.snapshot_writer != NULL, "Should create a snapshot writer");
+    
+    min_heap_t *heap = create_min_heap(opts.num_files, &opts);
+    traverse_directory_optimized(temp_dir, &opts, heap, 0);
+    free_min_heap(heap);
+    TEST_ASSERT(snapshot_finish(opts.snapshot_writer) == 0, "Should write the snapshot");
+    opts.snapshot_writer = NULL;
+    
+    snapshot_t *snap = snapshot_open(snap_file);
+    TEST_ASSERT(snap != NULL, "Should open the snapshot");
+    TEST_ASSERT(snapshot_count(snap) == 101, "Should record the root and 100 files");
+    
+    // Every record round-trips its path and metadata
+    const char *record_path;
+    struct stat st, actual;
+    int records = 0;
+    while (snapshot_next(snap, &record_path, &st) > 0) {
+        TEST_ASSERT(lstat(record_path, &actual) == 0, "Recorded path should exist");
+        TEST_ASSERT(st.st_size == actual.st_size && st.st_ino == actual.st_ino &&
+                    st.st_mtime == actual.st_mtime && st.st_mode == actual.st_mode,
+                    "Recorded metadata should match the file");
+        records++;
+    }
+    TEST_ASSERT(records == 101, "Should decode every record");
+    
+    // Queries run against the snapshot alone
+    opts.num_files = 1;
+    opts.filter_type = FILTER_FILE_ONLY;
+    heap = create_min_heap(opts.num_files, &opts);
+    TEST_ASSERT(snapshot_query(snap, &opts, heap) == 0, "Query should succeed");
+    TEST_ASSERT(get_heap_size(heap) == 1 && strstr(get_heap_entries(heap)[0].path, "_042.txt"),
+               "Should find the largest file");
+    free_min_heap(heap);
+    snapshot_close(snap);
+
+    // A filtered query still saves every entry: the walk runs unfiltered
+    // and heap_offer() ranks only what passes the query's filters
+    opts.num_files = 200;
+    options_t walk_opts = opts;
+    walk_opts.filter_type = FILTER_ALL;
+    walk_opts.snapshot_filter = &opts;
+    walk_opts.snapshot_writer = snapshot_create(snap_file);
+    TEST_ASSERT(walk_opts.snapshot_writer != NULL, "Should create a snapshot writer");
+    heap = create_min_heap(opts.num_files, &opts);
+    traverse_directory_optimized(temp_dir, &walk_opts, heap, 0);
+    TEST_ASSERT(get_heap_size(heap) == 100, "Only files should be ranked");
+    free_min_heap(heap);
+    TEST_ASSERT(snapshot_finish(walk_opts.snapshot_writer) == 0, "Should write the snapshot");
+    snap = snapshot_open(snap_file);
+    TEST_ASSERT(snap != NULL && snapshot_count(snap) == 101, "Should record the root directory too");
+    snapshot_close(snap);
+
+    unlink(snap_file);
+    cleanup_temp_dir(temp_dir);
+    free(temp_dir);
+    TEST_PASS("Metadata snapshot");
+}
+
+static int test_snapshot_roots(void) {
+    char *temp_dir = create_temp_dir();
+    TEST_ASSERT(temp_dir != NULL, "Failed to create temp directory");
+    
+    // root/big (100 bytes), root/sub/ and root/sub/deep (10 bytes); the
+    // prefix sibling root/sub2 must not count as part of root/sub
+    char path[512];
+    snprintf(path, sizeof(path), "%s/sub", temp_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/sub/deep", temp_dir);
+    create_file(path, "0123456789");
+    snprintf(path, sizeof(path), "%s/sub2", temp_dir);
+    create_file(path, "0123456789012345678901234567890123456789");
+    snprintf(path, sizeof(path), "%s/big", temp_dir);
+    create_file(path, "0123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789");
+    // Others may list the root but not root/sub
+    chmod(temp_dir, 0755);
+    snprintf(path, sizeof(path), "%s/sub", temp_dir);
+    chmod(path, 0700);
+    char snap_file[512];
+    snprintf(snap_file, sizeof(snap_file), "%s.snap", temp_dir);
+    
+    options_t opts = {0};
+    opts.sort_type = SORT_SIZE;
+    opts.recursive = 1;
+    opts.max_depth = -1;
+    opts.reverse = 1;
+    opts.num_files = 10;
+    opts.snapshot_writer = snapshot_create(snap_file);
+    TEST_ASSERT(opts.snapshot_writer != NULL, "Should create a snapshot writer");
+    min_heap_t *heap = create_min_heap(opts.num_files, &opts);
+    traverse_directory_optimized(temp_dir, &opts, heap, 0);
+    free_min_heap(heap);
+    TEST_ASSERT(snapshot_finish(opts.snapshot_writer) == 0, "Should write the snapshot");
+    opts.snapshot_writer = NULL;
+    snapshot_t *snap = snapshot_open(snap_file);
+    TEST_ASSERT(snap != NULL, "Should open the snapshot");
+    
+    // A subtree answers as a walk of it would
+    char sub[512];
+    snprintf(sub, sizeof(sub), "%s/sub", temp_dir);
+    char *roots[] = { sub };
+    opts.filter_type = FILTER_FILE_ONLY;
+    heap = create_min_heap(opts.num_files, &opts);
+    TEST_ASSERT(snapshot_query_roots(snap, roots, 1, &opts, heap) == 0, "Subtree query should succeed");
+    TEST_ASSERT(get_heap_size(heap) == 1 && get_heap_entries(heap)[0].st.st_size == 10,
+               "Only entries under the root should be offered");
+    free_min_heap(heap);
+    
+    // --maxdepth and -R count from the requested root
+    char *top[] = { temp_dir };
+    opts.max_depth = 1;
+    heap = create_min_heap(opts.num_files, &opts);
+    TEST_ASSERT(snapshot_query_roots(snap, top, 1, &opts, heap) == 0, "Depth-limited query should succeed");
+    TEST_ASSERT(get_heap_size(heap) == 2, "Depth 2 entries should be left out");
+    free_min_heap(heap);
+    
+    snprintf(path, sizeof(path), "%s/missing", temp_dir);
+    char *missing[] = { path };
+    heap = create_min_heap(opts.num_files, &opts);
+    TEST_ASSERT(snapshot_query_roots(snap, missing, 1, &opts, heap) != 0, "Roots outside the snapshot should be reported");
+    free_min_heap(heap);
+    
+    // A findmaxd client only sees what it could list itself
+    TEST_ASSERT(snapshot_set_reader(snap, 54321, 54321) == 0, "Should set the reader");
+    opts.max_depth = -1;
+    heap = create_min_heap(opts.num_files, &opts);
+    TEST_ASSERT(snapshot_query_roots(snap, top, 1, &opts, heap) == 0, "Reader query should succeed");
+    TEST_ASSERT(get_heap_size(heap) == 2, "Entries below an unreadable directory should be hidden");
+    free_min_heap(heap);
+    heap = create_min_heap(opts.num_files, &opts);
+    TEST_ASSERT(snapshot_query_roots(snap, roots, 1, &opts, heap) == 0, "Subtree query should succeed");
+    TEST_ASSERT(get_heap_size(heap) == 0, "An unreadable root should list none of its entries");
+    free_min_heap(heap);
+    
+    snapshot_close(snap);
+    unlink(snap_file);
+    cleanup_temp_dir(temp_dir);
+    free(temp_dir);
+    TEST_PASS("Snapshot queries by root");
+}
+
+static int test_snapshot_diff(void) {
+    char* temp_dir = create_temp_dir();
+    TEST_ASSERT(temp_dir != NULL, "Failed to create temp directory");
+    
+    char grow[512], shrink[512], added[512];
+    snprintf(grow, sizeof(grow), "%s/grow.txt", temp_dir);
+    snprintf(shrink, sizeof(shrink), "%s/shrink.txt", temp_dir);
+    snprintf(added, sizeof(added), "%s/added.txt", temp_dir);
+    create_file(grow, "a");
+    create_file(shrink, "a fairly long line of text");
+    
+    char old_file[512], new_file[512];
+    snprintf(old_file, sizeof(old_file), "%s.old", temp_dir);
+    snprintf(new_file, sizeof(new_file), "%s.new", temp_dir);
+    
+    options_t opts = {0};
+    opts.sort_type = SORT_SIZE;
+    opts.filter_type = FILTER_FILE_ONLY;
+    opts.recursive = 1;
+    opts.max_depth = -1;
+    opts.reverse = 1;
+    opts.num_files = 10;
+    
+    const char *files[] = { old_file, new_file };
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            create_file(grow, "now considerably longer than before");
+            unlink(shrink);
+            create_file(shrink, "short");
+            create_file(added, "0123456789");
+        }
+        opts.snapshot_writer = snapshot_create(files[pass]);
+        min_heap_t *heap = create_min_heap(opts.num_files, &opts);
+        traverse_directory_optimized(temp_dir, &opts, heap, 0);
+        free_min_heap(heap);
+        TEST_ASSERT(snapshot_finish(opts.snapshot_writer) == 0, "Should write the snapshot");
+        opts.snapshot_writer = NULL;
+    }
+    
+    snapshot_t *old_snap = snapshot_open(old_file);
+    snapshot_t *new_snap = snapshot_open(new_file);
+    TEST_ASSERT(old_snap && new_snap, "Should open both snapshots");
+    
+    // Growth ranks the grown file first, the new file next, the shrunk one last
+    options_t rank_opts = opts;
+    rank_opts.reverse = 1;
+    min_heap_t *heap = create_min_heap(opts.num_files, &rank_opts);
+    TEST_ASSERT(snapshot_diff(old_snap, new_snap, &opts, heap) == 0, "Diff should succeed");
+    TEST_ASSERT(get_heap_size(heap) == 3, "Three files changed");
+    file_entry_t *entries = get_heap_entries(heap);
+    file_list_t list = { entries, 3, 3 };
+    sort_files(&list, &rank_opts);
+    TEST_ASSERT(strstr(entries[0].path, "grow.txt") && entries[0].sort_key == 34, "Grown file should lead");
+    TEST_ASSERT(strstr(entries[1].path, "added.txt") && entries[1].sort_key == 10, "New file counts fully");
+    TEST_ASSERT(strstr(entries[2].path, "shrink.txt") && entries[2].sort_key == -21, "Shrunk file comes last");
+    free_min_heap(heap);
+    
+    // New bytes only counts files absent from the old scan
+    opts.diff_by = DIFF_BY_NEW;
+    heap = create_min_heap(opts.num_files, &rank_opts);
+    snapshot_diff(old_snap, new_snap, &opts, heap);
+    TEST_ASSERT(get_heap_size(heap) == 1 && strstr(get_heap_entries(heap)[0].path, "added.txt"),
+               "Only the added file is new");
+    free_min_heap(heap);
+    
+    snapshot_close(old_snap);
+    snapshot_close(new_snap);
+    unlink(old_file);
+    unlink(new_file);
+    cleanup_temp_dir(temp_dir);
+    free(temp_dir);
+    TEST_PASS("Snapshot diff");
+}
+
+static int test_files_from(void) {
+    char* temp_dir = create_temp_dir();
+    TEST_ASSERT(temp_dir != NULL, "Failed to create temp directory");
+    
+    char list_file[512];
+    snprintf(list_file, sizeof(list_file), "%s.list", temp_dir);
+    FILE *list = fopen(list_file, "w");
+    TEST_ASSERT(list != NULL, "Failed to create list file");
+    
+    // NUL-separated, with a missing entry and a name with a newline in it
+    char path[512];
+    const char *names[] = { "small.txt", "large.txt", "odd\nname.txt", "missing.txt" };
+    const char *contents[] = { "a", "the largest of the listed files", "medium", NULL };
+    for (int i = 0; i < 4; i++) {
+        snprintf(path, sizeof(path), "%s/%s", temp_dir, names[i]);
+        if (contents[i]) create_file(path, contents[i]);
+        fwrite(path, 1, strlen(path) + 1, list);
+    }
+    fclose(list);
+    
+    options_t opts = {0};
+    opts.sort_type = SORT_SIZE;
+    opts.max_depth = -1;
+    opts.reverse = 1;
+    opts.num_files = 5;
+    opts.quiet = 1;
+    
+    min_heap_t *heap = create_min_heap(opts.num_files, &opts);
+    TEST_ASSERT(traverse_files_from(list_file, '\0', &opts, heap) == 0, "Should read the list");
+    TEST_ASSERT(get_heap_size(heap) == 3, "Should offer the three existing paths");
+    free_min_heap(heap);
+    
+    // The name filter applies to listed paths as well
+    strcpy(opts.name_glob, "*name*");
+    opts.predicates = PRED_NAME;
+    heap = create_min_heap(opts.num_files, &opts);
+    traverse_files_from(list_file, '\0', &opts, heap);
+    TEST_ASSERT(get_heap_size(heap) == 1 && strstr(get_heap_entries(heap)[0].path, "odd\nname"),
+               "Should keep only the matching name");
+    free_min_heap(heap);
+    
+    unlink(list_file);
+    cleanup_temp_dir(temp_dir);
+    free(temp_dir);
+    TEST_PASS("Streaming path list");
+}
+
+static int test_group_by(void) {
+    char* temp_dir = create_temp_dir();
+    TEST_ASSERT(temp_dir != NULL, "Failed to create temp directory");
+    
+    char path[512];
+    snprintf(path, sizeof(path), "%s/a", temp_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/a/deep", temp_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/b", temp_dir);
+    mkdir(path, 0755);
+    const char *names[] = { "a/one.txt", "a/deep/two.c", "a/deep/three.c", "b/four.txt" };
+    for (int i = 0; i < 4; i++) {
+        snprintf(path, sizeof(path), "%s/%s", temp_dir, names[i]);
+        create_file(path, names[i]);
+    }
+    
+    options_t opts = {0};
+    opts.sort_type = SORT_SIZE;
+    opts.filter_type = FILTER_FILE_ONLY;
+    opts.recursive = 1;
+    opts.max_depth = -1;
+    opts.reverse = 1;
+    opts.num_files = 2;
+    opts.max_groups = DEFAULT_MAX_GROUPS;
+    opts.group_by = GROUP_BY_DIR;
+    opts.group_depth = 1;
+    
+    // dir:1 folds a/deep into a, which keeps only its top two of three
+    char *roots[] = { temp_dir };
+    opts.group_map = group_map_create(roots, 1, &opts);
+    min_heap_t *heap = create_min_heap(opts.num_files, &opts);
+    traverse_directory_optimized(temp_dir, &opts, heap, 0);
+    TEST_ASSERT(get_heap_size(heap) == 0, "Overall heap should stay empty");
+    
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/a/deep/two.c", temp_dir);
+    stat(path, &st);
+    min_heap_t *group = group_heap_for(opts.group_map, path, &st);
+    TEST_ASSERT(group && get_heap_size(group) == 2, "Group a should hold its top two");
+    snprintf(path, sizeof(path), "%s/b/four.txt", temp_dir);
+    stat(path, &st);
+    group = group_heap_for(opts.group_map, path, &st);
+    TEST_ASSERT(group && get_heap_size(group) == 1, "Group b should hold its one file");
+    group_map_free(opts.group_map);
+    free_min_heap(heap);
+    
+    // Past the group cap, further extensions are dropped
+    opts.group_by = GROUP_BY_EXT;
+    opts.max_groups = 1;
+    opts.group_map = group_map_create(roots, 1, &opts);
+    snprintf(path, sizeof(path), "%s/a/one.txt", temp_dir);
+    stat(path, &st);
+    TEST_ASSERT(group_heap_for(opts.group_map, path, &st) != NULL, "First group should be created");
+    snprintf(path, sizeof(path), "%s/a/deep/two.c", temp_dir);
+    TEST_ASSERT(group_heap_for(opts.group_map, path, &st) == NULL, "Second group should be refused");
+    group_map_free(opts.group_map);
+
+    // Owner groups are keyed on the numeric id
+    opts.group_by = GROUP_BY_UID;
+    opts.max_groups = DEFAULT_MAX_GROUPS;
+    opts.group_map = group_map_create(roots, 1, &opts);
+    group = group_heap_for(opts.group_map, path, &st);
+    snprintf(path, sizeof(path), "%s/b/four.txt", temp_dir);
+    TEST_ASSERT(group && group_heap_for(opts.group_map, path, &st) == group, "Same owner should share a group");
+    st.st_uid += 1;
+    TEST_ASSERT(group_heap_for(opts.group_map, path, &st) != group, "Other owner should get its own group");
+    group_map_free(opts.group_map);
+
+    cleanup_temp_dir(temp_dir);
+    free(temp_dir);
+    TEST_PASS("Group-by top-N");
+}
+
+static int test_totals(void) {
+    char* temp_dir = create_temp_dir();
+    TEST_ASSERT(temp_dir != NULL, "Failed to create temp directory");
+    
+    // sub holds 30 bytes in two files, one of them also linked from the top
+    char path[512], link_path[512];
+    snprintf(path, sizeof(path), "%s/sub", temp_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/sub/ten.txt", temp_dir);
+    create_file(path, "0123456789");
+    snprintf(link_path, sizeof(link_path), "%s/ten.link", temp_dir);
+    TEST_ASSERT(link(path, link_path) == 0, "Should create a hard link");
+    snprintf(path, sizeof(path), "%s/sub/twenty.txt", temp_dir);
+    create_file(path, "01234567890123456789");
+    
+    options_t opts = {0};
+    opts.sort_type = SORT_SIZE;
+    opts.recursive = 1;
+    opts.max_depth = -1;
+    opts.reverse = 1;
+    opts.num_files = 5;
+    opts.total = TOTAL_COUNT;
+    
+    min_heap_t *heap = create_min_heap(opts.num_files, &opts);
+    char *roots[] = { temp_dir };
+    TEST_ASSERT(traverse_totals(roots, 1, &opts, heap) == 0, "Totals walk should succeed");
+    TEST_ASSERT(get_heap_size(heap) == 2, "Only the two directories are ranked");
+    
+    // The linked file counts once, so the top has no more files than sub
+    file_entry_t *entries = get_heap_entries(heap);
+    for (size_t i = 0; i < 2; i++) {
+        TEST_ASSERT(entries[i].st.st_size == 2, "Each directory totals two files");
+    }
+    free_min_heap(heap);
+    
+    // Byte totals include the directory inodes themselves, as du -b does
+    struct stat top_st, sub_st;
+    stat(temp_dir, &top_st);
+    snprintf(path, sizeof(path), "%s/sub", temp_dir);
+    stat(path, &sub_st);
+    opts.total = TOTAL_SIZE;
+    heap = create_min_heap(opts.num_files, &opts);
+    traverse_totals(roots, 1, &opts, heap);
+    entries = get_heap_entries(heap);
+    for (size_t i = 0; i < get_heap_size(heap); i++) {
+        off_t expected = sub_st.st_size + 30;
+        if (strcmp(entries[i].path, temp_dir) == 0) expected += top_st.st_size;
+        TEST_ASSERT(entries[i].st.st_size == expected, "Directory size should be the subtree total");
+    }
+    free_min_heap(heap);
+    
+    cleanup_temp_dir(temp_dir);
+    free(temp_dir);
+    TEST_PASS("Cumulative directory totals");
+}
+
+static int test_sort_keys(void) {
+    // Every key is reachable by name from the table
+    for (int i = 0; i < SORT_KEY_COUNT; i++) {
+        sort_type_t sort_type;
+        TEST_ASSERT(sort_key_by_name(sort_keys[i].name, &sort_type) == 0 && sort_type == (sort_type_t)i,
+                   "Key names should resolve to their table entry");
+    }
+    
+    struct stat st = {0};
+    st.st_size = 1 << 30;
+    st.st_blocks = 8;
+    st.st_nlink = 3;
+    options_t opts = {0};
+    file_list_t *files = create_file_list();
+    
+    opts.sort_type = SORT_BLOCKS;
+    add_file_entry(files, "/a//b/sparse", &st, &opts);
+    TEST_ASSERT(files->entries[0].sort_key == 4096, "Blocks key should be allocated bytes");
+    opts.sort_type = SORT_NLINK;
+    add_file_entry(files, "/a//b/sparse", &st, &opts);
+    TEST_ASSERT(files->entries[1].sort_key == 3, "Links key should be the link count");
+    opts.sort_type = SORT_DEPTH;
+    add_file_entry(files, "/a//b/sparse", &st, &opts);
+    TEST_ASSERT(files->entries[2].sort_key == 3, "Depth key should count path components");
+    opts.sort_type = SORT_PATHLEN;
+    add_file_entry(files, "/a//b/sparse", &st, &opts);
+    TEST_ASSERT(files->entries[3].sort_key == 12, "Path length key should be the path length");
+    free_file_list(files);
+    
+    // -r keeps the N smallest: the heap root must be the largest kept
+    opts.sort_type = SORT_SIZE;
+    opts.reverse = 0;
+    min_heap_t *heap = create_min_heap(3, &opts);
+    const off_t sizes[] = { 500, 100, 700, 300, 200, 600, 400 };
+    for (int i = 0; i < 7; i++) {
+        st.st_size = sizes[i];
+        heap_offer(heap, "f", &st, &opts);
+    }
+    file_entry_t *entries = get_heap_entries(heap);
+    int64_t sum = 0;
+    for (size_t i = 0; i < get_heap_size(heap); i++) sum += entries[i].sort_key;
+    TEST_ASSERT(get_heap_size(heap) == 3 && sum == 600, "Reverse heap should keep the three smallest");
+    free_min_heap(heap);
+    
+    // size,mtime:asc,name: ties on size go to the older file, then by name
+    options_t multi = {0};
+    multi.reverse = 1;
+    TEST_ASSERT(parse_sort_list("size,mtime:asc,name", &multi) == 0 && multi.sort_count == 3,
+               "Should parse a three-key list");
+    TEST_ASSERT(parse_sort_list("size,bogus", &multi) != 0, "Unknown keys should be rejected");
+    files = create_file_list();
+    const char *names[] = { "/t/b", "/t/a", "/t/c", "/t/d" };
+    const off_t tie_sizes[] = { 0, 0, 0, 5 };
+    const time_t mtimes[] = { 100, 100, 50, 200 };
+    for (int i = 0; i < 4; i++) {
+        st.st_size = tie_sizes[i];
+        st.st_mtime = mtimes[i];
+        add_file_entry(files, names[i], &st, &multi);
+    }
+    sort_files(files, &multi);
+    TEST_ASSERT(strcmp(files->entries[0].path, "/t/d") == 0, "Largest size should lead");
+    TEST_ASSERT(strcmp(files->entries[1].path, "/t/c") == 0, "Older mtime should break the size tie");
+    TEST_ASSERT(strcmp(files->entries[2].path, "/t/b") == 0 && strcmp(files->entries[3].path, "/t/a") == 0,
+               "Name should break the remaining tie");
+    free_file_list(files);
+
+    // name,size: long names that share a prefix still order by name
+    TEST_ASSERT(parse_sort_list("name:asc,size", &multi) == 0, "Should parse name:asc,size");
+    files = create_file_list();
+    char long_name[1200];
+    for (int i = 0; i < 2; i++) {
+        snprintf(long_name, sizeof(long_name), "/t/%01100d%c", 0, i ? 'a' : 'b');
+        st.st_size = i ? 1 : 9;
+        add_file_entry(files, long_name, &st, &multi);
+    }
+    sort_files(files, &multi);
+    TEST_ASSERT(files->entries[0].path[strlen(files->entries[0].path) - 1] == 'a',
+               "Long names should order by name before size");
+    free_file_list(files);
+
+    TEST_PASS("Sort key table");
+}
+
+static int test_queries(void) {
+    char* temp_dir = create_temp_dir();
+    TEST_ASSERT(temp_dir != NULL, "Failed to create temp directory");
+    
+    char path[512];
+    const char *contents[] = { "a", "bbbbb", "ccc", "dddddddd" };
+    for (int i = 0; i < 4; i++) {
+        snprintf(path, sizeof(path), "%s/file%d", temp_dir, i);
+        create_file(path, contents[i]);
+    }
+    
+    options_t opts = {0};
+    opts.sort_type = SORT_MTIME;
+    opts.recursive = 1;
+    opts.max_depth = -1;
+    opts.reverse = 1;
+    opts.num_files = 1;
+    
+    const char *specs[] = { "largest=size/2/f", "smallest=size:asc/1/f", "dirs=name/5/d" };
+    opts.queries = query_set_create(specs, 3, &opts);
+    TEST_ASSERT(opts.queries && query_set_count(opts.queries) == 3, "Should build three queries");
+    const char *bad[] = { "size/0" };
+    TEST_ASSERT(query_set_create(bad, 1, &opts) == NULL, "A zero count should be rejected");
+    
+    min_heap_t *heap = create_min_heap(opts.num_files, &opts);
+    traverse_directory_optimized(temp_dir, &opts, heap, 0);
+    
+    // One walk fills every query's heap with its own ranking
+    min_heap_t *largest = query_set_heap(opts.queries, 0);
+    file_entry_t *entries = get_heap_entries(largest);
+    TEST_ASSERT(get_heap_size(largest) == 2 && entries[0].sort_key + entries[1].sort_key == 13,
+               "Largest should keep the 8 and 5 byte files");
+    min_heap_t *smallest = query_set_heap(opts.queries, 1);
+    TEST_ASSERT(get_heap_size(smallest) == 1 && get_heap_entries(smallest)[0].st.st_size == 1,
+               "Smallest should keep the 1 byte file");
+    TEST_ASSERT(get_heap_size(query_set_heap(opts.queries, 2)) == 1, "Only the directory is a dir");
+    TEST_ASSERT(get_heap_size(heap) == 0, "The overall heap should stay empty");
+    
+    free_min_heap(heap);
+    query_set_free(opts.queries);
+    cleanup_temp_dir(temp_dir);
+    free(temp_dir);
+    TEST_PASS("Several queries in one traversal");
+}
+
+static int test_score(void) {
+    struct stat st = {0};
+    st.st_size = 3 * 1024;
+    st.st_atime = 1000;
+    st.st_nlink = 2;
+    
+    score_program_t *program = score_compile("size * (now - atime) / 1K", 1000 + 86400);
+    TEST_ASSERT(program != NULL, "Should compile a score expression");
+    TEST_ASSERT(score_eval(program, "/a/f", &st) == 3.0 * 86400, "Score should combine stat fields");
+    score_free(program);
+    
+    // now, suffixes and constant operands fold away: 8 instructions, not 15
+    program = score_compile("st_size - (now - 2d) * 0 + max(1, 2) * -links", 5000);
+    TEST_ASSERT(program != NULL && score_length(program) == 8, "Constant subexpressions should be folded");
+    TEST_ASSERT(score_eval(program, "/a/f", &st) == 3 * 1024 - 4, "Folded program should evaluate the same");
+    score_free(program);
+    program = score_compile("log(0) + depth / 0 + min(pathlen, 100)", 0);
+    TEST_ASSERT(program != NULL && score_eval(program, "/a/f", &st) == 4, "Undefined operations should score 0");
+    score_free(program);
+    
+    TEST_ASSERT(score_compile("size +", 0) == NULL, "Incomplete expression should be rejected");
+    TEST_ASSERT(score_compile("size * bogus", 0) == NULL, "Unknown names should be rejected");
+    TEST_ASSERT(score_compile("max(size)", 0) == NULL, "Wrong argument count should be rejected");
+    
+    // Packed keys keep the order of the scores
+    const double scores[] = { -1e300, -2.5, -1, -0.5, 0, 0.25, 1, 1.5, 1e18, 1e300 };
+    for (int i = 1; i < 10; i++) {
+        TEST_ASSERT(score_key(scores[i - 1]) < score_key(scores[i]), "Score keys should preserve order");
+    }
+    
+    // --score ranks through the ordinary heap
+    options_t opts = {0};
+    opts.score = score_compile("-size", 0);
+    opts.sort_type = SORT_SCORE;
+    opts.reverse = 1;  // the default, max-first order
+    min_heap_t *heap = create_min_heap(2, &opts);
+    const off_t sizes[] = { 500, 100, 700, 300 };
+    for (int i = 0; i < 4; i++) {
+        st.st_size = sizes[i];
+        heap_offer(heap, "f", &st, &opts);
+    }
+    file_entry_t *entries = get_heap_entries(heap);
+    off_t sum = entries[0].st.st_size + entries[1].st.st_size;
+    TEST_ASSERT(get_heap_size(heap) == 2 && sum == 400, "Highest scores should be the two smallest files");
+    free_min_heap(heap);
+    score_free(opts.score);
+    
+    TEST_PASS("Score expressions");
+}
+
+static int test_until_size(void) {
+    // Oldest first (-r -t) until 10000 bytes: the answer is the prefix of
+    // that order whose sizes first reach the budget
+    options_t opts = {0};
+    opts.sort_type = SORT_MTIME;
+    opts.until_size = 10000;
+    min_heap_t *heap = create_min_heap(1, &opts);
+    TEST_ASSERT(heap != NULL, "Should create a budget heap");
+    
+    struct stat st = {0};
+    const time_t mtimes[] = { 50, 10, 70, 30, 20, 60, 40 };
+    const off_t sizes[] = { 9000, 4000, 1000, 3000, 2000, 5000, 6000 };
+    for (int i = 0; i < 7; i++) {
+        st.st_mtime = mtimes[i];
+        st.st_size = sizes[i];
+        heap_offer(heap, "f", &st, &opts);
+    }
+    // By age: 10 (4000), 20 (2000), 30 (3000), 40 (6000) reaches 15000
+    file_entry_t *entries = get_heap_entries(heap);
+    off_t total = 0;
+    time_t newest = 0;
+    for (size_t i = 0; i < get_heap_size(heap); i++) {
+        total += entries[i].st.st_size;
+        if (entries[i].st.st_mtime > newest) newest = entries[i].st.st_mtime;
+    }
+    TEST_ASSERT(get_heap_size(heap) == 4 && total == 15000 && newest == 40,
+               "Budget heap should keep the shortest prefix reaching the size");
+    free_min_heap(heap);
+    
+    // --until-count caps the selection even if the size is not reached
+    opts.until_count = 2;
+    heap = create_min_heap(1, &opts);
+    for (int i = 0; i < 7; i++) {
+        st.st_mtime = mtimes[i];
+        st.st_size = sizes[i];
+        heap_offer(heap, "f", &st, &opts);
+    }
+    TEST_ASSERT(get_heap_size(heap) == 2, "Count budget should stop the selection first");
+    free_min_heap(heap);
+    
+    TEST_PASS("Size budget selection");
+}
+
+static int test_exec(void) {
+    file_entry_t *entries = calloc(3, sizeof(file_entry_t));
+    TEST_ASSERT(entries != NULL, "Should allocate entries");
+    strcpy(entries[0].path, "/tmp");
+    strcpy(entries[1].path, "/");
+    strcpy(entries[2].path, "/tmp/with space");  // does not exist
+    
+    exec_command_t *command = exec_parse("sh -c 'for f; do test -e \"$f\" || exit 1; done' sh {} +", 0);
+    TEST_ASSERT(command != NULL, "Should parse a batched command");
+    TEST_ASSERT(exec_run(command, entries, 2, 1) == 0, "Batched command should succeed");
+    TEST_ASSERT(exec_run(command, entries, 3, 2) != 0, "A failing command should be reported");
+    exec_free(command);
+    
+    // One argument per path, even with spaces, and {} inside a word
+    command = exec_parse("sh -c 'test \"$#\" = 0 && test \"$0\" = x/tmp/with\\ space' x{}", 1);
+    TEST_ASSERT(command != NULL, "Should parse a per-entry command with quotes");
+    TEST_ASSERT(exec_run(command, entries + 2, 1, 1) == 0, "Path should be substituted into the word");
+    exec_free(command);
+
+    // A substitution that does not fit is reported, not truncated
+    memset(entries[0].path, 'a', MAX_PATH_LEN - 2);
+    entries[0].path[MAX_PATH_LEN - 2] = '\0';
+    command = exec_parse("true {}{}", 1);
+    TEST_ASSERT(command != NULL, "Should parse a doubled substitution");
+    TEST_ASSERT(exec_run(command, entries, 1, 1) != 0, "An overlong argument should be reported");
+    exec_free(command);
+
+    TEST_ASSERT(exec_parse("rm {} -f", 0) == NULL, "{} must be last in batch mode");
+    TEST_ASSERT(exec_parse("echo 'open", 0) == NULL, "Unterminated quote should be rejected");
+    TEST_ASSERT(exec_parse("  ", 1) == NULL, "Empty command should be rejected");
+    free(entries);
+    
+    // The splitter --batch shares
+    char *words[4];
+    int count = split_command_words("-S -F '%s %n' \"/a b\"", words, 4);
+    TEST_ASSERT(count == 4 && strcmp(words[2], "%s %n") == 0 && strcmp(words[3], "/a b") == 0,
+               "Should split quoted words");
+    for (int i = 0; i < count; i++) free(words[i]);
+    TEST_ASSERT(split_command_words("a b c d e", words, 4) == -1, "Too many words should be rejected");
+    
+    TEST_PASS("Batched exec");
+}
+
+static int test_batch(void) {
+    char* temp_dir = create_temp_dir();
+    TEST_ASSERT(temp_dir != NULL, "Failed to create temp directory");
+    
+    char path[512];
+    snprintf(path, sizeof(path), "%s/small", temp_dir);
+    create_file(path, "a");
+    snprintf(path, sizeof(path), "%s/big", temp_dir);
+    create_file(path, "aaaaa");
+    
+    // -S -f given with --batch applies to every line; -r on one line
+    // must not carry over to the next
+    char input[2048];
+    snprintf(input, sizeof(input),
+             "-R %s\n-r -R %s\n--version\n# comment\n-R %s\n--bogus\n--help\n-R %s\n",
+             temp_dir, temp_dir, temp_dir, temp_dir);
+    int in_pipe[2];
+    TEST_ASSERT(pipe(in_pipe) == 0, "Failed to create pipe");
+    write(in_pipe[1], input, strlen(input));
+    close(in_pipe[1]);
+    FILE *out = tmpfile();
+    TEST_ASSERT(out != NULL, "Failed to create output file");
+    
+    fflush(stdout);
+    fflush(stderr);
+    int saved_in = dup(0), saved_out = dup(1), saved_err = dup(2);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(in_pipe[0], 0);
+    dup2(fileno(out), 1);
+    dup2(null_fd, 2);
+    clearerr(stdin);
+    char *args[] = { "findmax", "--batch", "-S", "-f" };
+    int status = batch_main(args, 4);
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_in, 0);
+    dup2(saved_out, 1);
+    dup2(saved_err, 2);
+    clearerr(stdin);
+    close(saved_in);
+    close(saved_out);
+    close(saved_err);
+    close(null_fd);
+    close(in_pipe[0]);
+    
+    char output[16384];
+    rewind(out);
+    size_t len = fread(output, 1, sizeof(output) - 1, out);
+    output[len] = '\0';
+    fclose(out);
+    
+    // Each answer in order, each followed by its terminator
+    char expected[6][600];
+    snprintf(expected[0], sizeof(expected[0]), "%s/big\n# findmax exit 0\n", temp_dir);
+    snprintf(expected[1], sizeof(expected[1]), "%s/small\n# findmax exit 0\n", temp_dir);
+    snprintf(expected[2], sizeof(expected[2]), "# findmax exit 0\n%s/big\n# findmax exit 0\n", temp_dir);
+    snprintf(expected[3], sizeof(expected[3]), "# findmax exit 1\n");
+    snprintf(expected[4], sizeof(expected[4]), "# findmax exit 0\n");
+    snprintf(expected[5], sizeof(expected[5]), "%s/big\n# findmax exit 0\n", temp_dir);
+    const char *at = output;
+    int in_order = 1;
+    for (int i = 0; i < 6 && in_order; i++) {
+        const char *found = strstr(at, expected[i]);
+        in_order = found != NULL;
+        if (found) at = found + strlen(expected[i]);
+    }
+    int terminators = 0;
+    for (const char *p = output; (p = strstr(p, "\n# findmax exit ")); p++) terminators++;
+    
+    cleanup_temp_dir(temp_dir);
+    free(temp_dir);
+    TEST_ASSERT(status == 0, "Batch should succeed");
+    TEST_ASSERT(terminators == 7, "Every query line should get one terminator");
+    TEST_ASSERT(in_order, "Answers should follow their queries, past --version and --help");
+    TEST_PASS("Batch queries");
+}
+
+static int test_sketch(void) {
+    options_t opts = {0};
+    opts.sort_type = SORT_SIZE;
+    sketch_t *sketch = sketch_create(&opts);
+    TEST_ASSERT(sketch != NULL, "Should create a sketch");
+    TEST_ASSERT(sketch_quantile(sketch, 0.5) == 0, "An empty sketch has no quantiles");
+    
+    // Sizes 1..100000: every quantile within the bucket error of the truth
+    file_entry_t entry = {0};
+    strcpy(entry.path, "f");
+    entry.st.st_mode = S_IFREG | 0644;
+    for (off_t size = 1; size <= 100000; size++) {
+        entry.st.st_size = size;
+        set_sort_key(&entry, &opts);
+        sketch_add(sketch, &entry);
+    }
+    const double qs[] = { 0.01, 0.5, 0.9, 0.999 };
+    for (int i = 0; i < 4; i++) {
+        double truth = qs[i] * 100000;
+        double got = (double)sketch_quantile(sketch, qs[i]);
+        TEST_ASSERT(got >= truth * 0.984 && got <= truth * 1.016, "Quantile should be within 1.6%");
+    }
+    TEST_ASSERT(sketch_quantile(sketch, 1.0) == 100000, "p100 should be the exact maximum");
+    sketch_free(sketch);
+
+    // A --score is counted from the entry's sort_key
+    opts.sort_type = SORT_SCORE;
+    opts.score = score_compile("size * 2", 0);
+    TEST_ASSERT(opts.score != NULL, "Should compile the score");
+    sketch = sketch_create(&opts);
+    entry.st.st_size = 50;
+    set_sort_key(&entry, &opts);
+    sketch_add(sketch, &entry);
+    TEST_ASSERT(sketch_quantile(sketch, 1.0) == 100, "Score should be read back from sort_key");
+    sketch_free(sketch);
+    score_free(opts.score);
+    
+    TEST_PASS("Distribution sketch");
+}
+
+static int test_shard(void) {
+    options_t opts = {0};
+    TEST_ASSERT(parse_shard("0/2", &opts) != 0 && parse_shard("3/2", &opts) != 0 &&
+               parse_shard("1/", &opts) != 0, "Out of range shards should be rejected");
+    TEST_ASSERT(parse_shard("2/3", &opts) == 0 && opts.shard_index == 2 && opts.shard_count == 3,
+               "Should parse K/N");
+    
+    // Every path belongs to exactly one shard, whatever the root's spelling
+    char path[64];
+    int per_shard[4] = {0};
+    opts.shard_count = 4;
+    for (int i = 0; i < 200; i++) {
+        snprintf(path, sizeof(path), "/data/dir%d", i);
+        int owners = 0;
+        for (int k = 1; k <= 4; k++) {
+            opts.shard_index = k;
+            if (shard_owns(path, strlen("/data"), &opts)) {
+                owners++;
+                per_shard[k - 1]++;
+                TEST_ASSERT(shard_owns(path, strlen("/data/"), &opts), "Owner should not depend on a trailing slash");
+            }
+        }
+        TEST_ASSERT(owners == 1, "Each path should have exactly one shard");
+    }
+    for (int k = 0; k < 4; k++) {
+        TEST_ASSERT(per_shard[k] > 20, "Shards should be roughly balanced");
+    }
+    
+    // Merging reads records back, escaped paths included
+    char *temp_dir = create_temp_dir();
+    TEST_ASSERT(temp_dir != NULL, "Should create temp directory");
+    char file[512];
+    snprintf(file, sizeof(file), "%s/shard1", temp_dir);
+    create_file(file, "# findmax shard 1/2\n"
+                      "100644 0 0 1 1 2 300 8 0 100 0 0 a\\nb\n"
+                      "100644 0 0 1 1 3 700 8 0 200 0 0  lead\\\\\n");
+    char *files[] = { file };
+    options_t merge_opts = {0};
+    merge_opts.sort_type = SORT_SIZE;
+    merge_opts.reverse = 1;
+    min_heap_t *heap = create_min_heap(1, &merge_opts);
+    TEST_ASSERT(heap != NULL, "Should create heap");
+    TEST_ASSERT(traverse_merge(files, 1, &merge_opts, heap) == 0, "Should merge valid records");
+    file_entry_t *entries = get_heap_entries(heap);
+    TEST_ASSERT(get_heap_size(heap) == 1 && entries[0].st.st_size == 700 &&
+               strcmp(entries[0].path, " lead\\") == 0, "Merge should keep the largest record");
+    free_min_heap(heap);
+    
+    snprintf(file, sizeof(file), "%s/shard2", temp_dir);
+    create_file(file, "100644 0 0 1 1 2 300\n");
+    heap = create_min_heap(1, &merge_opts);
+    TEST_ASSERT(traverse_merge(files, 1, &merge_opts, heap) != 0, "Truncated records should be reported");
+    free_min_heap(heap);
+    cleanup_temp_dir(temp_dir);
+    free(temp_dir);
+    
+    TEST_PASS("Shards and merge");
+}
+
+static int test_mount_policy(void) {
+    char *temp_dir = create_temp_dir();
+    TEST_ASSERT(temp_dir != NULL, "Should create temp directory");
+    char path[512];
+    snprintf(path, sizeof(path), "%s/skipped", temp_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/skipped/big", temp_dir);
+    create_file(path, "0123456789012345678901234567890123456789");
+    snprintf(path, sizeof(path), "%s/kept", temp_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/kept/small", temp_dir);
+    create_file(path, "0123");
+    
+    // Rules match however the walk spells the path
+    char policy_file[512];
+    snprintf(policy_file, sizeof(policy_file), "%s/policy", temp_dir);
+    char policy[1024];
+    snprintf(policy, sizeof(policy), "# comment\n%s//skipped/  skip\ntype:nfs deadline 30s\n", temp_dir);
+    create_file(policy_file, policy);
+    
+    options_t opts = {0};
+    opts.recursive = 1;
+    opts.max_depth = -1;
+    opts.sort_type = SORT_SIZE;
+    opts.reverse = 1;
+    opts.filter_type = FILTER_FILE_ONLY;
+    opts.xdev = 1;
+    opts.mount_policy = mount_policy_load(policy_file);
+    TEST_ASSERT(opts.mount_policy != NULL, "Should load the policy");
+    min_heap_t *heap = create_min_heap(8, &opts);
+    TEST_ASSERT(heap != NULL, "Should create heap");
+    traverse_directory_optimized(temp_dir, &opts, heap, 0);
+    file_entry_t *entries = get_heap_entries(heap);
+    size_t count = get_heap_size(heap);
+    TEST_ASSERT(count == 2, "Should find the files outside the skipped mount point");
+    for (size_t i = 0; i < count; i++) {
+        TEST_ASSERT(strstr(entries[i].path, "skipped") == NULL, "Skipped mount point should not be read");
+    }
+    free_min_heap(heap);
+    mount_policy_free(opts.mount_policy);
+    
+    snprintf(path, sizeof(path), "%s/policy2", temp_dir);
+    create_file(path, "/mnt skip extra\n");
+    TEST_ASSERT(mount_policy_load(path) == NULL, "Should reject text after a rule");
+    snprintf(path, sizeof(path), "%s/policy3", temp_dir);
+    create_file(path, "type:nfs deadline soon\n");
+    TEST_ASSERT(mount_policy_load(path) == NULL, "Should reject an invalid deadline");
+    cleanup_temp_dir(temp_dir);
+    free(temp_dir);
+    
+    TEST_PASS("Mount policies");
+}
+
+static int test_split_directory(void) {
+    char *temp_dir = create_temp_dir();
+    TEST_ASSERT(temp_dir != NULL, "Should create temp directory");
+    char path[512];
+    char content[64];
+    int files = SPLIT_START_ENTRIES + 500;
+    for (int i = 0; i < files; i++) {
+        snprintf(path, sizeof(path), "%s/f%d", temp_dir, i);
+        memset(content, 'x', sizeof(content));
+        content[i % 50] = '\0';
+        create_file(path, content);
+    }
+    snprintf(path, sizeof(path), "%s/sub", temp_dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/sub/largest", temp_dir);
+    memset(content, 'x', sizeof(content));
+    content[sizeof(content) - 1] = '\0';
+    create_file(path, content);
+    
+    // Worker heaps merged, and the walking thread's own finds, give the
+    // same ranking as one thread
+    off_t sizes[2][5];
+    for (int run = 0; run < 2; run++) {
+        options_t opts = {0};
+        opts.recursive = 1;
+        opts.max_depth = -1;
+        opts.sort_type = SORT_SIZE;
+        opts.reverse = 1;
+        opts.filter_type = FILTER_FILE_ONLY;
+        opts.num_files = 5;
+        opts.threads = run == 0 ? 1 : 4;
+        min_heap_t *heap = create_min_heap(5, &opts);
+        TEST_ASSERT(heap != NULL, "Should create heap");
+        traverse_directory_optimized(temp_dir, &opts, heap, 0);
+        TEST_ASSERT(get_heap_size(heap) == 5, "Should keep the top 5");
+        file_entry_t *entries = get_heap_entries(heap);
+        // Largest first
+        for (int i = 0; i < 5; i++) {
+            int j = i;
+            while (j > 0 && sizes[run][j - 1] < entries[i].st.st_size) {
+                sizes[run][j] = sizes[run][j - 1];
+                j--;
+            }
+            sizes[run][j] = entries[i].st.st_size;
+        }
+        free_min_heap(heap);
+        
+        file_entry_t best = {0};
+        traverse_directory_single(temp_dir, &opts, &best, 0);
+        TEST_ASSERT(strstr(best.path, "/sub/largest") != NULL, "Single walk should find the largest file");
+    }
+    TEST_ASSERT(sizes[1][0] == 63 && memcmp(sizes[0], sizes[1], sizeof(sizes[0])) == 0,
+               "Split directory should rank like a serial walk");
+    cleanup_temp_dir(temp_dir);
+    free(temp_dir);
+    
+    TEST_PASS("Giant directory split between workers");
+}
+
 int main(void) {
     printf("=== findmax Unit Tests ===\n\n");
     
@@ -439,12 +1661,33 @@ int main(void) {
     RUN_TEST(test_file_list_addition);
     RUN_TEST(test_file_list_expansion);
     RUN_TEST(test_should_include_file);
+    RUN_TEST(test_predicate_filters);
     RUN_TEST(test_traverse_directory);
     RUN_TEST(test_max_depth);
     RUN_TEST(test_sorting_by_time);
     RUN_TEST(test_sorting_by_size);
     RUN_TEST(test_format_output);
     RUN_TEST(test_reverse_sorting);
+    RUN_TEST(test_ignore_vcs);
+    RUN_TEST(test_breadth_first);
+    RUN_TEST(test_approximate);
+    RUN_TEST(test_scan_stats);
+    RUN_TEST(test_snapshot);
+    RUN_TEST(test_snapshot_roots);
+    RUN_TEST(test_snapshot_diff);
+    RUN_TEST(test_files_from);
+    RUN_TEST(test_group_by);
+    RUN_TEST(test_totals);
+    RUN_TEST(test_sort_keys);
+    RUN_TEST(test_queries);
+    RUN_TEST(test_score);
+    RUN_TEST(test_sketch);
+    RUN_TEST(test_until_size);
+    RUN_TEST(test_exec);
+    RUN_TEST(test_batch);
+    RUN_TEST(test_shard);
+    RUN_TEST(test_mount_policy);
+    RUN_TEST(test_split_directory);
     
     printf("=== Test Results ===\n");
     printf("Tests run: %d\n", test_count);
@@ -0,0 +1,255 @@
+#include "findmax.h"
+
+// Cumulative directory sizes for --total (du-style ranking).
+//
+// The tree is walked depth-first with an explicit stack of open
+// directories instead of recursion, so deep trees cannot overflow the C
+// stack. Every frame accumulates the bytes, blocks and file count of its
+// subtree; when a directory is exhausted its frame is popped, the
+// directory is offered to the heap with the chosen total as its size,
+// and the totals are added to the parent frame. Files with more than one
+// link are counted once, at the first path they are seen under, as du
+// does.
+//
+// Entries are stat()ed relative to the open directory with fstatat(), so
+// each lookup resolves a single component rather than the whole path.
+
+typedef struct {
+    DIR *dir;
+    size_t path_len;
+    int depth;
+    struct stat st;
+    ignore_rules_t *rules;
+    uint64_t bytes;
+    uint64_t blocks;
+    uint64_t files;
+} total_frame_t;
+
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+} inode_key_t;
+
+typedef struct {
+    inode_key_t *keys;
+    size_t count;
+    size_t capacity;
+} inode_set_t;
+
+static size_t inode_slot(const inode_set_t *set, dev_t dev, ino_t ino) {
+    uint64_t h = (uint64_t)dev * 0x9E3779B97F4A7C15ULL ^ (uint64_t)ino;
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 32;
+    return (size_t)h & (set->capacity - 1);
+}
+
+// Record (dev, ino); returns 1 if it was already present, -1 on allocation
+// failure. Slots with ino 0 are empty.
+static int inode_set_add(inode_set_t *set, dev_t dev, ino_t ino) {
+    if ((set->count + 1) * 2 > set->capacity) {
+        size_t new_capacity = set->capacity ? set->capacity * 2 : 256;
+        inode_key_t *keys = calloc(new_capacity, sizeof(inode_key_t));
+        if (!keys) return -1;
+        inode_set_t grown = { keys, set->count, new_capacity };
+        for (size_t i = 0; i < set->capacity; i++) {
+            if (!set->keys[i].ino) continue;
+            size_t j = inode_slot(&grown, set->keys[i].dev, set->keys[i].ino);
+            while (keys[j].ino) j = (j + 1) & (new_capacity - 1);
+            keys[j] = set->keys[i];
+        }
+        free(set->keys);
+        *set = grown;
+    }
+    
+    size_t i = inode_slot(set, dev, ino);
+    while (set->keys[i].ino) {
+        if (set->keys[i].dev == dev && set->keys[i].ino == ino) return 1;
+        i = (i + 1) & (set->capacity - 1);
+    }
+    set->keys[i].dev = dev;
+    set->keys[i].ino = ino;
+    set->count++;
+    return 0;
+}
+
+static int push_frame(total_frame_t **stack, size_t *depth, size_t *capacity, const char *path, size_t path_len, int level, const struct stat *st, ignore_rules_t *rules, const options_t *opts) {
+    if (*depth >= *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 32;
+        total_frame_t *frames = realloc(*stack, sizeof(total_frame_t) * new_capacity);
+        if (!frames) return -1;
+        *stack = frames;
+        *capacity = new_capacity;
+    }
+    
+    DIR *dir = open_directory(path);
+    if (!dir) return -1;
+    
+    total_frame_t *frame = &(*stack)[(*depth)++];
+    frame->dir = dir;
+    frame->path_len = path_len;
+    frame->depth = level;
+    frame->st = *st;
+    frame->rules = opts->ignore_vcs ? ignore_rules_enter(rules, path) : NULL;
+    // A directory's own blocks count towards its total, as in du
+    frame->bytes = (uint64_t)st->st_size;
+    frame->blocks = (uint64_t)st->st_blocks;
+    frame->files = 0;
+    return 0;
+}
+
+// Offer a finished directory with its total in st_size and the cumulative
+// block count in st_blocks
+static void offer_total(const char *path, const total_frame_t *frame, const options_t *opts, min_heap_t *heap) {
+    if (opts->max_depth >= 0 && frame->depth > opts->max_depth) {
+        return;
+    }
+    struct stat st = frame->st;
+    st.st_blocks = (blkcnt_t)frame->blocks;
+    switch (opts->total) {
+        case TOTAL_BLOCKS:
+            st.st_size = (off_t)(frame->blocks * 512);
+            break;
+        case TOTAL_COUNT:
+            st.st_size = (off_t)frame->files;
+            break;
+        case TOTAL_SIZE:
+        default:
+            st.st_size = (off_t)frame->bytes;
+            break;
+    }
+    heap_offer(heap, path, &st, opts);
+}
+
+// Walk one root, offering every directory under it with its total
+static int total_root(const char *root, const options_t *opts, const options_t *count_opts, min_heap_t *heap, inode_set_t *seen) {
+    char path[MAX_PATH_LEN];
+    size_t root_len = strlen(root);
+    if (root_len >= sizeof(path)) {
+        if (!opts->quiet) {
+            fprintf(stderr, "findmax: path too long: %s\n", root);
+        }
+        return -1;
+    }
+    memcpy(path, root, root_len + 1);
+    
+    struct stat st;
+    if (stat_path(path, &st, opts) != 0) {
+        if (!opts->quiet) {
+            perror(path);
+        }
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode) || !mount_may_enter(path, &st, 0, 0, opts)) {
+        return 0;
+    }
+    
+    total_frame_t *stack = NULL;
+    size_t depth = 0, capacity = 0;
+    if (push_frame(&stack, &depth, &capacity, path, root_len, 0, &st, NULL, opts) != 0) {
+        if (!opts->quiet) {
+            perror(path);
+        }
+        free(stack);
+        return -1;
+    }
+    
+    while (depth > 0) {
+        total_frame_t *frame = &stack[depth - 1];
+        struct dirent *entry = read_directory(frame->dir);
+        
+        if (!entry) {
+            // Subtree complete: rank it, then fold it into the parent
+            closedir(frame->dir);
+            ignore_rules_release(frame->rules);
+            path[frame->path_len] = '\0';
+            offer_total(path, frame, opts, heap);
+            if (depth > 1) {
+                total_frame_t *parent = &stack[depth - 2];
+                parent->bytes += frame->bytes;
+                parent->blocks += frame->blocks;
+                parent->files += frame->files;
+            }
+            depth--;
+            continue;
+        }
+        
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        
+        path[frame->path_len] = '\0';
+        int ret = snprintf(path + frame->path_len, sizeof(path) - frame->path_len, "/%s", entry->d_name);
+        if (ret < 0 || (size_t)ret >= sizeof(path) - frame->path_len) {
+            if (!opts->quiet) {
+                path[frame->path_len] = '\0';
+                fprintf(stderr, "findmax: path too long: %s/%s\n", path, entry->d_name);
+            }
+            continue;
+        }
+        size_t path_len = frame->path_len + (size_t)ret;
+        STATS_ADD(path_bytes, path_len);
+        
+        if (opts->ignore_vcs && ignore_should_prune(frame->rules, path, entry, opts)) {
+            continue;
+        }
+        
+        if (opts->mount_policy && mount_path_skipped(path, opts)) {
+            continue;
+        }
+        
+        // The directory is open anyway, so stat resolves one component
+        if (stat_path_at(dirfd(frame->dir), entry->d_name, &st, opts) != 0) {
+            if (!opts->quiet) {
+                perror(path);
+            }
+            continue;
+        }
+        
+        if (S_ISDIR(st.st_mode)) {
+            // Like du -x, a mount point left unread counts for nothing
+            if (!mount_may_enter(path, &st, frame->st.st_dev, frame->depth + 1, opts)) {
+                continue;
+            }
+            if (push_frame(&stack, &depth, &capacity, path, path_len, frame->depth + 1, &st, frame->rules, opts) != 0) {
+                if (!opts->quiet) {
+                    perror(path);
+                }
+                // Unreadable: its own blocks still count, as in du
+                frame = &stack[depth - 1];
+                frame->bytes += (uint64_t)st.st_size;
+                frame->blocks += (uint64_t)st.st_blocks;
+            }
+            continue;
+        }
+        
+        if (!should_include_name(path, count_opts) || !should_include_file(&st, count_opts)) {
+            continue;
+        }
+        if (st.st_nlink > 1 && inode_set_add(seen, st.st_dev, st.st_ino) == 1) {
+            continue;
+        }
+        frame->bytes += (uint64_t)st.st_size;
+        frame->blocks += (uint64_t)st.st_blocks;
+        frame->files++;
+    }
+    
+    free(stack);
+    return 0;
+}
+
+int traverse_totals(char **paths, int path_count, const options_t *opts, min_heap_t *heap) {
+    // Filters select the files that are counted; every directory is ranked
+    options_t count_opts = *opts;
+    count_opts.filter_type = FILTER_ALL;
+    
+    inode_set_t seen = {0};
+    int failed = 0;
+    for (int i = 0; i < path_count; i++) {
+        if (total_root(paths[i], opts, &count_opts, heap, &seen) != 0) {
+            failed = 1;
+        }
+    }
+    free(seen.keys);
+    return failed ? -1 : 0;
+}